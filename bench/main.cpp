@@ -0,0 +1,671 @@
+#include "WindowCanvas.h"
+#include "Kernels.h"
+#include "Sprite.h"
+#include "DrawList.h"
+#include "BitmapFont.h"
+#include "Composite.h"
+#include "CanvasView.h"
+#include "Thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Throughput benchmarks for the hot paths: presenting, filling and event
+// draining. Every result is a rate, so higher is better. Results can be
+// written as CSV and JSON and compared against a baseline file in the CSV
+// format, any result dropping more than the tolerance below it fails the run.
+
+static const uint32_t MAX_RESULTS = 128;
+static const uint32_t MAX_NAME_LENGTH = 64;
+
+struct Result {
+	char name[MAX_NAME_LENGTH];
+	const char* unit;
+	double value;
+};
+
+struct Options {
+	const char* csvPath;
+	const char* jsonPath;
+	const char* baselinePath;
+	bool updateBaseline;
+	double tolerance;
+	// Minimum time spent on every measurement, in seconds.
+	double minTime;
+};
+
+static Result results[MAX_RESULTS];
+static uint32_t resultCount = 0;
+
+static void addResult(const char* unit, double value, const char* format, ...) {
+	if (resultCount == MAX_RESULTS) {
+		return;
+	}
+	Result& result = results[resultCount++];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(result.name, sizeof(result.name), format, args);
+	va_end(args);
+	result.unit = unit;
+	result.value = value;
+	printf("%-40s %12.2f %s\n", result.name, value, unit);
+}
+
+// Run 'function' in batches of growing size until one batch takes at least
+// a tenth of 'minTime', then keep timing batches until 'minTime' is spent.
+// Returns the best rate in calls per second, the least disturbed batch.
+template <typename Function>
+static double measure(Function function, double minTime) {
+	function();
+	uint32_t batch = 1;
+	double best = 0.0;
+	double total = 0.0;
+	while (total < minTime) {
+		const uint64_t start = getMonotonicTime();
+		for (uint32_t index = 0; index < batch; ++index) {
+			function();
+		}
+		const double elapsed = (getMonotonicTime() - start) / 1e9;
+		total += elapsed;
+		if (elapsed < minTime / 10.0) {
+			batch *= 2;
+			continue;
+		}
+		const double rate = batch / elapsed;
+		if (rate > best) {
+			best = rate;
+		}
+	}
+	return best;
+}
+
+// Xorshift, the same inputs on every run.
+static uint32_t nextRandom(uint32_t& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Premultiplied pixel, a quarter of them fully transparent or opaque.
+static uint32_t randomPremultiplied(uint32_t& state) {
+	const uint32_t value = nextRandom(state);
+	const uint32_t alpha = ((value & 3) == 0) ? 0 : ((value & 3) == 1) ? 255 : value >> 24;
+	const uint32_t r = ((value >> 2) & 0xFF) * alpha / 255;
+	const uint32_t g = ((value >> 10) & 0xFF) * alpha / 255;
+	const uint32_t b = ((value >> 16) & 0xFF) * alpha / 255;
+	return alpha << 24 | r << 16 | g << 8 | b;
+}
+
+static uint32_t reportMismatch(const char* format, ...) {
+	char name[128];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(name, sizeof(name), format, args);
+	va_end(args);
+	fprintf(stderr, "MISMATCH %s\n", name);
+	return 1;
+}
+
+// Run the selected kernels and the scalar reference on the same inputs, the
+// vector kernels promise bit identical results. Spans start one pixel off
+// alignment and cover every tail length of the vector loops. Returns the
+// number of mismatches.
+static uint32_t verifyKernels() {
+	static const uint32_t COUNTS[] = {1, 3, 7, 8, 15, 16, 17, 31, 33, 63, 65, 255, 1023};
+	static const uint32_t MAX_COUNT = 1024;
+	static const uint8_t ALPHAS[] = {0, 1, 128, 255};
+	const Kernels& reference = getReferenceKernels();
+	const Kernels& kernels = getKernels();
+	uint32_t* buffers = (uint32_t*)malloc(5 * MAX_COUNT * sizeof(uint32_t));
+	if (buffers == nullptr) {
+		fprintf(stderr, "Failed to allocate the verification buffers.\n");
+		return 1;
+	}
+	uint32_t* src = buffers;
+	uint32_t* expected = buffers + MAX_COUNT;
+	uint32_t* actual = buffers + 2 * MAX_COUNT;
+	uint32_t* columns = buffers + 3 * MAX_COUNT;
+	uint32_t* weights = buffers + 4 * MAX_COUNT;
+	uint32_t state = 0x12345678;
+	uint32_t failures = 0;
+
+	for (uint32_t count : COUNTS) {
+		for (uint32_t mode = 0; mode < BlendModeCount; ++mode) {
+			for (uint8_t alpha : ALPHAS) {
+				for (uint32_t index = 0; index < MAX_COUNT; ++index) {
+					src[index] = randomPremultiplied(state);
+					expected[index] = randomPremultiplied(state);
+				}
+				memcpy(actual, expected, MAX_COUNT * sizeof(uint32_t));
+				reference.composite32[mode](expected + 1, src + 1, count, alpha);
+				kernels.composite32[mode](actual + 1, src + 1, count, alpha);
+				if (memcmp(expected, actual, MAX_COUNT * sizeof(uint32_t)) != 0) {
+					failures += reportMismatch("composite32/%s/mode %u/alpha %u/%u", kernels.name, mode, alpha, count);
+				}
+			}
+		}
+	}
+
+	// Rows of any byte length, 'pitch' apart, from an odd address.
+	static const uint32_t LENGTHS[] = {1, 7, 15, 16, 17, 31, 33, 63, 64, 65, 127, 129, 255, 513};
+	uint8_t* bytes = (uint8_t*)src;
+	for (uint32_t index = 0; index < MAX_COUNT; ++index) {
+		src[index] = nextRandom(state);
+	}
+	for (uint32_t length : LENGTHS) {
+		for (uint32_t rows = 1; rows <= 3; ++rows) {
+			const uint32_t pitch = length + 5;
+			if (reference.hashRows(bytes + 1, pitch, length, rows) != kernels.hashRows(bytes + 1, pitch, length, rows)) {
+				failures += reportMismatch("hashRows/%s/%ux%u", kernels.name, length, rows);
+			}
+		}
+	}
+
+	// Two source rows of random pixels, random columns with a next column,
+	// weights anywhere in 0 to 256 with both ends included.
+	const uint32_t rowWidth = MAX_COUNT / 2;
+	static const uint32_t ROW_WEIGHTS[] = {0, 1, 128, 255, 256};
+	for (uint32_t count : COUNTS) {
+		for (uint32_t weight : ROW_WEIGHTS) {
+			for (uint32_t index = 0; index < MAX_COUNT; ++index) {
+				src[index] = nextRandom(state);
+				columns[index] = nextRandom(state) % (rowWidth - 1);
+				const uint32_t value = nextRandom(state);
+				weights[index] = ((value & 7) == 0) ? 0 : ((value & 7) == 1) ? 256 : (value >> 8) % 257;
+			}
+			memset(expected, 0, MAX_COUNT * sizeof(uint32_t));
+			memset(actual, 0, MAX_COUNT * sizeof(uint32_t));
+			reference.scaleBilinear32(expected + 1, src, src + rowWidth, columns, weights, weight, count);
+			kernels.scaleBilinear32(actual + 1, src, src + rowWidth, columns, weights, weight, count);
+			if (memcmp(expected, actual, MAX_COUNT * sizeof(uint32_t)) != 0) {
+				failures += reportMismatch("scaleBilinear32/%s/weight %u/%u", kernels.name, weight, count);
+			}
+		}
+	}
+
+	// Every index value, from an odd address, through a random palette.
+	uint32_t palette[256];
+	for (uint32_t index = 0; index < 256; ++index) {
+		palette[index] = nextRandom(state);
+	}
+	for (uint32_t count : COUNTS) {
+		for (uint32_t index = 0; index < MAX_COUNT; ++index) {
+			bytes[index] = (uint8_t)((index & 1) ? nextRandom(state) : index);
+		}
+		memset(expected, 0, MAX_COUNT * sizeof(uint32_t));
+		memset(actual, 0, MAX_COUNT * sizeof(uint32_t));
+		reference.expandIndex8(expected + 1, bytes + 1, count, palette);
+		kernels.expandIndex8(actual + 1, bytes + 1, count, palette);
+		if (memcmp(expected, actual, MAX_COUNT * sizeof(uint32_t)) != 0) {
+			failures += reportMismatch("expandIndex8/%s/%u", kernels.name, count);
+		}
+	}
+
+	free(buffers);
+	printf("Verified the %s kernels against %s: %u mismatches.\n", kernels.name, reference.name, failures);
+	return failures;
+}
+
+static const char* getBackendName(const WindowCanvas& canvas) {
+	switch (canvas.getBackend()) {
+	case WindowCanvas::Headless :
+		return "headless";
+	case WindowCanvas::Xcb :
+		return "xcb";
+	default :
+		return "native";
+	}
+}
+
+// Stands in for the upload of a headless canvas, so that present results
+// include the copy of the frame.
+static void copyFrame(const WindowCanvas& canvas, const WindowRect* rects, uint32_t count, void* user) {
+	uint8_t* dst = (uint8_t*)user;
+	const uint8_t* src = canvas.getPixelBuffer();
+	const uint32_t bytesPerPixel = getBytesPerPixel(canvas.getPixelFormat());
+	const uint32_t pitch = canvas.getStride();
+	for (uint32_t index = 0; index < count; ++index) {
+		const WindowRect& rect = rects[index];
+		for (uint32_t y = rect.y; y < rect.y + rect.height; ++y) {
+			const uint32_t offset = y * pitch + rect.x * bytesPerPixel;
+			memcpy(dst + offset, src + offset, rect.width * bytesPerPixel);
+		}
+	}
+}
+
+static void benchPresent(const Options& options) {
+	static const uint32_t SIZES[][2] = {{640, 480}, {1280, 720}, {1920, 1080}};
+	static const uint8_t DEPTHS[] = {8, 16, 24, 32};
+
+	for (const uint32_t* size : SIZES) {
+		for (uint8_t depth : DEPTHS) {
+			WindowCanvas canvas(size[0], size[1], depth, "bench");
+			if (canvas.getPixelBuffer() == nullptr) {
+				fprintf(stderr, "Failed to create a %ux%u %u bit canvas.\n", size[0], size[1], depth);
+				continue;
+			}
+			uint8_t* frame = nullptr;
+			if (canvas.getBackend() == WindowCanvas::Headless) {
+				frame = (uint8_t*)malloc(canvas.getPixelBufferLength());
+				if (frame != nullptr) {
+					canvas.setFrameSink(copyFrame, frame);
+				}
+			}
+			canvas.clear(0x00336699);
+			const double fps = measure([&]() {
+				canvas.blit();
+			}, options.minTime);
+			const char* backend = getBackendName(canvas);
+			addResult("frames/s", fps, "present/%s/%ux%ux%u", backend, size[0], size[1], depth);
+			addResult("MB/s", fps * canvas.getPixelBufferLength() / 1e6, "present/%s/%ux%ux%u/bandwidth", backend, size[0], size[1], depth);
+			free(frame);
+		}
+	}
+}
+
+// Fill and blend through the typed view of one layout.
+template <PixelFormat FORMAT>
+static void benchView(const Options& options, uint8_t depth, const uint32_t* image, uint32_t imageSize) {
+	WindowCanvas canvas(1920, 1080, depth, "bench", WindowCanvas::Headless);
+	const CanvasView<FORMAT> view(canvas);
+	if (!view.isValid()) {
+		return;
+	}
+	double rate = measure([&]() {
+		view.fill(1, 1, view.getWidth() - 2, view.getHeight() - 2, 0x00654321);
+	}, options.minTime);
+	addResult("Mpixels/s", rate * (view.getWidth() - 2) * (view.getHeight() - 2) / 1e6, "view/fill/1920x1080x%u", depth);
+
+	rate = measure([&]() {
+		view.template blend<BlendSrcOver>(100, 100, image, imageSize, imageSize, imageSize);
+	}, options.minTime);
+	addResult("Mpixels/s", rate * imageSize * imageSize / 1e6, "view/blend/%ux%u/%u", imageSize, imageSize, depth);
+}
+
+static void benchFill(const Options& options) {
+	// One span in the caches, one well beyond them.
+	static const uint32_t COUNTS[] = {64 * 1024, 8 * 1024 * 1024};
+	const uint32_t maxCount = COUNTS[sizeof(COUNTS) / sizeof(COUNTS[0]) - 1];
+	uint32_t* dst = (uint32_t*)malloc(maxCount * sizeof(uint32_t));
+	uint32_t* src = (uint32_t*)malloc(maxCount * sizeof(uint32_t));
+	if (dst == nullptr || src == nullptr) {
+		fprintf(stderr, "Failed to allocate the fill buffers.\n");
+		free(dst);
+		free(src);
+		return;
+	}
+	for (uint32_t index = 0; index < maxCount; ++index) {
+		src[index] = (index * 2654435761u) & 0x80FFFFFF;
+		dst[index] = 0xFF000000 | index;
+	}
+
+	const Kernels* tables[] = {&getReferenceKernels(), &getKernels()};
+	for (const Kernels* table : tables) {
+		const Kernels& kernels = *table;
+		for (uint32_t count : COUNTS) {
+			double rate = measure([&]() {
+				kernels.fill32(dst, count, 0x00123456);
+			}, options.minTime);
+			addResult("Mpixels/s", rate * count / 1e6, "fill32/%s/%u", kernels.name, count);
+
+			rate = measure([&]() {
+				kernels.fill32Stream(dst, count, 0x00123456);
+			}, options.minTime);
+			addResult("Mpixels/s", rate * count / 1e6, "fill32Stream/%s/%u", kernels.name, count);
+
+			rate = measure([&]() {
+				kernels.composite32[BlendSrcOver](dst, src, count, 255);
+			}, options.minTime);
+			addResult("Mpixels/s", rate * count / 1e6, "composite32/%s/%u", kernels.name, count);
+		}
+		if (table == tables[1] && kernels.level == Kernels::Scalar) {
+			// No vector kernels, the second pass would repeat the first one.
+			break;
+		}
+	}
+	free(dst);
+	free(src);
+
+	static const uint8_t DEPTHS[] = {8, 16, 24, 32};
+	for (uint8_t depth : DEPTHS) {
+		WindowCanvas canvas(1920, 1080, depth, "bench", WindowCanvas::Headless);
+		if (canvas.getPixelBuffer() == nullptr) {
+			continue;
+		}
+		const uint32_t pixels = canvas.getWidth() * canvas.getHeight();
+		double rate = measure([&]() {
+			canvas.clear(0x00654321);
+		}, options.minTime);
+		addResult("Mpixels/s", rate * pixels / 1e6, "clear/1920x1080x%u", depth);
+
+		rate = measure([&]() {
+			canvas.fillRect(1, 1, canvas.getWidth() - 2, canvas.getHeight() - 2, 0x00654321);
+		}, options.minTime);
+		addResult("Mpixels/s", rate * (canvas.getWidth() - 2) * (canvas.getHeight() - 2) / 1e6, "fillRect/1920x1080x%u", depth);
+	}
+
+	// The palette lookup done by blit() for an 8 bit canvas, into every
+	// presented format.
+	{
+		WindowCanvas canvas(1920, 1080, 8, "bench", WindowCanvas::Headless);
+		const uint32_t width = canvas.getWidth(), height = canvas.getHeight();
+		uint8_t* target = (uint8_t*)malloc(width * height * 4);
+		if (canvas.getPixelBuffer() != nullptr && target != nullptr) {
+			uint8_t* pixels = canvas.getPixelBuffer();
+			for (uint32_t y = 0; y < height; ++y) {
+				for (uint32_t x = 0; x < width; ++x) {
+					pixels[y * canvas.getStride() + x] = (uint8_t)(x ^ y);
+				}
+			}
+			static const PixelFormat FORMATS[] = {PixelFormatXRGB8888, PixelFormatBGRX8888, PixelFormatRGB888, PixelFormatRGB565};
+			static const char* FORMAT_NAMES[] = {"xrgb8888", "bgrx8888", "rgb888", "rgb565"};
+			for (uint32_t index = 0; index < 4; ++index) {
+				const uint32_t targetPitch = width * getBytesPerPixel(FORMATS[index]);
+				const double rate = measure([&]() {
+					expandIndexed(target, targetPitch, FORMATS[index], pixels, canvas.getStride(), canvas.getPalette(), width, height);
+				}, options.minTime);
+				addResult("Mpixels/s", rate * width * height / 1e6, "expandIndexed/1920x1080/%s", FORMAT_NAMES[index]);
+			}
+		}
+		free(target);
+	}
+
+	// Premultiplied gradient with every alpha value.
+	const uint32_t imageSize = 256;
+	uint32_t* image = (uint32_t*)malloc(imageSize * imageSize * sizeof(uint32_t));
+	for (uint32_t index = 0; index < imageSize * imageSize; ++index) {
+		const uint32_t alpha = index & 0xFF;
+		image[index] = alpha << 24 | (alpha / 2) << 16 | (alpha / 3) << 8 | (alpha / 4);
+	}
+	benchView<PixelFormatRGB565>(options, 16, image, imageSize);
+	benchView<PixelFormatRGB888>(options, 24, image, imageSize);
+	benchView<PixelFormatXRGB8888>(options, 32, image, imageSize);
+	free(image);
+
+	// The upscale done by blit() for a quarter resolution render size.
+	static const char* FILTER_NAMES[] = {"nearest", "bilinear"};
+	const uint32_t srcWidth = 480, srcHeight = 270, dstWidth = 1920, dstHeight = 1080;
+	uint32_t* scaleSrc = (uint32_t*)malloc(srcWidth * srcHeight * sizeof(uint32_t));
+	uint32_t* scaleDst = (uint32_t*)malloc(dstWidth * dstHeight * sizeof(uint32_t));
+	if (scaleSrc != nullptr && scaleDst != nullptr) {
+		for (uint32_t index = 0; index < srcWidth * srcHeight; ++index) {
+			scaleSrc[index] = index * 2654435761u;
+		}
+		for (uint32_t filter = ScaleNearest; filter <= ScaleBilinear; ++filter) {
+			const double rate = measure([&]() {
+				scalePixels((uint8_t*)scaleDst, dstWidth * 4, PixelFormatXRGB8888, dstWidth, dstHeight,
+				            (const uint8_t*)scaleSrc, srcWidth * 4, PixelFormatXRGB8888, srcWidth, srcHeight,
+				            0, 0, dstWidth, dstHeight, (ScaleFilter)filter);
+			}, options.minTime);
+			addResult("Mpixels/s", rate * dstWidth * dstHeight / 1e6, "scale/%s/%ux%u-%ux%u", FILTER_NAMES[filter], srcWidth, srcHeight, dstWidth, dstHeight);
+		}
+	}
+	free(scaleSrc);
+	free(scaleDst);
+
+	// A HUD of small icons: a ring of opaque pixels around a translucent
+	// centre, transparent corners.
+	WindowCanvas canvas(1920, 1080, 32, "bench", WindowCanvas::Headless);
+	uint32_t icon[16 * 16];
+	for (uint32_t index = 0; index < 16 * 16; ++index) {
+		const int32_t dx = (int32_t)(index % 16) * 2 - 15, dy = (int32_t)(index / 16) * 2 - 15;
+		const int32_t distance = dx * dx + dy * dy;
+		icon[index] = (distance > 225) ? 0 : (distance > 100) ? 0xFF3366CC : 0x80193366;
+	}
+	const Sprite sprite(Image(icon, 16, 16));
+	static const uint32_t SPRITE_COUNT = 4096;
+	SpriteDraw* draws = (SpriteDraw*)malloc(SPRITE_COUNT * sizeof(SpriteDraw));
+	if (canvas.getPixelBuffer() != nullptr && draws != nullptr) {
+		for (uint32_t index = 0; index < SPRITE_COUNT; ++index) {
+			draws[index].sprite = &sprite;
+			draws[index].x = (int32_t)((index * 37) % 1930) - 8;
+			draws[index].y = (int32_t)((index * 53) % 1090) - 8;
+			draws[index].flags = index & SpriteFlipX;
+		}
+		const double rate = measure([&]() {
+			drawSprites(canvas, draws, SPRITE_COUNT);
+		}, options.minTime);
+		addResult("sprites/s", rate * SPRITE_COUNT, "sprites/16x16/%u", SPRITE_COUNT);
+	}
+	free(draws);
+
+	// A chart: polylines of short segments across the whole canvas, recorded
+	// and rasterized per tile every frame.
+	static const uint32_t SEGMENT_COUNT = 20000;
+	static const uint32_t SERIES_COUNT = 8;
+	static const char* const LINE_NAMES[] = {"line", "lineAA"};
+	if (canvas.getPixelBuffer() != nullptr) {
+		DrawList list;
+		for (uint32_t antiAliased = 0; antiAliased < 2; ++antiAliased) {
+			const double rate = measure([&]() {
+				list.clear();
+				const uint32_t perSeries = SEGMENT_COUNT / SERIES_COUNT;
+				for (uint32_t series = 0; series < SERIES_COUNT; ++series) {
+					float previous = 540.0f;
+					for (uint32_t index = 0; index < perSeries; ++index) {
+						const float x0 = index * 1920.0f / perSeries, x1 = (index + 1) * 1920.0f / perSeries;
+						const float y = 540.0f + (float)(((index * 7919 + series * 104729) % 1001) - 500) * 0.9f;
+						if (antiAliased) {
+							list.lineAA(x0, previous, x1, y, 0xFF40C040);
+						} else {
+							list.line((int32_t)x0, (int32_t)previous, (int32_t)x1, (int32_t)y, 0xFF40C040);
+						}
+						previous = y;
+					}
+				}
+				list.execute(canvas);
+				canvas.waitTiles();
+			}, options.minTime);
+			addResult("segments/s", rate * SEGMENT_COUNT, "drawlist/%s/%u", LINE_NAMES[antiAliased], SEGMENT_COUNT);
+		}
+	}
+
+	// Overlay labels, a few hundred distinct strings drawn again every frame.
+	static const uint32_t LABEL_COUNT = 4096;
+	if (canvas.getPixelBuffer() != nullptr) {
+		BitmapFont font;
+		char labels[256][16];
+		for (uint32_t index = 0; index < 256; ++index) {
+			snprintf(labels[index], sizeof(labels[index]), "node %u: %u%%", index, index * 37 % 100);
+		}
+		const double rate = measure([&]() {
+			for (uint32_t index = 0; index < LABEL_COUNT; ++index) {
+				font.draw(canvas, (int32_t)((index * 97) % 1900) - 10, (int32_t)((index * 31) % 1080), labels[index % 256], 0xFFE0E0E0);
+			}
+		}, options.minTime);
+		addResult("labels/s", rate * LABEL_COUNT, "text/labels/%u", LABEL_COUNT);
+	}
+}
+
+static void benchEvents(const Options& options) {
+	WindowCanvas canvas(320, 240, 32, "bench");
+	if (canvas.getPixelBuffer() == nullptr) {
+		fprintf(stderr, "Failed to create the event canvas.\n");
+		return;
+	}
+	canvas.setEventCoalescing(false);
+	// Headless events go through the injection queue, keep within it.
+	const uint32_t batch = (canvas.getBackend() == WindowCanvas::Headless) ? 256 : 1024;
+	WindowEvent events[256];
+	bool failed = false;
+
+	const double rate = measure([&]() {
+		for (uint32_t index = 0; index < batch; ++index) {
+			WindowEvent event;
+			if (index & 1) {
+				event.type = WindowEvent::CursorMove;
+				event.x = index % 320;
+				event.y = index % 240;
+			} else {
+				event.type = WindowEvent::ButtonPressed;
+				event.button = 1;
+			}
+			canvas.postEvent(event);
+		}
+		// Synthetic events travel through the server, stop waiting after a second.
+		uint32_t received = 0;
+		const uint64_t deadline = getMonotonicTime() + 1000000000ull;
+		while (received < batch && !failed) {
+			received += canvas.pollEvents(events, 256);
+			if (getMonotonicTime() > deadline) {
+				failed = true;
+			}
+		}
+	}, options.minTime);
+
+	if (failed) {
+		fprintf(stderr, "Lost synthetic events, skipping the event results.\n");
+		return;
+	}
+	addResult("events/s", rate * batch, "events/%s/drain", getBackendName(canvas));
+}
+
+static bool writeCsv(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == nullptr) {
+		fprintf(stderr, "Failed to open '%s'.\n", path);
+		return false;
+	}
+	fprintf(file, "name,value,unit\n");
+	for (uint32_t index = 0; index < resultCount; ++index) {
+		fprintf(file, "%s,%.3f,%s\n", results[index].name, results[index].value, results[index].unit);
+	}
+	fclose(file);
+	return true;
+}
+
+static bool writeJson(const char* path, const Kernels& kernels) {
+	FILE* file = fopen(path, "w");
+	if (file == nullptr) {
+		fprintf(stderr, "Failed to open '%s'.\n", path);
+		return false;
+	}
+	fprintf(file, "{\n\t\"kernels\": \"%s\",\n\t\"threads\": %u,\n\t\"results\": [\n", kernels.name, Thread::getProcessorCount());
+	for (uint32_t index = 0; index < resultCount; ++index) {
+		fprintf(file, "\t\t{\"name\": \"%s\", \"value\": %.3f, \"unit\": \"%s\"}%s\n",
+		        results[index].name, results[index].value, results[index].unit, (index + 1 < resultCount) ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+	return true;
+}
+
+// Compare the results against a baseline CSV. Returns the number of
+// regressions, or -1 if the baseline could not be read.
+static int compareBaseline(const char* path, double tolerance) {
+	FILE* file = fopen(path, "r");
+	if (file == nullptr) {
+		return -1;
+	}
+	char line[256];
+	int regressions = 0;
+	uint32_t compared = 0;
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		char name[MAX_NAME_LENGTH];
+		double value;
+		if (sscanf(line, "%63[^,],%lf", name, &value) != 2) {
+			// Header or malformed line.
+			continue;
+		}
+		for (uint32_t index = 0; index < resultCount; ++index) {
+			const Result& result = results[index];
+			if (strcmp(result.name, name) != 0) {
+				continue;
+			}
+			++compared;
+			const double change = (value > 0.0) ? (result.value - value) / value : 0.0;
+			if (change < -tolerance) {
+				fprintf(stderr, "REGRESSION %s: %.2f %s, baseline %.2f (%.1f%%)\n", name, result.value, result.unit, value, change * 100.0);
+				++regressions;
+			}
+			break;
+		}
+	}
+	fclose(file);
+	printf("Compared %u results against '%s', %d regressions.\n", compared, path, regressions);
+	return regressions;
+}
+
+static void printUsage(const char* program) {
+	printf("Usage: %s [options]\n"
+	       "  --csv <path>        write the results as CSV\n"
+	       "  --json <path>       write the results as JSON\n"
+	       "  --baseline <path>   compare against a CSV baseline, written if missing\n"
+	       "  --update-baseline   overwrite the baseline with these results\n"
+	       "  --tolerance <pct>   allowed drop below the baseline (default 10)\n"
+	       "  --time <seconds>    minimum time per measurement (default 0.25)\n"
+	       "  --only <group>      run only 'verify', 'present', 'fill' or 'events'\n", program);
+}
+
+int main(int argc, char** argv) {
+	Options options = {nullptr, nullptr, nullptr, false, 0.10, 0.25};
+	const char* only = nullptr;
+	for (int index = 1; index < argc; ++index) {
+		const char* arg = argv[index];
+		const bool hasValue = (index + 1 < argc);
+		if (strcmp(arg, "--csv") == 0 && hasValue) {
+			options.csvPath = argv[++index];
+		} else if (strcmp(arg, "--json") == 0 && hasValue) {
+			options.jsonPath = argv[++index];
+		} else if (strcmp(arg, "--baseline") == 0 && hasValue) {
+			options.baselinePath = argv[++index];
+		} else if (strcmp(arg, "--update-baseline") == 0) {
+			options.updateBaseline = true;
+		} else if (strcmp(arg, "--tolerance") == 0 && hasValue) {
+			options.tolerance = atof(argv[++index]) / 100.0;
+		} else if (strcmp(arg, "--time") == 0 && hasValue) {
+			options.minTime = atof(argv[++index]);
+		} else if (strcmp(arg, "--only") == 0 && hasValue) {
+			only = argv[++index];
+		} else {
+			printUsage(argv[0]);
+			return (strcmp(arg, "--help") == 0) ? 0 : 2;
+		}
+	}
+
+	const Kernels& kernels = getKernels();
+	printf("Kernels: %s, processors: %u\n", kernels.name, Thread::getProcessorCount());
+
+	// Rates of wrong kernels are meaningless, stop before timing them.
+	if ((only == nullptr || strcmp(only, "verify") == 0) && verifyKernels() > 0) {
+		return 1;
+	}
+	if (only == nullptr || strcmp(only, "present") == 0) {
+		benchPresent(options);
+	}
+	if (only == nullptr || strcmp(only, "fill") == 0) {
+		benchFill(options);
+	}
+	if (only == nullptr || strcmp(only, "events") == 0) {
+		benchEvents(options);
+	}
+
+	if (options.csvPath != nullptr && !writeCsv(options.csvPath)) {
+		return 2;
+	}
+	if (options.jsonPath != nullptr && !writeJson(options.jsonPath, kernels)) {
+		return 2;
+	}
+	if (options.baselinePath == nullptr) {
+		return 0;
+	}
+	if (!options.updateBaseline) {
+		const int regressions = compareBaseline(options.baselinePath, options.tolerance);
+		if (regressions > 0) {
+			fprintf(stderr, "%d results regressed more than %.0f%% below the baseline.\n", regressions, options.tolerance * 100.0);
+			return 1;
+		}
+		if (regressions == 0) {
+			return 0;
+		}
+	}
+	// Only record a baseline from a real run on this machine.
+	if (!writeCsv(options.baselinePath)) {
+		return 2;
+	}
+	printf("Wrote the baseline '%s'.\n", options.baselinePath);
+	return 0;
+}
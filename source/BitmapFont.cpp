@@ -0,0 +1,623 @@
+#include "BitmapFont.h"
+#include "Kernels.h"
+#include "WindowCanvas.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+static const uint32_t NO_GLYPH = 0xFFFFFFFF;
+// Font files larger than this are refused.
+static const long MAX_FILE_LENGTH = 16 * 1024 * 1024;
+static const uint32_t MAX_GLYPH_COUNT = 65536;
+static const uint32_t MAX_GLYPH_SIZE = 255;
+// Pixels blended per call for translucent text.
+static const uint32_t BLEND_CHUNK_SIZE = 64;
+
+// font8x8_basic by Daniel Hepper, public domain, from the IBM PC BIOS fonts.
+// U+0020 to U+007E, one byte per row, the LSB is the leftmost pixel.
+static const uint32_t DEFAULT_FIRST = 0x20;
+static const uint32_t DEFAULT_COUNT = 95;
+static const uint8_t DEFAULT_GLYPHS[DEFAULT_COUNT][8] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+	{0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00}, // '!'
+	{0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // '"'
+	{0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00}, // '#'
+	{0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00}, // '$'
+	{0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00}, // '%'
+	{0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00}, // '&'
+	{0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00}, // '''
+	{0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00}, // '('
+	{0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00}, // ')'
+	{0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00}, // '*'
+	{0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00}, // '+'
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ','
+	{0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00}, // '-'
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // '.'
+	{0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00}, // '/'
+	{0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00}, // '0'
+	{0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00}, // '1'
+	{0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00}, // '2'
+	{0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00}, // '3'
+	{0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00}, // '4'
+	{0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00}, // '5'
+	{0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00}, // '6'
+	{0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00}, // '7'
+	{0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00}, // '8'
+	{0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00}, // '9'
+	{0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // ':'
+	{0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ';'
+	{0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00}, // '<'
+	{0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00}, // '='
+	{0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00}, // '>'
+	{0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00}, // '?'
+	{0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, // '@'
+	{0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00}, // 'A'
+	{0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00}, // 'B'
+	{0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00}, // 'C'
+	{0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00}, // 'D'
+	{0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00}, // 'E'
+	{0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00}, // 'F'
+	{0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00}, // 'G'
+	{0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00}, // 'H'
+	{0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'I'
+	{0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00}, // 'J'
+	{0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00}, // 'K'
+	{0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00}, // 'L'
+	{0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00}, // 'M'
+	{0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00}, // 'N'
+	{0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00}, // 'O'
+	{0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00}, // 'P'
+	{0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00}, // 'Q'
+	{0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00}, // 'R'
+	{0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00}, // 'S'
+	{0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'T'
+	{0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00}, // 'U'
+	{0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // 'V'
+	{0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00}, // 'W'
+	{0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00}, // 'X'
+	{0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00}, // 'Y'
+	{0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00}, // 'Z'
+	{0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00}, // '['
+	{0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00}, // '\'
+	{0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00}, // ']'
+	{0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00}, // '^'
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF}, // '_'
+	{0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00}, // '`'
+	{0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00}, // 'a'
+	{0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00}, // 'b'
+	{0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00}, // 'c'
+	{0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00}, // 'd'
+	{0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00}, // 'e'
+	{0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00}, // 'f'
+	{0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // 'g'
+	{0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00}, // 'h'
+	{0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'i'
+	{0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E}, // 'j'
+	{0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00}, // 'k'
+	{0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // 'l'
+	{0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00}, // 'm'
+	{0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00}, // 'n'
+	{0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00}, // 'o'
+	{0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F}, // 'p'
+	{0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78}, // 'q'
+	{0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00}, // 'r'
+	{0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00}, // 's'
+	{0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00}, // 't'
+	{0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00}, // 'u'
+	{0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // 'v'
+	{0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00}, // 'w'
+	{0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00}, // 'x'
+	{0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // 'y'
+	{0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00}, // 'z'
+	{0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00}, // '{'
+	{0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00}, // '|'
+	{0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00}, // '}'
+	{0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // '~'
+};
+
+static uint32_t decodeUtf8(const uint8_t*& text, const uint8_t* end) {
+	const uint32_t lead = *text++;
+	if (lead < 0x80) {
+		return lead;
+	}
+	uint32_t count, codepoint;
+	if ((lead & 0xE0) == 0xC0) {
+		count = 1;
+		codepoint = lead & 0x1F;
+	} else if ((lead & 0xF0) == 0xE0) {
+		count = 2;
+		codepoint = lead & 0x0F;
+	} else if ((lead & 0xF8) == 0xF0) {
+		count = 3;
+		codepoint = lead & 0x07;
+	} else {
+		return REPLACEMENT_CHARACTER;
+	}
+	for (uint32_t index = 0; index < count; ++index) {
+		if (text == end || (*text & 0xC0) != 0x80) {
+			return REPLACEMENT_CHARACTER;
+		}
+		codepoint = (codepoint << 6) | (*text++ & 0x3F);
+	}
+	return codepoint;
+}
+
+static uint8_t reverseBits(uint8_t value) {
+	value = (uint8_t)((value & 0xF0) >> 4 | (value & 0x0F) << 4);
+	value = (uint8_t)((value & 0xCC) >> 2 | (value & 0x33) << 2);
+	return (uint8_t)((value & 0xAA) >> 1 | (value & 0x55) << 1);
+}
+
+static int comparePairs(const void* a, const void* b) {
+	const uint32_t left = *(const uint32_t*)a, right = *(const uint32_t*)b;
+	return (left < right) ? -1 : (left > right) ? 1 : 0;
+}
+
+static uint8_t* readFile(const char* path, uint32_t& length) {
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr) {
+		return nullptr;
+	}
+	uint8_t* data = nullptr;
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && size <= MAX_FILE_LENGTH && fseek(file, 0, SEEK_SET) == 0) {
+		data = new uint8_t[size];
+		if (fread(data, 1, size, file) != (size_t)size) {
+			delete [] data;
+			data = nullptr;
+		}
+	}
+	fclose(file);
+	length = (uint32_t)size;
+	return data;
+}
+
+static uint32_t readLittleEndian(const uint8_t* data) {
+	return data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+// Code point, glyph pairs of a PSF Unicode table, only counted when 'map' is
+// null. Sequences of combining characters are skipped.
+static uint32_t readUnicodeTable(const uint8_t* table, const uint8_t* end, uint32_t glyphCount, bool version2, uint32_t* map) {
+	uint32_t count = 0;
+	for (uint32_t glyph = 0; glyph < glyphCount && table < end; ++glyph) {
+		bool sequence = false;
+		while (table < end) {
+			uint32_t codepoint;
+			if (version2) {
+				if (*table == 0xFF) {
+					++table;
+					break;
+				}
+				if (*table == 0xFE) {
+					++table;
+					sequence = true;
+					continue;
+				}
+				codepoint = decodeUtf8(table, end);
+			} else {
+				if (end - table < 2) {
+					table = end;
+					break;
+				}
+				codepoint = table[0] | (uint32_t)table[1] << 8;
+				table += 2;
+				if (codepoint == 0xFFFF) {
+					break;
+				}
+				if (codepoint == 0xFFFE) {
+					sequence = true;
+					continue;
+				}
+			}
+			if (!sequence) {
+				if (map != nullptr) {
+					map[count * 2] = codepoint;
+					map[count * 2 + 1] = glyph;
+				}
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
+BitmapFont::BitmapFont()
+	: width(0), height(0), glyphCount(0), atlas(nullptr), glyphPitch(0), advances(nullptr), map(nullptr), mapCount(0), fallback(0)
+	, runs(nullptr), hitCount(0), missCount(0) {
+	loadDefault();
+}
+
+BitmapFont::~BitmapFont() {
+	clearCache();
+	delete [] runs;
+	delete [] atlas;
+	delete [] advances;
+	delete [] map;
+}
+
+void BitmapFont::adopt(uint32_t width, uint32_t height, uint32_t glyphCount, uint8_t* atlas, uint8_t* advances, uint32_t* map, uint32_t mapCount) {
+	clearCache();
+	delete [] this->atlas;
+	delete [] this->advances;
+	delete [] this->map;
+	this->width = width;
+	this->height = height;
+	this->glyphCount = glyphCount;
+	this->atlas = atlas;
+	this->glyphPitch = (width + 7) / 8;
+	this->advances = advances;
+	this->map = map;
+	this->mapCount = mapCount;
+	qsort(map, mapCount, 2 * sizeof(uint32_t), comparePairs);
+
+	fallback = NO_GLYPH;
+	for (uint32_t codepoint = 0; codepoint < 256; ++codepoint) {
+		latin[codepoint] = NO_GLYPH;
+	}
+	for (uint32_t codepoint = 0; codepoint < 256; ++codepoint) {
+		latin[codepoint] = findGlyph(codepoint);
+	}
+	const uint32_t replacement = findGlyph(REPLACEMENT_CHARACTER);
+	fallback = (replacement != NO_GLYPH) ? replacement : (latin['?'] != NO_GLYPH) ? latin['?'] : 0;
+	for (uint32_t codepoint = 0; codepoint < 256; ++codepoint) {
+		latin[codepoint] = (latin[codepoint] != NO_GLYPH) ? latin[codepoint] : fallback;
+	}
+}
+
+uint32_t BitmapFont::findGlyph(uint32_t codepoint) const {
+	if (codepoint < 256 && latin[codepoint] != NO_GLYPH) {
+		return latin[codepoint];
+	}
+	uint32_t low = 0, high = mapCount;
+	while (low < high) {
+		const uint32_t middle = (low + high) / 2;
+		if (map[middle * 2] < codepoint) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return (low < mapCount && map[low * 2] == codepoint) ? map[low * 2 + 1] : fallback;
+}
+
+void BitmapFont::loadDefault() {
+	uint8_t* glyphRows = new uint8_t[DEFAULT_COUNT * 8];
+	uint8_t* glyphAdvances = new uint8_t[DEFAULT_COUNT];
+	uint32_t* glyphMap = new uint32_t[DEFAULT_COUNT * 2];
+	memcpy(glyphRows, DEFAULT_GLYPHS, sizeof(DEFAULT_GLYPHS));
+	for (uint32_t glyph = 0; glyph < DEFAULT_COUNT; ++glyph) {
+		glyphAdvances[glyph] = 8;
+		glyphMap[glyph * 2] = DEFAULT_FIRST + glyph;
+		glyphMap[glyph * 2 + 1] = glyph;
+	}
+	adopt(8, 8, DEFAULT_COUNT, glyphRows, glyphAdvances, glyphMap, DEFAULT_COUNT);
+}
+
+int BitmapFont::loadPSF(const char* path) {
+	uint32_t length = 0;
+	uint8_t* data = readFile(path, length);
+	if (data == nullptr) {
+		return 1;
+	}
+	uint32_t headerLength, count, glyphLength, glyphHeight, glyphWidth;
+	bool version2, hasTable;
+	if (length >= 4 && data[0] == 0x36 && data[1] == 0x04) {
+		version2 = false;
+		headerLength = 4;
+		count = (data[2] & 0x01) ? 512 : 256;
+		hasTable = (data[2] & 0x06) != 0;
+		glyphLength = data[3];
+		glyphHeight = data[3];
+		glyphWidth = 8;
+	} else if (length >= 32 && readLittleEndian(data) == 0x864AB572) {
+		version2 = true;
+		headerLength = readLittleEndian(data + 8);
+		hasTable = (readLittleEndian(data + 12) & 0x01) != 0;
+		count = readLittleEndian(data + 16);
+		glyphLength = readLittleEndian(data + 20);
+		glyphHeight = readLittleEndian(data + 24);
+		glyphWidth = readLittleEndian(data + 28);
+	} else {
+		delete [] data;
+		return 2;
+	}
+	const uint32_t pitch = (glyphWidth + 7) / 8;
+	if (count == 0 || count > MAX_GLYPH_COUNT || glyphWidth == 0 || glyphWidth > MAX_GLYPH_SIZE || glyphHeight == 0 || glyphHeight > MAX_GLYPH_SIZE
+	    || glyphLength != pitch * glyphHeight || headerLength > length || (uint64_t)count * glyphLength > length - headerLength) {
+		delete [] data;
+		return 2;
+	}
+
+	// PSF rows start with the MSB, the atlas with the LSB.
+	uint8_t* glyphRows = new uint8_t[count * glyphLength];
+	const uint8_t* glyphData = data + headerLength;
+	const uint8_t lastMask = (glyphWidth % 8 != 0) ? (uint8_t)((1u << (glyphWidth % 8)) - 1) : 0xFF;
+	for (uint32_t index = 0; index < count * glyphLength; ++index) {
+		glyphRows[index] = reverseBits(glyphData[index]);
+		if (index % pitch == pitch - 1) {
+			glyphRows[index] &= lastMask;
+		}
+	}
+	uint8_t* glyphAdvances = new uint8_t[count];
+	memset(glyphAdvances, glyphWidth, count);
+
+	// Without a table glyph 'i' shows code point 'i'.
+	const uint8_t* table = glyphData + count * glyphLength;
+	const uint8_t* end = data + length;
+	const uint32_t pairCount = hasTable ? readUnicodeTable(table, end, count, version2, nullptr) : count;
+	uint32_t* glyphMap = new uint32_t[(pairCount > 0 ? pairCount : 1) * 2];
+	if (hasTable) {
+		readUnicodeTable(table, end, count, version2, glyphMap);
+	} else {
+		for (uint32_t glyph = 0; glyph < count; ++glyph) {
+			glyphMap[glyph * 2] = glyph;
+			glyphMap[glyph * 2 + 1] = glyph;
+		}
+	}
+	delete [] data;
+	adopt(glyphWidth, glyphHeight, count, glyphRows, glyphAdvances, glyphMap, pairCount);
+	return 0;
+}
+
+int BitmapFont::loadBDF(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (file == nullptr) {
+		return 1;
+	}
+	char line[512];
+	int32_t boxWidth = 0, boxHeight = 0, boxX = 0, boxY = 0;
+	// Cell size the glyph rows were allocated with.
+	int32_t cellWidth = 0, cellHeight = 0;
+	uint32_t count = 0, glyph = 0, pitch = 0;
+	uint8_t* glyphRows = nullptr;
+	uint8_t* glyphAdvances = nullptr;
+	uint32_t* glyphMap = nullptr;
+	// State of the glyph being read.
+	int32_t encoding = -1, advance = 0, width = 0, height = 0, offsetX = 0, offsetY = 0;
+	int32_t bitmapRow = -1;
+	int result = 2;
+
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		if (bitmapRow >= 0) {
+			if (strncmp(line, "ENDCHAR", 7) == 0) {
+				if (encoding >= 0) {
+					glyphAdvances[glyph] = (uint8_t)((advance < 0) ? 0 : (advance > (int32_t)MAX_GLYPH_SIZE) ? MAX_GLYPH_SIZE : advance);
+					glyphMap[glyph * 2] = (uint32_t)encoding;
+					glyphMap[glyph * 2 + 1] = glyph;
+					++glyph;
+				}
+				bitmapRow = -1;
+				continue;
+			}
+			// The row in the cell, from the distance to the baseline.
+			const int32_t row = cellHeight + boxY - offsetY - height + bitmapRow++;
+			if (encoding < 0 || row < 0 || row >= cellHeight) {
+				continue;
+			}
+			uint8_t* dst = glyphRows + (glyph * cellHeight + row) * pitch;
+			for (int32_t column = 0; column < width && line[column / 4] != '\0'; ++column) {
+				const char digit = line[column / 4];
+				const int32_t nibble = (digit >= '0' && digit <= '9') ? digit - '0' : (digit >= 'A' && digit <= 'F') ? digit - 'A' + 10 : (digit >= 'a' && digit <= 'f') ? digit - 'a' + 10 : 0;
+				const int32_t x = offsetX - boxX + column;
+				if ((nibble & (8 >> (column % 4))) && x >= 0 && x < cellWidth) {
+					dst[x / 8] |= (uint8_t)(1u << (x % 8));
+				}
+			}
+		} else if (strncmp(line, "FONTBOUNDINGBOX", 15) == 0) {
+			// The box sizes the glyph rows, it can't change once they exist.
+			if (glyphRows != nullptr || sscanf(line, "FONTBOUNDINGBOX %d %d %d %d", &boxWidth, &boxHeight, &boxX, &boxY) != 4) {
+				break;
+			}
+			if (boxWidth <= 0 || boxWidth > (int32_t)MAX_GLYPH_SIZE || boxHeight <= 0 || boxHeight > (int32_t)MAX_GLYPH_SIZE) {
+				break;
+			}
+		} else if (sscanf(line, "CHARS %u", &count) == 1) {
+			if (boxWidth <= 0 || count == 0 || count > MAX_GLYPH_COUNT || glyphRows != nullptr) {
+				break;
+			}
+			cellWidth = boxWidth;
+			cellHeight = boxHeight;
+			pitch = (cellWidth + 7) / 8;
+			glyphRows = new uint8_t[count * cellHeight * pitch];
+			memset(glyphRows, 0, count * cellHeight * pitch);
+			glyphAdvances = new uint8_t[count];
+			glyphMap = new uint32_t[count * 2];
+		} else if (strncmp(line, "STARTCHAR", 9) == 0) {
+			encoding = -1;
+			advance = boxWidth;
+			width = 0;
+			height = 0;
+			offsetX = 0;
+			offsetY = 0;
+		} else if (sscanf(line, "ENCODING %d", &encoding) == 1) {
+		} else if (sscanf(line, "DWIDTH %d", &advance) == 1) {
+		} else if (sscanf(line, "BBX %d %d %d %d", &width, &height, &offsetX, &offsetY) == 4) {
+		} else if (strncmp(line, "BITMAP", 6) == 0) {
+			if (glyphRows == nullptr || glyph >= count) {
+				break;
+			}
+			bitmapRow = 0;
+		} else if (strncmp(line, "ENDFONT", 7) == 0) {
+			result = (glyph > 0) ? 0 : 2;
+			break;
+		}
+	}
+	fclose(file);
+	if (result != 0) {
+		delete [] glyphRows;
+		delete [] glyphAdvances;
+		delete [] glyphMap;
+		return result;
+	}
+	adopt(cellWidth, cellHeight, glyph, glyphRows, glyphAdvances, glyphMap, glyph);
+	return 0;
+}
+
+uint32_t BitmapFont::getHeight() const {
+	return height;
+}
+
+uint32_t BitmapFont::getGlyphCount() const {
+	return glyphCount;
+}
+
+uint32_t BitmapFont::measureLine(const char* text, uint32_t length) const {
+	const uint8_t* current = (const uint8_t*)text;
+	const uint8_t* end = current + length;
+	uint32_t lineWidth = 0;
+	while (current < end) {
+		lineWidth += advances[findGlyph(decodeUtf8(current, end))];
+	}
+	return lineWidth;
+}
+
+uint32_t BitmapFont::measure(const char* text) const {
+	uint32_t widest = 0;
+	while (text != nullptr) {
+		const char* newline = strchr(text, '\n');
+		const uint32_t length = (newline != nullptr) ? (uint32_t)(newline - text) : (uint32_t)strlen(text);
+		const uint32_t lineWidth = measureLine(text, length);
+		widest = (lineWidth > widest) ? lineWidth : widest;
+		text = (newline != nullptr) ? newline + 1 : nullptr;
+	}
+	return widest;
+}
+
+// Find the line in the cache, or shape it into the slot of its hash.
+const BitmapFont::Run* BitmapFont::shape(const char* text, uint32_t length) {
+	if (runs == nullptr) {
+		runs = new Run[RUN_CACHE_SIZE];
+		memset(runs, 0, RUN_CACHE_SIZE * sizeof(Run));
+	}
+	const uint64_t hash = getKernels().hashRows((const uint8_t*)text, 0, length, 1);
+	Run& run = runs[hash & (RUN_CACHE_SIZE - 1)];
+	if (run.text != nullptr && run.hash == hash && run.length == length && memcmp(run.text, text, length) == 0) {
+		++hitCount;
+		return &run;
+	}
+	++missCount;
+
+	if (length > run.textCapacity) {
+		delete [] run.text;
+		run.text = new char[length];
+		run.textCapacity = length;
+	}
+	memcpy(run.text, text, length);
+	run.hash = hash;
+	run.length = length;
+	// The last cell may reach past the last advance.
+	const uint32_t lineWidth = measureLine(text, length);
+	run.width = (lineWidth > width) ? lineWidth : width;
+	run.pitch = (lineWidth + 7) / 8 + glyphPitch + 1;
+	const uint32_t maskLength = run.pitch * height;
+	if (maskLength > run.maskCapacity) {
+		delete [] run.mask;
+		run.mask = new uint8_t[maskLength];
+		run.maskCapacity = maskLength;
+	}
+	memset(run.mask, 0, maskLength);
+
+	const uint8_t* current = (const uint8_t*)text;
+	const uint8_t* end = current + length;
+	uint32_t x = 0;
+	while (current < end) {
+		const uint32_t glyph = findGlyph(decodeUtf8(current, end));
+		const uint8_t* src = atlas + glyph * height * glyphPitch;
+		const uint32_t shift = x % 8;
+		for (uint32_t row = 0; row < height; ++row, src += glyphPitch) {
+			uint8_t* dst = run.mask + row * run.pitch + x / 8;
+			for (uint32_t index = 0; index < glyphPitch; ++index) {
+				dst[index] |= (uint8_t)(src[index] << shift);
+				if (shift != 0) {
+					dst[index + 1] |= (uint8_t)(src[index] >> (8 - shift));
+				}
+			}
+		}
+		run.width = (x + width > run.width) ? x + width : run.width;
+		x += advances[glyph];
+	}
+	return &run;
+}
+
+void BitmapFont::drawRun(WindowCanvas& canvas, int32_t x, int32_t y, const Run& run, uint32_t color) const {
+	const int64_t canvasWidth = canvas.getWidth();
+	const int64_t canvasHeight = canvas.getHeight();
+	const int64_t top = (y < 0) ? -(int64_t)y : 0;
+	const int64_t bottom = (y + (int64_t)height > canvasHeight) ? canvasHeight - y : height;
+	const int64_t left = (x < 0) ? -(int64_t)x : 0;
+	const int64_t right = (x + (int64_t)run.width > canvasWidth) ? canvasWidth - x : run.width;
+	if (top >= bottom || left >= right) {
+		return;
+	}
+	const Kernels& kernels = getKernels();
+	const uint32_t pitch = canvas.getStride() / 4;
+	const uint32_t count = (uint32_t)(right - left);
+	uint32_t* dst = (uint32_t*)canvas.getPixelBuffer() + (y + top) * pitch + x + left;
+	const uint8_t* mask = run.mask + top * run.pitch;
+	if ((color >> 24) == 0xFF) {
+		for (int64_t row = top; row < bottom; ++row, dst += pitch, mask += run.pitch) {
+			kernels.maskFill32(dst, mask, (uint32_t)left, count, color);
+		}
+		return;
+	}
+
+	// Translucent text blends every span of set bits.
+	uint32_t colors[BLEND_CHUNK_SIZE];
+	for (uint32_t& value : colors) {
+		value = color;
+	}
+	for (int64_t row = top; row < bottom; ++row, dst += pitch, mask += run.pitch) {
+		uint32_t index = 0;
+		while (index < count) {
+			const uint32_t bit = (uint32_t)left + index;
+			if ((mask[bit / 8] & (1u << (bit % 8))) == 0) {
+				++index;
+				continue;
+			}
+			uint32_t length = 1;
+			while (index + length < count && length < BLEND_CHUNK_SIZE && (mask[(bit + length) / 8] & (1u << ((bit + length) % 8)))) {
+				++length;
+			}
+			kernels.composite32[BlendSrcOver](dst + index, colors, length, 255);
+			index += length;
+		}
+	}
+}
+
+void BitmapFont::draw(WindowCanvas& canvas, int32_t x, int32_t y, const char* text, uint32_t color) {
+	if (text == nullptr || canvas.getDepth() != 32 || canvas.getPixelBuffer() == nullptr) {
+		return;
+	}
+	int64_t lineY = y;
+	while (text != nullptr) {
+		const char* newline = strchr(text, '\n');
+		const uint32_t length = (newline != nullptr) ? (uint32_t)(newline - text) : (uint32_t)strlen(text);
+		if (length > 0 && lineY > -(int64_t)height && lineY < canvas.getHeight()) {
+			drawRun(canvas, x, (int32_t)lineY, *shape(text, length), color);
+		}
+		lineY += height;
+		text = (newline != nullptr) ? newline + 1 : nullptr;
+	}
+}
+
+void BitmapFont::clearCache() {
+	if (runs == nullptr) {
+		return;
+	}
+	for (uint32_t index = 0; index < RUN_CACHE_SIZE; ++index) {
+		delete [] runs[index].text;
+		delete [] runs[index].mask;
+	}
+	memset(runs, 0, RUN_CACHE_SIZE * sizeof(Run));
+}
+
+uint64_t BitmapFont::getCacheHitCount() const {
+	return hitCount;
+}
+
+uint64_t BitmapFont::getCacheMissCount() const {
+	return missCount;
+}
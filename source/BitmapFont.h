@@ -0,0 +1,98 @@
+#ifndef __WC_BITMAP_FONT_H__
+#define __WC_BITMAP_FONT_H__
+
+#include <stdint.h>
+
+class WindowCanvas;
+
+// Bitmap font text. The glyphs are packed once into a one bit atlas, and
+// every string drawn is shaped into a one bit mask of the whole line, which
+// is cached by the text. Drawing a cached string is then one masked store
+// per row of the label. Text is UTF-8, '\n' starts a new line. Not thread
+// safe, the cache changes while drawing.
+class BitmapFont {
+public:
+	// Slots of the shaped run cache, a power of two.
+	static const uint32_t RUN_CACHE_SIZE = 1024;
+
+private:
+	// A shaped line: one bit per pixel, LSB first, 'pitch' bytes per row.
+	struct Run {
+		uint64_t hash;
+		char* text;
+		uint32_t length;
+		uint32_t textCapacity;
+		uint8_t* mask;
+		uint32_t maskCapacity;
+		uint32_t width;
+		uint32_t pitch;
+	};
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t glyphCount;
+	// Rows of every glyph, 'glyphPitch' bytes each, LSB first.
+	uint8_t* atlas;
+	uint32_t glyphPitch;
+	uint8_t* advances;
+	// Code point and glyph pairs sorted by code point, with a table for
+	// Latin-1.
+	uint32_t* map;
+	uint32_t mapCount;
+	uint32_t latin[256];
+	// Glyph of unmapped code points.
+	uint32_t fallback;
+	Run* runs;
+	uint64_t hitCount;
+	uint64_t missCount;
+
+	void adopt(uint32_t width, uint32_t height, uint32_t glyphCount, uint8_t* atlas, uint8_t* advances, uint32_t* map, uint32_t mapCount);
+	uint32_t findGlyph(uint32_t codepoint) const;
+	uint32_t measureLine(const char* text, uint32_t length) const;
+	const Run* shape(const char* text, uint32_t length);
+	void drawRun(WindowCanvas& canvas, int32_t x, int32_t y, const Run& run, uint32_t color) const;
+
+	BitmapFont(const BitmapFont&);
+	BitmapFont& operator=(const BitmapFont&);
+
+public:
+	// Starts with the built-in 8x8 font.
+	BitmapFont();
+
+	~BitmapFont();
+
+	// Switch back to the built-in 8x8 font, printable ASCII only.
+	void loadDefault();
+
+	// Load a PC Screen Font (version 1 or 2), as used by the Linux console,
+	// with its Unicode table if it has one. The current font is kept on
+	// failure. Returns 0 on success.
+	int loadPSF(const char* path);
+
+	// Load a BDF font. The glyphs are placed on the cell of the font bounding
+	// box and advance by their DWIDTH. The current font is kept on failure.
+	// Returns 0 on success.
+	int loadBDF(const char* path);
+
+	uint32_t getHeight() const;
+
+	uint32_t getGlyphCount() const;
+
+	// Width of the longest line of 'text' in pixels.
+	uint32_t measure(const char* text) const;
+
+	// Draw 'text' with the top left corner of its first line at 'x', 'y',
+	// clipped to the canvas. Translucent colors are blended (SrcOver). Only
+	// 32 bit canvases are drawn to.
+	void draw(WindowCanvas& canvas, int32_t x, int32_t y, const char* text, uint32_t color);
+
+	// Drop the shaped runs.
+	void clearCache();
+
+	// Lines found in and missing from the run cache so far.
+	uint64_t getCacheHitCount() const;
+
+	uint64_t getCacheMissCount() const;
+};
+
+#endif // __WC_BITMAP_FONT_H__
@@ -0,0 +1,438 @@
+#ifndef __WC_CANVAS_VIEW_H__
+#define __WC_CANVAS_VIEW_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "PixelFormat.h"
+#include "Composite.h"
+#include "WindowCanvas.h"
+
+// Compile time description of a pixel format. 'pack' turns a 0xAARRGGBB
+// color into the stored word, 'unpack' does the opposite with an opaque
+// alpha when the format has none. Pixels are read and written with memcpy,
+// which compiles to plain moves without breaking aliasing rules. Like the
+// rest of the library, a little endian CPU is assumed.
+template <PixelFormat FORMAT>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<PixelFormatXRGB8888> {
+	static constexpr uint32_t BYTES = 4;
+
+	// 32 bit canvases hold premultiplied 0xAARRGGBB, the word is kept whole.
+	static constexpr uint32_t pack(uint32_t color) {
+		return color;
+	}
+
+	static constexpr uint32_t unpack(uint32_t word) {
+		return word;
+	}
+
+	static inline uint32_t load(const uint8_t* pixel) {
+		uint32_t word;
+		memcpy(&word, pixel, 4);
+		return word;
+	}
+
+	static inline void store(uint8_t* pixel, uint32_t word) {
+		memcpy(pixel, &word, 4);
+	}
+};
+
+template <>
+struct PixelTraits<PixelFormatXBGR8888> {
+	static constexpr uint32_t BYTES = 4;
+
+	static constexpr uint32_t pack(uint32_t color) {
+		return (color & 0xFF00FF00u) | (color >> 16 & 0xFF) | (color & 0xFF) << 16;
+	}
+
+	static constexpr uint32_t unpack(uint32_t word) {
+		return 0xFF000000u | (word & 0xFF00) | (word >> 16 & 0xFF) | (word & 0xFF) << 16;
+	}
+
+	static inline uint32_t load(const uint8_t* pixel) {
+		return PixelTraits<PixelFormatXRGB8888>::load(pixel);
+	}
+
+	static inline void store(uint8_t* pixel, uint32_t word) {
+		PixelTraits<PixelFormatXRGB8888>::store(pixel, word);
+	}
+};
+
+template <>
+struct PixelTraits<PixelFormatBGRX8888> {
+	static constexpr uint32_t BYTES = 4;
+
+	static constexpr uint32_t pack(uint32_t color) {
+		return __builtin_bswap32(color);
+	}
+
+	static constexpr uint32_t unpack(uint32_t word) {
+		return 0xFF000000u | __builtin_bswap32(word);
+	}
+
+	static inline uint32_t load(const uint8_t* pixel) {
+		return PixelTraits<PixelFormatXRGB8888>::load(pixel);
+	}
+
+	static inline void store(uint8_t* pixel, uint32_t word) {
+		PixelTraits<PixelFormatXRGB8888>::store(pixel, word);
+	}
+};
+
+template <>
+struct PixelTraits<PixelFormatRGB888> {
+	static constexpr uint32_t BYTES = 3;
+
+	static constexpr uint32_t pack(uint32_t color) {
+		return color & 0xFFFFFF;
+	}
+
+	static constexpr uint32_t unpack(uint32_t word) {
+		return 0xFF000000u | word;
+	}
+
+	static inline uint32_t load(const uint8_t* pixel) {
+		return (uint32_t)pixel[2] << 16 | (uint32_t)pixel[1] << 8 | pixel[0];
+	}
+
+	static inline void store(uint8_t* pixel, uint32_t word) {
+		pixel[0] = word & 0xFF;
+		pixel[1] = (word >> 8) & 0xFF;
+		pixel[2] = (word >> 16) & 0xFF;
+	}
+};
+
+template <>
+struct PixelTraits<PixelFormatRGB565> {
+	static constexpr uint32_t BYTES = 2;
+
+	static constexpr uint32_t pack(uint32_t color) {
+		return ((color >> 8) & 0xF800) | ((color >> 5) & 0x07E0) | ((color >> 3) & 0x001F);
+	}
+
+	// Same bit replication as the conversion kernels.
+	static constexpr uint32_t unpack(uint32_t word) {
+		return 0xFF000000u
+			| (word & 0xF800) << 8 | (word & 0xE000) << 3
+			| (word & 0x07E0) << 5 | (word & 0x0600) >> 1
+			| (word & 0x001F) << 3 | (word & 0x001C) >> 2;
+	}
+
+	static inline uint32_t load(const uint8_t* pixel) {
+		uint16_t word;
+		memcpy(&word, pixel, 2);
+		return word;
+	}
+
+	static inline void store(uint8_t* pixel, uint32_t word) {
+		const uint16_t value = (uint16_t)word;
+		memcpy(pixel, &value, 2);
+	}
+};
+
+// The "color" of an indexed pixel is its palette index in the low byte, the
+// same as WindowCanvas::clear() on an 8 bit canvas.
+template <>
+struct PixelTraits<PixelFormatIndex8> {
+	static constexpr uint32_t BYTES = 1;
+
+	static constexpr uint32_t pack(uint32_t color) {
+		return color & 0xFF;
+	}
+
+	static constexpr uint32_t unpack(uint32_t word) {
+		return word;
+	}
+
+	static inline uint32_t load(const uint8_t* pixel) {
+		return *pixel;
+	}
+
+	static inline void store(uint8_t* pixel, uint32_t word) {
+		*pixel = (uint8_t)word;
+	}
+};
+
+// Typed access to a pixel buffer whose format is known at compile time, so
+// every loop below is built for one layout without testing the depth per
+// pixel. Colors are 0xAARRGGBB. Rectangles are clipped to the view.
+template <PixelFormat FORMAT>
+class CanvasView {
+public:
+	typedef PixelTraits<FORMAT> Traits;
+
+	// One row of the view.
+	class Row {
+		uint8_t* pixels;
+		uint32_t width;
+
+	public:
+		Row(uint8_t* pixels, uint32_t width)
+			: pixels(pixels), width(width) {
+		}
+
+		uint8_t* getPixels() const {
+			return pixels;
+		}
+
+		uint32_t getWidth() const {
+			return width;
+		}
+
+		// Stored word of pixel 'x', not checked against the width.
+		uint32_t load(uint32_t x) const {
+			return Traits::load(pixels + x * Traits::BYTES);
+		}
+
+		void store(uint32_t x, uint32_t word) const {
+			Traits::store(pixels + x * Traits::BYTES, word);
+		}
+
+		uint32_t get(uint32_t x) const {
+			return Traits::unpack(load(x));
+		}
+
+		void set(uint32_t x, uint32_t color) const {
+			store(x, Traits::pack(color));
+		}
+	};
+
+	// Walks the rows top to bottom, stepping by the stride.
+	class RowIterator {
+		uint8_t* pixels;
+		uint32_t pitch;
+		uint32_t width;
+
+	public:
+		RowIterator(uint8_t* pixels, uint32_t pitch, uint32_t width)
+			: pixels(pixels), pitch(pitch), width(width) {
+		}
+
+		Row operator*() const {
+			return Row(pixels, width);
+		}
+
+		RowIterator& operator++() {
+			pixels += pitch;
+			return *this;
+		}
+
+		bool operator!=(const RowIterator& other) const {
+			return pixels != other.pixels;
+		}
+	};
+
+	// Range of rows for range based for loops.
+	class Rows {
+		uint8_t* pixels;
+		uint32_t pitch;
+		uint32_t width;
+		uint32_t height;
+
+	public:
+		Rows(uint8_t* pixels, uint32_t pitch, uint32_t width, uint32_t height)
+			: pixels(pixels), pitch(pitch), width(width), height(height) {
+		}
+
+		RowIterator begin() const {
+			return RowIterator(pixels, pitch, width);
+		}
+
+		RowIterator end() const {
+			return RowIterator(pixels + (size_t)height * pitch, pitch, width);
+		}
+	};
+
+private:
+	uint8_t* pixels;
+	uint32_t pitch;
+	uint32_t width;
+	uint32_t height;
+
+	// Clip a rectangle to the view. Returns false if nothing is left, the
+	// offsets of the clipped corner otherwise.
+	bool clip(int32_t& x, int32_t& y, uint32_t& width, uint32_t& height, int32_t& offsetX, int32_t& offsetY) const {
+		int64_t x0 = x, y0 = y;
+		int64_t x1 = x0 + width, y1 = y0 + height;
+		x0 = x0 < 0 ? 0 : x0;
+		y0 = y0 < 0 ? 0 : y0;
+		x1 = x1 > this->width ? this->width : x1;
+		y1 = y1 > this->height ? this->height : y1;
+		if (x0 >= x1 || y0 >= y1) {
+			return false;
+		}
+		offsetX = (int32_t)(x0 - x);
+		offsetY = (int32_t)(y0 - y);
+		x = (int32_t)x0;
+		y = (int32_t)y0;
+		width = (uint32_t)(x1 - x0);
+		height = (uint32_t)(y1 - y0);
+		return true;
+	}
+
+public:
+	CanvasView(uint8_t* pixels, uint32_t pitch, uint32_t width, uint32_t height)
+		: pixels(pixels), pitch(pitch), width(width), height(height) {
+	}
+
+	// View of the pixel buffer of 'canvas'. Empty, see isValid(), when the
+	// canvas uses another format. The view is invalidated when the pixel
+	// buffer changes: resize, row padding, or present() with several buffers.
+	explicit CanvasView(WindowCanvas& canvas)
+		: pixels(nullptr), pitch(0), width(0), height(0) {
+		if (canvas.getPixelFormat() == FORMAT && canvas.getPixelBuffer() != nullptr) {
+			pixels = canvas.getPixelBuffer();
+			pitch = canvas.getStride();
+			width = canvas.getWidth();
+			height = canvas.getHeight();
+		}
+	}
+
+	bool isValid() const {
+		return pixels != nullptr;
+	}
+
+	uint32_t getWidth() const {
+		return width;
+	}
+
+	uint32_t getHeight() const {
+		return height;
+	}
+
+	uint32_t getStride() const {
+		return pitch;
+	}
+
+	uint8_t* getPixels() const {
+		return pixels;
+	}
+
+	// Row 'y', not checked against the height.
+	Row row(uint32_t y) const {
+		return Row(pixels + (size_t)y * pitch, width);
+	}
+
+	Rows rows() const {
+		return Rows(pixels, pitch, width, height);
+	}
+
+	// Color of pixel 'x', 'y', 0 outside of the view.
+	uint32_t getPixel(int32_t x, int32_t y) const {
+		if ((uint32_t)x >= width || (uint32_t)y >= height) {
+			return 0;
+		}
+		return row(y).get(x);
+	}
+
+	void setPixel(int32_t x, int32_t y, uint32_t color) const {
+		if ((uint32_t)x < width && (uint32_t)y < height) {
+			row(y).set(x, color);
+		}
+	}
+
+	void fill(uint32_t color) const {
+		fill(0, 0, width, height, color);
+	}
+
+	void fill(int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t color) const {
+		int32_t offsetX, offsetY;
+		if (!clip(x, y, width, height, offsetX, offsetY)) {
+			return;
+		}
+		// Rows are written in blocks of whole pixels copied from a pattern.
+		// The fixed size copies become vector stores for every pixel size,
+		// where a loop of 2 or 3 byte stores often stays scalar.
+		static const uint32_t BLOCK = 192;
+		uint8_t pattern[BLOCK];
+		const uint32_t word = Traits::pack(color);
+		for (uint32_t index = 0; index < BLOCK / Traits::BYTES; ++index) {
+			Traits::store(pattern + index * Traits::BYTES, word);
+		}
+		const size_t length = (size_t)width * Traits::BYTES;
+		uint8_t* dstRow = pixels + (size_t)y * pitch + x * Traits::BYTES;
+		for (uint32_t line = 0; line < height; ++line, dstRow += pitch) {
+			uint8_t* dst = dstRow;
+			size_t remaining = length;
+			for (; remaining >= BLOCK; remaining -= BLOCK, dst += BLOCK) {
+				memcpy(dst, pattern, BLOCK);
+			}
+			memcpy(dst, pattern, remaining);
+		}
+	}
+
+	// Copy a 'width' x 'height' block of 'src' at 'srcX', 'srcY' to 'x', 'y',
+	// converting between the formats. The source block must lie inside
+	// 'src'. Views of the same format may overlap.
+	template <PixelFormat SRC_FORMAT>
+	void copy(int32_t x, int32_t y, const CanvasView<SRC_FORMAT>& src, int32_t srcX, int32_t srcY, uint32_t width, uint32_t height) const {
+		typedef PixelTraits<SRC_FORMAT> SrcTraits;
+		static_assert((FORMAT == PixelFormatIndex8) == (SRC_FORMAT == PixelFormatIndex8), "Indexed pixels only copy to and from indexed pixels, expandIndexed() looks them up.");
+		int32_t offsetX, offsetY;
+		if (!clip(x, y, width, height, offsetX, offsetY)) {
+			return;
+		}
+		srcX += offsetX;
+		srcY += offsetY;
+		if (FORMAT == SRC_FORMAT) {
+			// Bottom up when the destination is below an overlapping source.
+			const bool backwards = y > srcY && pixels == src.getPixels();
+			for (uint32_t line = 0; line < height; ++line) {
+				const uint32_t index = backwards ? height - 1 - line : line;
+				memmove(pixels + (size_t)(y + index) * pitch + x * Traits::BYTES,
+				        src.getPixels() + (size_t)(srcY + index) * src.getStride() + srcX * SrcTraits::BYTES, width * Traits::BYTES);
+			}
+			return;
+		}
+		for (uint32_t line = 0; line < height; ++line) {
+			const Row dstRow(pixels + (size_t)(y + line) * pitch + x * Traits::BYTES, width);
+			const typename CanvasView<SRC_FORMAT>::Row srcRow = src.row(srcY + line);
+			for (uint32_t index = 0; index < width; ++index) {
+				dstRow.store(index, Traits::pack(SrcTraits::unpack(srcRow.load(srcX + index))));
+			}
+		}
+	}
+
+	// Composite a 'width' x 'height' image of premultiplied 0xAARRGGBB
+	// pixels at 'x', 'y'. 'srcPitch' is the image row length in pixels. The
+	// native 32 bit layout is blended in place by the vector kernels of
+	// compositeSpan(), the other layouts through a small 0xAARRGGBB buffer.
+	template <BlendMode MODE>
+	void blend(int32_t x, int32_t y, const uint32_t* src, uint32_t width, uint32_t height, uint32_t srcPitch, uint8_t alpha = 255) const {
+		static_assert(FORMAT != PixelFormatIndex8, "Indexed pixels have no color to blend with.");
+		int32_t offsetX, offsetY;
+		if (alpha == 0 || !clip(x, y, width, height, offsetX, offsetY)) {
+			return;
+		}
+		static const uint32_t CHUNK = 256;
+		uint32_t colors[CHUNK];
+		src += (size_t)offsetY * srcPitch + offsetX;
+		uint8_t* dstRow = pixels + (size_t)y * pitch + x * Traits::BYTES;
+		for (uint32_t line = 0; line < height; ++line, dstRow += pitch, src += srcPitch) {
+			if (FORMAT == PixelFormatXRGB8888) {
+				compositeSpan((uint32_t*)dstRow, src, width, MODE, alpha);
+				continue;
+			}
+			for (uint32_t start = 0; start < width; start += CHUNK) {
+				const uint32_t count = (width - start < CHUNK) ? width - start : CHUNK;
+				const Row chunk(dstRow + start * Traits::BYTES, count);
+				for (uint32_t index = 0; index < count; ++index) {
+					colors[index] = chunk.get(index);
+				}
+				compositeSpan(colors, src + start, count, MODE, alpha);
+				for (uint32_t index = 0; index < count; ++index) {
+					chunk.set(index, colors[index]);
+				}
+			}
+		}
+	}
+};
+
+typedef CanvasView<PixelFormatXRGB8888> CanvasView32;
+typedef CanvasView<PixelFormatRGB888> CanvasView24;
+typedef CanvasView<PixelFormatRGB565> CanvasView16;
+typedef CanvasView<PixelFormatIndex8> CanvasView8;
+
+#endif // __WC_CANVAS_VIEW_H__
@@ -0,0 +1,46 @@
+#include "Composite.h"
+#include "Kernels.h"
+#include "WindowCanvas.h"
+
+void compositeSpan(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode) {
+	getKernels().composite32[mode](dst, src, count, 255);
+}
+
+void compositeSpan(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode, uint8_t alpha) {
+	// A fully transparent source leaves the destination unchanged in every mode.
+	if (alpha == 0) {
+		return;
+	}
+	getKernels().composite32[mode](dst, src, count, alpha);
+}
+
+void compositeSpanReference(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode) {
+	getReferenceKernels().composite32[mode](dst, src, count, 255);
+}
+
+void compositeSpanReference(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode, uint8_t alpha) {
+	getReferenceKernels().composite32[mode](dst, src, count, alpha);
+}
+
+void compositeRect(WindowCanvas& canvas, int32_t x, int32_t y, const uint32_t* src, uint32_t width, uint32_t height, uint32_t srcPitch, BlendMode mode, uint8_t alpha) {
+	if (canvas.getDepth() != 32 || alpha == 0) {
+		return;
+	}
+	int64_t x0 = x, y0 = y;
+	int64_t x1 = x0 + width, y1 = y0 + height;
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 > canvas.getWidth() ? canvas.getWidth() : x1;
+	y1 = y1 > canvas.getHeight() ? canvas.getHeight() : y1;
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+
+	const Kernels& kernels = getKernels();
+	const uint32_t pitch = canvas.getStride() / 4;
+	uint32_t* dstRow = (uint32_t*)canvas.getPixelBuffer() + y0 * pitch + x0;
+	const uint32_t* srcRow = src + (y0 - y) * srcPitch + (x0 - x);
+	for (int64_t row = y0; row < y1; ++row, dstRow += pitch, srcRow += srcPitch) {
+		kernels.composite32[mode](dstRow, srcRow, (uint32_t)(x1 - x0), alpha);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef __WC_COMPOSITE_H__
+#define __WC_COMPOSITE_H__
+
+#include <stdint.h>
+
+class WindowCanvas;
+
+// Porter-Duff style operators on premultiplied 0xAARRGGBB pixels.
+enum BlendMode {
+	// dst = src + dst * (1 - src.a)
+	BlendSrcOver,
+	// dst = min(src + dst, 1)
+	BlendAdd,
+	// dst = src * dst + src * (1 - dst.a) + dst * (1 - src.a)
+	BlendMultiply,
+	BlendModeCount,
+};
+
+// Composite 'count' source pixels onto 'dst' using the source alpha.
+void compositeSpan(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode);
+
+// Same as above with the source scaled by a constant 'alpha' first.
+void compositeSpan(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode, uint8_t alpha);
+
+// Scalar implementations. The vector kernels produce bit identical results,
+// these are kept as the reference to check them against.
+void compositeSpanReference(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode);
+void compositeSpanReference(uint32_t* dst, const uint32_t* src, uint32_t count, BlendMode mode, uint8_t alpha);
+
+// Composite a 'width' x 'height' image onto a 32 bit canvas at 'x', 'y',
+// clipped to the canvas. 'srcPitch' is the image row length in pixels.
+void compositeRect(WindowCanvas& canvas, int32_t x, int32_t y, const uint32_t* src, uint32_t width, uint32_t height, uint32_t srcPitch, BlendMode mode, uint8_t alpha = 255);
+
+#endif // __WC_COMPOSITE_H__
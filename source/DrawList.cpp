@@ -0,0 +1,609 @@
+#include "DrawList.h"
+#include "Kernels.h"
+#include "WindowCanvas.h"
+
+#include <math.h>
+#include <string.h>
+
+// Coordinates are clamped to this range so that the edge functions and the
+// Bresenham terms fit in 64 bits.
+static const int32_t COORDINATE_LIMIT = 1 << 24;
+// Pixels the anti-aliased lines may reach beyond their end points.
+static const float LINE_MARGIN = 2.0f;
+
+struct Clip {
+	int32_t x0, y0, x1, y1;
+};
+
+template <typename T>
+static void reserve(T*& array, uint32_t& capacity, uint32_t count, uint32_t used) {
+	if (count <= capacity) {
+		return;
+	}
+	uint32_t next = (capacity < 64) ? 64 : capacity;
+	while (next < count) {
+		next *= 2;
+	}
+	T* grown = new T[next];
+	if (used > 0) {
+		memcpy(grown, array, used * sizeof(T));
+	}
+	delete [] array;
+	array = grown;
+	capacity = next;
+}
+
+static int32_t clampCoordinate(int64_t value) {
+	return (value < -COORDINATE_LIMIT) ? -COORDINATE_LIMIT : (value > COORDINATE_LIMIT) ? COORDINATE_LIMIT : (int32_t)value;
+}
+
+static float clampCoordinate(float value) {
+	// Also maps NaN to the lower limit.
+	return (value >= -COORDINATE_LIMIT) ? ((value < COORDINATE_LIMIT) ? value : COORDINATE_LIMIT) : -COORDINATE_LIMIT;
+}
+
+// 28.4 fixed point, rounded to the nearest sixteenth.
+static int32_t toFixed(float value) {
+	return (int32_t)floorf(clampCoordinate(value) * 16.0f + 0.5f);
+}
+
+static int64_t floorDivide(int64_t a, int64_t b) {
+	const int64_t q = a / b;
+	return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+static int64_t ceilDivide(int64_t a, int64_t b) {
+	return -floorDivide(-a, b);
+}
+
+// Multiply all four channels by 'coverage' / 256.
+static uint32_t scaleColor(uint32_t color, uint32_t coverage) {
+	const uint32_t rb = (((color & 0x00FF00FF) * coverage) >> 8) & 0x00FF00FF;
+	const uint32_t ag = (((color >> 8) & 0x00FF00FF) * coverage) & 0xFF00FF00;
+	return rb | ag;
+}
+
+// SrcOver of a premultiplied color.
+static void blendPixel(uint32_t* dst, uint32_t color) {
+	*dst = color + scaleColor(*dst, 256 - (color >> 24));
+}
+
+static void plot(uint32_t* dst, uint32_t color) {
+	if ((color >> 24) == 0xFF) {
+		*dst = color;
+	} else {
+		blendPixel(dst, color);
+	}
+}
+
+static void fillSpan(const Kernels& kernels, uint32_t* dst, uint32_t count, uint32_t color) {
+	if ((color >> 24) == 0xFF) {
+		kernels.fill32(dst, count, color);
+		return;
+	}
+	for (uint32_t index = 0; index < count; ++index) {
+		blendPixel(dst + index, color);
+	}
+}
+
+// Pixel k of the line is at k steps along the major axis and
+// round(k * minor / major) along the other, so every tile can start its own
+// part of the line without walking the rest.
+static void drawLine(uint32_t* base, uint32_t pitch, const Clip& clip, const int32_t* points, uint32_t color) {
+	const int64_t dx = (int64_t)points[2] - points[0];
+	const int64_t dy = (int64_t)points[3] - points[1];
+	const bool steep = (dy < 0 ? -dy : dy) > (dx < 0 ? -dx : dx);
+	const int64_t majorStart = steep ? points[1] : points[0];
+	const int64_t minorStart = steep ? points[0] : points[1];
+	const int64_t majorDelta = steep ? dy : dx;
+	const int64_t minorDelta = steep ? dx : dy;
+	const int64_t majorStep = (majorDelta < 0) ? -1 : 1;
+	const int64_t minorStep = (minorDelta < 0) ? -1 : 1;
+	const int64_t majorLength = majorDelta * majorStep;
+	const int64_t minorLength = minorDelta * minorStep;
+	const int64_t majorLow = steep ? clip.y0 : clip.x0;
+	const int64_t majorHigh = steep ? clip.y1 : clip.x1;
+	const int64_t minorLow = steep ? clip.x0 : clip.y0;
+	const int64_t minorHigh = steep ? clip.x1 : clip.y1;
+
+	// Steps whose major coordinate is inside the clip.
+	int64_t first = (majorStep > 0) ? majorLow - majorStart : majorStart - (majorHigh - 1);
+	int64_t last = (majorStep > 0) ? majorHigh - 1 - majorStart : majorStart - majorLow;
+	first = (first < 0) ? 0 : first;
+	last = (last > majorLength) ? majorLength : last;
+	if (first > last) {
+		return;
+	}
+
+	const int64_t denominator = 2 * (majorLength > 0 ? majorLength : 1);
+	const int64_t numerator = 2 * first * minorLength + majorLength;
+	int64_t quotient = numerator / denominator;
+	int64_t remainder = numerator % denominator;
+	for (int64_t step = first; step <= last; ++step) {
+		const int64_t major = majorStart + step * majorStep;
+		const int64_t minor = minorStart + quotient * minorStep;
+		if (minor >= minorLow && minor < minorHigh) {
+			const int64_t x = steep ? minor : major;
+			const int64_t y = steep ? major : minor;
+			plot(base + y * pitch + x, color);
+		} else if ((minorStep > 0) ? minor >= minorHigh : minor < minorLow) {
+			// Moving away from the clip.
+			break;
+		}
+		remainder += 2 * minorLength;
+		if (remainder >= denominator) {
+			remainder -= denominator;
+			++quotient;
+		}
+	}
+}
+
+// Wu's line: every column along the major axis covers the two pixels nearest
+// to the line, weighted by the distance. The line reaches half a pixel past
+// its end points, partly covered end columns are weighted by the overlap.
+static void drawLineAA(uint32_t* base, uint32_t pitch, const Clip& clip, const float* points, uint32_t color) {
+	float x0 = points[0], y0 = points[1], x1 = points[2], y1 = points[3];
+	const bool steep = fabsf(y1 - y0) > fabsf(x1 - x0);
+	if (steep) {
+		float swap = x0; x0 = y0; y0 = swap;
+		swap = x1; x1 = y1; y1 = swap;
+	}
+	if (x0 > x1) {
+		float swap = x0; x0 = x1; x1 = swap;
+		swap = y0; y0 = y1; y1 = swap;
+	}
+	const float gradient = (x1 - x0 > 0.0f) ? (y1 - y0) / (x1 - x0) : 0.0f;
+	const int32_t majorLow = steep ? clip.y0 : clip.x0;
+	const int32_t majorHigh = steep ? clip.y1 : clip.x1;
+	const int32_t minorLow = steep ? clip.x0 : clip.y0;
+	const int32_t minorHigh = steep ? clip.x1 : clip.y1;
+	const float start = x0 - 0.5f;
+	const float end = x1 + 0.5f;
+	int32_t first = (int32_t)floorf(start);
+	int32_t last = (int32_t)floorf(end);
+	first = (first < majorLow) ? majorLow : first;
+	last = (last >= majorHigh) ? majorHigh - 1 : last;
+
+	for (int32_t column = first; column <= last; ++column) {
+		const float left = (start > column) ? start : (float)column;
+		const float right = (end < column + 1) ? end : (float)(column + 1);
+		if (right <= left) {
+			continue;
+		}
+		const float position = y0 + (column + 0.5f - x0) * gradient - 0.5f;
+		const float row = floorf(position);
+		const float weight = position - row;
+		const int32_t coverage[2] = {
+			(int32_t)((right - left) * (1.0f - weight) * 256.0f + 0.5f),
+			(int32_t)((right - left) * weight * 256.0f + 0.5f),
+		};
+		for (int32_t index = 0; index < 2; ++index) {
+			const int32_t minor = (int32_t)row + index;
+			if (coverage[index] <= 0 || minor < minorLow || minor >= minorHigh) {
+				continue;
+			}
+			const int32_t x = steep ? minor : column;
+			const int32_t y = steep ? column : minor;
+			blendPixel(base + (int64_t)y * pitch + x, scaleColor(color, coverage[index] > 256 ? 256 : coverage[index]));
+		}
+	}
+}
+
+// Midpoint circle, each point plotted once so that translucent colors do not
+// blend twice where the octants meet.
+static void drawCircle(uint32_t* base, uint32_t pitch, const Clip& clip, const int32_t* circle, uint32_t color) {
+	const int64_t cx = circle[0], cy = circle[1];
+	int64_t x = circle[2], y = 0;
+	int64_t error = 1 - x;
+	while (x >= y) {
+		int64_t points[8][2];
+		uint32_t count = 0;
+		if (x == 0) {
+			points[count][0] = cx; points[count++][1] = cy;
+		} else if (y == 0) {
+			points[count][0] = cx + x; points[count++][1] = cy;
+			points[count][0] = cx - x; points[count++][1] = cy;
+			points[count][0] = cx; points[count++][1] = cy + x;
+			points[count][0] = cx; points[count++][1] = cy - x;
+		} else {
+			points[count][0] = cx + x; points[count++][1] = cy + y;
+			points[count][0] = cx - x; points[count++][1] = cy + y;
+			points[count][0] = cx + x; points[count++][1] = cy - y;
+			points[count][0] = cx - x; points[count++][1] = cy - y;
+			if (x != y) {
+				points[count][0] = cx + y; points[count++][1] = cy + x;
+				points[count][0] = cx - y; points[count++][1] = cy + x;
+				points[count][0] = cx + y; points[count++][1] = cy - x;
+				points[count][0] = cx - y; points[count++][1] = cy - x;
+			}
+		}
+		for (uint32_t index = 0; index < count; ++index) {
+			const int64_t px = points[index][0], py = points[index][1];
+			if (px >= clip.x0 && px < clip.x1 && py >= clip.y0 && py < clip.y1) {
+				plot(base + py * pitch + px, color);
+			}
+		}
+		++y;
+		if (error < 0) {
+			error += 2 * y + 1;
+		} else {
+			--x;
+			error += 2 * (y - x) + 1;
+		}
+	}
+}
+
+static void drawFilledCircle(const Kernels& kernels, uint32_t* base, uint32_t pitch, const Clip& clip, const int32_t* circle, uint32_t color) {
+	const int64_t cx = circle[0], cy = circle[1], radius = circle[2];
+	const int64_t top = (cy - radius > clip.y0) ? cy - radius : clip.y0;
+	const int64_t bottom = (cy + radius + 1 < clip.y1) ? cy + radius + 1 : clip.y1;
+	for (int64_t y = top; y < bottom; ++y) {
+		const int64_t limit = radius * radius - (y - cy) * (y - cy);
+		int64_t half = (int64_t)sqrt((double)limit);
+		while (half * half > limit) {
+			--half;
+		}
+		while ((half + 1) * (half + 1) <= limit) {
+			++half;
+		}
+		const int64_t left = (cx - half > clip.x0) ? cx - half : clip.x0;
+		const int64_t right = (cx + half + 1 < clip.x1) ? cx + half + 1 : clip.x1;
+		if (left < right) {
+			fillSpan(kernels, base + y * pitch + left, (uint32_t)(right - left), color);
+		}
+	}
+}
+
+// Each edge function E(x, y) = (x - ax) * (by - ay) - (y - ay) * (bx - ax) is
+// linear in x, so instead of testing every pixel the row span is solved from
+// the three edges. The corners are wound so that E >= 0 inside. Pixels
+// exactly on an edge belong to it when it is a left or a top edge.
+static void drawFilledTriangle(const Kernels& kernels, uint32_t* base, uint32_t pitch, const Clip& clip, const int32_t* fixed, uint32_t color) {
+	int64_t edgeA[3], edgeB[3], edgeX[3], edgeY[3], bias[3];
+	for (uint32_t edge = 0; edge < 3; ++edge) {
+		const uint32_t next = (edge + 1) % 3;
+		edgeX[edge] = fixed[edge * 2];
+		edgeY[edge] = fixed[edge * 2 + 1];
+		edgeA[edge] = (int64_t)fixed[next * 2 + 1] - fixed[edge * 2 + 1];
+		edgeB[edge] = (int64_t)fixed[next * 2] - fixed[edge * 2];
+		const bool topLeft = (edgeA[edge] > 0) || (edgeA[edge] == 0 && edgeB[edge] < 0);
+		bias[edge] = topLeft ? 0 : -1;
+	}
+
+	for (int32_t y = clip.y0; y < clip.y1; ++y) {
+		const int64_t py = (int64_t)y * 16 + 8;
+		int64_t left = clip.x0;
+		int64_t right = clip.x1;
+		for (uint32_t edge = 0; edge < 3 && left < right; ++edge) {
+			// E at the centre of pixel x is 16 * A * x + K.
+			const int64_t a = edgeA[edge];
+			const int64_t k = (8 - edgeX[edge]) * a - (py - edgeY[edge]) * edgeB[edge] + bias[edge];
+			if (a > 0) {
+				const int64_t from = ceilDivide(-k, 16 * a);
+				left = (from > left) ? from : left;
+			} else if (a < 0) {
+				const int64_t to = floorDivide(k, -16 * a) + 1;
+				right = (to < right) ? to : right;
+			} else if (k < 0) {
+				right = left;
+			}
+		}
+		if (left < right) {
+			fillSpan(kernels, base + (int64_t)y * pitch + left, (uint32_t)(right - left), color);
+		}
+	}
+}
+
+// Even-odd scanlines through the pixel centres. An edge crosses a row when
+// the centre is in [top, bottom) of the edge, so shared vertices count once.
+// Crossings are rounded up, which covers the same pixels as the triangles.
+static void drawFilledPolygon(const Kernels& kernels, uint32_t* base, uint32_t pitch, const Clip& clip, const int32_t* points, uint32_t count, int32_t* crossings, uint32_t color) {
+	for (int32_t y = clip.y0; y < clip.y1; ++y) {
+		const int64_t py = (int64_t)y * 16 + 8;
+		uint32_t crossingCount = 0;
+		for (uint32_t index = 0; index < count; ++index) {
+			const int32_t* a = points + index * 2;
+			const int32_t* b = points + ((index + 1 < count) ? index + 1 : 0) * 2;
+			if ((a[1] <= py && py < b[1]) || (b[1] <= py && py < a[1])) {
+				const int64_t x = a[0] + ceilDivide((py - a[1]) * ((int64_t)b[0] - a[0]), (int64_t)b[1] - a[1]);
+				// Insertion sort, rows rarely cross more than a few edges.
+				uint32_t slot = crossingCount++;
+				while (slot > 0 && crossings[slot - 1] > x) {
+					crossings[slot] = crossings[slot - 1];
+					--slot;
+				}
+				crossings[slot] = (int32_t)x;
+			}
+		}
+		for (uint32_t index = 0; index + 1 < crossingCount; index += 2) {
+			// Pixels whose centre is in [crossing, next crossing).
+			int64_t left = ceilDivide((int64_t)crossings[index] - 8, 16);
+			int64_t right = ceilDivide((int64_t)crossings[index + 1] - 8, 16);
+			left = (left > clip.x0) ? left : clip.x0;
+			right = (right < clip.x1) ? right : clip.x1;
+			if (left < right) {
+				fillSpan(kernels, base + (int64_t)y * pitch + left, (uint32_t)(right - left), color);
+			}
+		}
+	}
+}
+
+DrawList::DrawList()
+	: commands(nullptr), commandCount(0), commandCapacity(0), points(nullptr), pointCount(0), pointCapacity(0), maxPolygonCount(0)
+	, binStart(nullptr), binCapacity(0), binCommands(nullptr), binCommandCapacity(0), binColumns(0), crossings(nullptr), crossingCapacity(0)
+	, executing(nullptr) {
+}
+
+DrawList::~DrawList() {
+	clear();
+	delete [] commands;
+	delete [] points;
+	delete [] binStart;
+	delete [] binCommands;
+	delete [] crossings;
+}
+
+void DrawList::clear() {
+	if (executing != nullptr) {
+		executing->waitTiles();
+		executing = nullptr;
+	}
+	commandCount = 0;
+	pointCount = 0;
+	maxPolygonCount = 0;
+}
+
+uint32_t DrawList::getCommandCount() const {
+	return commandCount;
+}
+
+DrawList::Command* DrawList::addCommand(CommandType type, uint32_t color) {
+	if (executing != nullptr) {
+		executing->waitTiles();
+		executing = nullptr;
+	}
+	reserve(commands, commandCapacity, commandCount + 1, commandCount);
+	Command* command = commands + commandCount++;
+	command->type = type;
+	command->color = color;
+	return command;
+}
+
+void DrawList::line(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color) {
+	Command* command = addCommand(CommandLine, color);
+	command->i[0] = clampCoordinate((int64_t)x0);
+	command->i[1] = clampCoordinate((int64_t)y0);
+	command->i[2] = clampCoordinate((int64_t)x1);
+	command->i[3] = clampCoordinate((int64_t)y1);
+	command->x0 = (command->i[0] < command->i[2]) ? command->i[0] : command->i[2];
+	command->y0 = (command->i[1] < command->i[3]) ? command->i[1] : command->i[3];
+	command->x1 = ((command->i[0] > command->i[2]) ? command->i[0] : command->i[2]) + 1;
+	command->y1 = ((command->i[1] > command->i[3]) ? command->i[1] : command->i[3]) + 1;
+}
+
+void DrawList::lineAA(float x0, float y0, float x1, float y1, uint32_t color) {
+	Command* command = addCommand(CommandLineAA, color);
+	command->f[0] = clampCoordinate(x0);
+	command->f[1] = clampCoordinate(y0);
+	command->f[2] = clampCoordinate(x1);
+	command->f[3] = clampCoordinate(y1);
+	command->x0 = (int32_t)floorf(fminf(command->f[0], command->f[2]) - LINE_MARGIN);
+	command->y0 = (int32_t)floorf(fminf(command->f[1], command->f[3]) - LINE_MARGIN);
+	command->x1 = (int32_t)floorf(fmaxf(command->f[0], command->f[2]) + LINE_MARGIN) + 1;
+	command->y1 = (int32_t)floorf(fmaxf(command->f[1], command->f[3]) + LINE_MARGIN) + 1;
+}
+
+void DrawList::circle(int32_t cx, int32_t cy, uint32_t radius, uint32_t color) {
+	Command* command = addCommand(CommandCircle, color);
+	command->i[0] = clampCoordinate((int64_t)cx);
+	command->i[1] = clampCoordinate((int64_t)cy);
+	command->i[2] = clampCoordinate((int64_t)radius);
+	command->x0 = command->i[0] - command->i[2];
+	command->y0 = command->i[1] - command->i[2];
+	command->x1 = command->i[0] + command->i[2] + 1;
+	command->y1 = command->i[1] + command->i[2] + 1;
+}
+
+void DrawList::fillCircle(int32_t cx, int32_t cy, uint32_t radius, uint32_t color) {
+	circle(cx, cy, radius, color);
+	commands[commandCount - 1].type = CommandFillCircle;
+}
+
+void DrawList::fillTriangle(float x0, float y0, float x1, float y1, float x2, float y2, uint32_t color) {
+	int32_t fixed[6] = {toFixed(x0), toFixed(y0), toFixed(x1), toFixed(y1), toFixed(x2), toFixed(y2)};
+	const int64_t area = ((int64_t)fixed[4] - fixed[0]) * ((int64_t)fixed[3] - fixed[1]) - ((int64_t)fixed[5] - fixed[1]) * ((int64_t)fixed[2] - fixed[0]);
+	if (area == 0) {
+		return;
+	}
+	if (area < 0) {
+		// Swap the last two corners, the edge functions expect E >= 0 inside.
+		int32_t swap = fixed[2]; fixed[2] = fixed[4]; fixed[4] = swap;
+		swap = fixed[3]; fixed[3] = fixed[5]; fixed[5] = swap;
+	}
+	Command* command = addCommand(CommandFillTriangle, color);
+	memcpy(command->fixed, fixed, sizeof(fixed));
+	int32_t minX = fixed[0], minY = fixed[1], maxX = fixed[0], maxY = fixed[1];
+	for (uint32_t corner = 1; corner < 3; ++corner) {
+		minX = (fixed[corner * 2] < minX) ? fixed[corner * 2] : minX;
+		maxX = (fixed[corner * 2] > maxX) ? fixed[corner * 2] : maxX;
+		minY = (fixed[corner * 2 + 1] < minY) ? fixed[corner * 2 + 1] : minY;
+		maxY = (fixed[corner * 2 + 1] > maxY) ? fixed[corner * 2 + 1] : maxY;
+	}
+	command->x0 = minX >> 4;
+	command->y0 = minY >> 4;
+	command->x1 = (maxX >> 4) + 1;
+	command->y1 = (maxY >> 4) + 1;
+}
+
+void DrawList::fillPolygon(const float* coordinates, uint32_t count, uint32_t color) {
+	if (coordinates == nullptr || count < 3) {
+		return;
+	}
+	Command* command = addCommand(CommandFillPolygon, color);
+	reserve(points, pointCapacity, (pointCount + count) * 2, pointCount * 2);
+	command->polygon.first = pointCount;
+	command->polygon.count = count;
+	int32_t* corner = points + pointCount * 2;
+	int32_t minX = COORDINATE_LIMIT * 16, minY = COORDINATE_LIMIT * 16, maxX = -minX, maxY = -minY;
+	for (uint32_t index = 0; index < count * 2; index += 2) {
+		corner[index] = toFixed(coordinates[index]);
+		corner[index + 1] = toFixed(coordinates[index + 1]);
+		minX = (corner[index] < minX) ? corner[index] : minX;
+		maxX = (corner[index] > maxX) ? corner[index] : maxX;
+		minY = (corner[index + 1] < minY) ? corner[index + 1] : minY;
+		maxY = (corner[index + 1] > maxY) ? corner[index + 1] : maxY;
+	}
+	pointCount += count;
+	maxPolygonCount = (count > maxPolygonCount) ? count : maxPolygonCount;
+	command->x0 = minX >> 4;
+	command->y0 = minY >> 4;
+	command->x1 = (maxX >> 4) + 1;
+	command->y1 = (maxY >> 4) + 1;
+}
+
+// Count ('fill' false) or store ('fill' true) the command in the bins it may
+// touch. Lines only go to the tiles along them instead of their whole bounds.
+void DrawList::binCommand(uint32_t index, uint32_t columns, int32_t width, int32_t height, bool fill) {
+	const Command& command = commands[index];
+	const int32_t left = (command.x0 > 0) ? command.x0 : 0;
+	const int32_t top = (command.y0 > 0) ? command.y0 : 0;
+	const int32_t right = (command.x1 < width) ? command.x1 : width;
+	const int32_t bottom = (command.y1 < height) ? command.y1 : height;
+	if (left >= right || top >= bottom) {
+		return;
+	}
+	const uint32_t firstColumn = left / TILE_SIZE;
+	const uint32_t lastColumn = (right - 1) / TILE_SIZE;
+	const uint32_t firstRow = top / TILE_SIZE;
+	const uint32_t lastRow = (bottom - 1) / TILE_SIZE;
+	const bool isLine = (command.type == CommandLine || command.type == CommandLineAA);
+	double ax = 0.0, ay = 0.0, bx = 0.0, by = 0.0;
+	if (command.type == CommandLine) {
+		ax = command.i[0]; ay = command.i[1]; bx = command.i[2]; by = command.i[3];
+	} else if (command.type == CommandLineAA) {
+		ax = command.f[0]; ay = command.f[1]; bx = command.f[2]; by = command.f[3];
+	}
+
+	for (uint32_t row = firstRow; row <= lastRow; ++row) {
+		uint32_t from = firstColumn, to = lastColumn;
+		if (isLine) {
+			// Columns of the segment within the row, plus the margin.
+			double low = (ax < bx) ? ax : bx, high = (ax < bx) ? bx : ax;
+			if (ay != by) {
+				double t0 = ((double)row * TILE_SIZE - LINE_MARGIN - ay) / (by - ay);
+				double t1 = ((double)(row + 1) * TILE_SIZE + LINE_MARGIN - ay) / (by - ay);
+				if (t0 > t1) {
+					const double swap = t0; t0 = t1; t1 = swap;
+				}
+				t0 = (t0 < 0.0) ? 0.0 : t0;
+				t1 = (t1 > 1.0) ? 1.0 : t1;
+				if (t0 > t1) {
+					continue;
+				}
+				low = ax + t0 * (bx - ax);
+				high = ax + t1 * (bx - ax);
+				if (low > high) {
+					const double swap = low; low = high; high = swap;
+				}
+			}
+			low = floor((low - LINE_MARGIN) / TILE_SIZE);
+			high = floor((high + LINE_MARGIN) / TILE_SIZE);
+			// Off the canvas columns in this row. Both ends are in range of
+			// uint32_t past this point.
+			if (high < 0.0 || low > (double)to) {
+				continue;
+			}
+			low = (low < 0.0) ? 0.0 : low;
+			from = (low > from) ? (uint32_t)low : from;
+			to = (high < to) ? (uint32_t)high : to;
+		}
+		for (uint32_t column = from; column <= to && column < columns; ++column) {
+			const uint32_t bin = row * columns + column;
+			if (fill) {
+				binCommands[binStart[bin]++] = index;
+			} else {
+				++binStart[bin + 1];
+			}
+		}
+	}
+}
+
+void DrawList::execute(WindowCanvas& canvas) {
+	if (executing != nullptr) {
+		executing->waitTiles();
+		executing = nullptr;
+	}
+	if (commandCount == 0 || canvas.getDepth() != 32 || canvas.getPixelBuffer() == nullptr) {
+		return;
+	}
+	const int32_t width = canvas.getWidth();
+	const int32_t height = canvas.getHeight();
+	const uint32_t columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const uint32_t rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+	const uint32_t binCount = columns * rows;
+
+	// Counting sort of the commands by bin, keeping their order in each bin.
+	reserve(binStart, binCapacity, binCount + 1, 0);
+	memset(binStart, 0, (binCount + 1) * sizeof(uint32_t));
+	for (uint32_t index = 0; index < commandCount; ++index) {
+		binCommand(index, columns, width, height, false);
+	}
+	for (uint32_t bin = 0; bin < binCount; ++bin) {
+		binStart[bin + 1] += binStart[bin];
+	}
+	reserve(binCommands, binCommandCapacity, binStart[binCount], 0);
+	for (uint32_t index = 0; index < commandCount; ++index) {
+		binCommand(index, columns, width, height, true);
+	}
+	// Filling moved every start to the start of the next bin.
+	memmove(binStart + 1, binStart, binCount * sizeof(uint32_t));
+	binStart[0] = 0;
+
+	reserve(crossings, crossingCapacity, canvas.getTileThreadCount() * maxPolygonCount, 0);
+	binColumns = columns;
+	executing = &canvas;
+	canvas.renderTiles(runTile, this, TILE_SIZE, TILE_SIZE);
+}
+
+void DrawList::drawTile(const WindowTile& tile) const {
+	const Kernels& kernels = getKernels();
+	const Clip clip = {tile.x, tile.y, tile.x + (int32_t)tile.width, tile.y + (int32_t)tile.height};
+	const uint32_t pitch = tile.pitch / 4;
+	uint32_t* base = (uint32_t*)(tile.pixels - (size_t)tile.y * tile.pitch - (size_t)tile.x * 4);
+	int32_t* scratch = crossings + tile.thread * maxPolygonCount;
+	const uint32_t bin = (tile.y / TILE_SIZE) * binColumns + tile.x / TILE_SIZE;
+
+	for (uint32_t index = binStart[bin]; index < binStart[bin + 1]; ++index) {
+		const Command& command = commands[binCommands[index]];
+		// Only the part of the tile the command may touch.
+		Clip bounds = clip;
+		bounds.x0 = (command.x0 > bounds.x0) ? command.x0 : bounds.x0;
+		bounds.y0 = (command.y0 > bounds.y0) ? command.y0 : bounds.y0;
+		bounds.x1 = (command.x1 < bounds.x1) ? command.x1 : bounds.x1;
+		bounds.y1 = (command.y1 < bounds.y1) ? command.y1 : bounds.y1;
+		switch (command.type) {
+		case CommandLine :
+			drawLine(base, pitch, bounds, command.i, command.color);
+			break;
+		case CommandLineAA :
+			drawLineAA(base, pitch, bounds, command.f, command.color);
+			break;
+		case CommandCircle :
+			drawCircle(base, pitch, bounds, command.i, command.color);
+			break;
+		case CommandFillCircle :
+			drawFilledCircle(kernels, base, pitch, bounds, command.i, command.color);
+			break;
+		case CommandFillTriangle :
+			drawFilledTriangle(kernels, base, pitch, bounds, command.fixed, command.color);
+			break;
+		case CommandFillPolygon :
+			drawFilledPolygon(kernels, base, pitch, bounds, points + command.polygon.first * 2, command.polygon.count, scratch, command.color);
+			break;
+		}
+	}
+}
+
+void DrawList::runTile(const WindowTile& tile, void* user) {
+	((const DrawList*)user)->drawTile(tile);
+}
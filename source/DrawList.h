@@ -0,0 +1,120 @@
+#ifndef __WC_DRAW_LIST_H__
+#define __WC_DRAW_LIST_H__
+
+#include <stdint.h>
+
+class WindowCanvas;
+struct WindowTile;
+
+// Records drawing commands and rasterizes them in one pass per screen tile.
+// execute() sorts the commands into 64 x 64 bins and runs the tiles with
+// WindowCanvas::renderTiles(), so every tile stays in the caches while all
+// of its commands are drawn, and blit() waits for the result.
+// Colors are premultiplied 0xAARRGGBB, translucent colors are blended
+// (SrcOver). Coordinates are in pixels, pixel centres at +0.5. Only 32 bit
+// canvases are drawn to.
+class DrawList {
+public:
+	// Side of the bins, a multiple of the renderTiles() alignment.
+	static const uint32_t TILE_SIZE = 64;
+
+private:
+	enum CommandType {
+		CommandLine,
+		CommandLineAA,
+		CommandCircle,
+		CommandFillCircle,
+		CommandFillTriangle,
+		CommandFillPolygon,
+	};
+
+	struct Command {
+		CommandType type;
+		uint32_t color;
+		// Pixels possibly touched, [x0, x1) x [y0, y1).
+		int32_t x0, y0, x1, y1;
+		union {
+			// Integer end points, or centre and radius.
+			int32_t i[6];
+			// Line end points.
+			float f[4];
+			// 28.4 fixed point triangle corners.
+			int32_t fixed[6];
+			// Corners in 'points'.
+			struct {
+				uint32_t first;
+				uint32_t count;
+			} polygon;
+		};
+	};
+
+	Command* commands;
+	uint32_t commandCount;
+	uint32_t commandCapacity;
+	// 28.4 fixed point x, y pairs of the polygons.
+	int32_t* points;
+	uint32_t pointCount;
+	uint32_t pointCapacity;
+	uint32_t maxPolygonCount;
+
+	// Command indices per bin, bin 'b' owns binCommands[binStart[b]] to
+	// binCommands[binStart[b + 1]].
+	uint32_t* binStart;
+	uint32_t binCapacity;
+	uint32_t* binCommands;
+	uint32_t binCommandCapacity;
+	uint32_t binColumns;
+	// Polygon crossings, 'maxPolygonCount' per tile thread.
+	int32_t* crossings;
+	uint32_t crossingCapacity;
+
+	// Canvas whose tiles may still be reading the commands.
+	WindowCanvas* executing;
+
+	Command* addCommand(CommandType type, uint32_t color);
+	void binCommand(uint32_t index, uint32_t columns, int32_t width, int32_t height, bool fill);
+	void drawTile(const WindowTile& tile) const;
+	static void runTile(const WindowTile& tile, void* user);
+
+	DrawList(const DrawList&);
+	DrawList& operator=(const DrawList&);
+
+public:
+	DrawList();
+
+	~DrawList();
+
+	// Drop the recorded commands, keeping the allocations.
+	void clear();
+
+	uint32_t getCommandCount() const;
+
+	// One pixel wide Bresenham line, both end points included.
+	void line(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color);
+
+	// Anti-aliased line (Xiaolin Wu), about one pixel wide.
+	void lineAA(float x0, float y0, float x1, float y1, uint32_t color);
+
+	// Midpoint circle outline around pixel 'cx', 'cy'.
+	void circle(int32_t cx, int32_t cy, uint32_t radius, uint32_t color);
+
+	// Every pixel whose centre is within 'radius' of the centre of pixel
+	// 'cx', 'cy'.
+	void fillCircle(int32_t cx, int32_t cy, uint32_t radius, uint32_t color);
+
+	// Pixels whose centre is inside the triangle, shared edges are drawn by
+	// one of the triangles only (top-left rule). Either winding.
+	void fillTriangle(float x0, float y0, float x1, float y1, float x2, float y2, uint32_t color);
+
+	// Even-odd fill of the polygon through 'count' x, y pairs, which may be
+	// concave or self-intersecting.
+	void fillPolygon(const float* points, uint32_t count, uint32_t color);
+
+	// Draw the commands into 'canvas' on its tile threads and return; blit()
+	// or waitTiles() finish the work. The commands are kept, so a list can be
+	// executed again, and must not change until the tiles are done: clear()
+	// and the drawing calls wait for them.
+	void execute(WindowCanvas& canvas);
+};
+
+#endif // __WC_DRAW_LIST_H__
@@ -0,0 +1,90 @@
+#include "FramePacer.h"
+#include "WindowCanvas.h"
+#include "Thread.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WC_SPIN_PAUSE() _mm_pause()
+#else
+#define WC_SPIN_PAUSE() /* EMPTY */
+#endif
+
+// Covers the usual nanosleep wake-up latency on an idle system.
+static const uint64_t DEFAULT_SPIN_THRESHOLD = 500000;
+
+FramePacer::FramePacer(WindowCanvas& canvas, double framesPerSecond, SyncMode syncMode)
+	: canvas(canvas), period(0), spinThreshold(DEFAULT_SPIN_THRESHOLD), deadline(0), lastFrame(0), lastFrameTime(0), frameCount(0), missedCount(0), syncMode(syncMode) {
+	setTargetRate(framesPerSecond);
+}
+
+void FramePacer::setTargetRate(double framesPerSecond) {
+	period = (framesPerSecond > 0.0) ? (uint64_t)(1000000000.0 / framesPerSecond) : 0;
+	reset();
+}
+
+double FramePacer::getTargetRate() const {
+	return (period > 0) ? 1000000000.0 / period : 0.0;
+}
+
+void FramePacer::setSyncMode(SyncMode syncMode) {
+	this->syncMode = syncMode;
+}
+
+void FramePacer::setSpinThreshold(uint32_t microseconds) {
+	spinThreshold = (uint64_t)microseconds * 1000;
+}
+
+bool FramePacer::wait() {
+	// Push the frame out first so the server works on it while we sleep.
+	if (syncMode != SyncNone) {
+		canvas.flush(syncMode == SyncFinish);
+	}
+
+	uint64_t now = getMonotonicTime();
+	if (deadline == 0) {
+		deadline = now;
+	}
+	deadline += period;
+
+	bool onTime = true;
+	if (period == 0) {
+		// Unlimited, there is no deadline to miss.
+		deadline = now;
+	} else if (now >= deadline) {
+		// Do not try to catch up with a burst of short frames.
+		++missedCount;
+		deadline = now;
+		onTime = false;
+	} else {
+		if (deadline - now > spinThreshold) {
+			sleepUntil(deadline - spinThreshold);
+		}
+		while ((now = getMonotonicTime()) < deadline) {
+			WC_SPIN_PAUSE();
+		}
+	}
+
+	if (lastFrame != 0) {
+		lastFrameTime = now - lastFrame;
+	}
+	lastFrame = now;
+	++frameCount;
+	return onTime;
+}
+
+void FramePacer::reset() {
+	deadline = 0;
+	lastFrame = 0;
+}
+
+uint64_t FramePacer::getFrameCount() const {
+	return frameCount;
+}
+
+uint64_t FramePacer::getMissedFrameCount() const {
+	return missedCount;
+}
+
+double FramePacer::getLastFrameTime() const {
+	return lastFrameTime / 1000000000.0;
+}
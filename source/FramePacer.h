@@ -0,0 +1,63 @@
+#ifndef __WC_FRAME_PACER_H__
+#define __WC_FRAME_PACER_H__
+
+#include <stdint.h>
+
+class WindowCanvas;
+
+// Holds a render loop to a fixed frame rate. wait() flushes the canvas
+// output, sleeps until shortly before the next deadline and spins for the
+// rest, which keeps frame times steady without burning a core.
+class FramePacer {
+public:
+	enum SyncMode {
+		// Only wait for the deadline.
+		SyncNone,
+		// Send the queued requests to the display server before waiting.
+		SyncFlush,
+		// Wait for the display server to process the frame before waiting.
+		SyncFinish,
+	};
+
+private:
+	WindowCanvas& canvas;
+	uint64_t period;
+	uint64_t spinThreshold;
+	uint64_t deadline;
+	uint64_t lastFrame;
+	uint64_t lastFrameTime;
+	uint64_t frameCount;
+	uint64_t missedCount;
+	SyncMode syncMode;
+
+public:
+	FramePacer(WindowCanvas& canvas, double framesPerSecond = 60.0, SyncMode syncMode = SyncFlush);
+
+	// A rate of 0 or less removes the limit: wait() still flushes and counts
+	// the frames, but never sleeps or misses a deadline.
+	void setTargetRate(double framesPerSecond);
+
+	double getTargetRate() const;
+
+	void setSyncMode(SyncMode syncMode);
+
+	// Time before the deadline spent spinning instead of sleeping.
+	void setSpinThreshold(uint32_t microseconds);
+
+	// Call once per frame after blit(). Returns false if the deadline was
+	// already missed, in which case the schedule restarts from now. Always
+	// true without a target rate.
+	bool wait();
+
+	// Start a new schedule from now, e.g. after a pause.
+	void reset();
+
+	uint64_t getFrameCount() const;
+
+	uint64_t getMissedFrameCount() const;
+
+	// Seconds between the last two calls to wait().
+	double getLastFrameTime() const;
+};
+
+#endif // __WC_FRAME_PACER_H__
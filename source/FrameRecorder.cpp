@@ -0,0 +1,224 @@
+#include "FrameRecorder.h"
+#include "WindowCanvas.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char FRAME_HEADER[] = "FRAME\n";
+static const uint32_t FRAME_HEADER_LENGTH = sizeof(FRAME_HEADER) - 1;
+
+static uint8_t clampByte(int32_t value) {
+	return (value > 255) ? 255 : (uint8_t)value;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+	while (b != 0) {
+		const uint32_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+FrameRecorder::FrameRecorder(WindowCanvas& canvas, uint32_t slotCount)
+	: canvas(canvas), file(nullptr), width(0), height(0), format(PixelFormatXRGB8888), slotCount(slotCount), slotLength(0), output(nullptr), outputLength(0), rows(nullptr)
+	, running(false), failed(false), frameCount(0), droppedCount(0), bytesWritten(0) {
+	if (this->slotCount < 1) {
+		this->slotCount = 1;
+	} else if (this->slotCount > MAX_SLOT_COUNT) {
+		this->slotCount = MAX_SLOT_COUNT;
+	}
+	memset(slots, 0, sizeof(slots));
+}
+
+FrameRecorder::~FrameRecorder() {
+	close();
+}
+
+int FrameRecorder::open(const char* path, double framesPerSecond) {
+	close();
+	width = canvas.getWidth();
+	height = canvas.getHeight();
+	format = canvas.getPixelFormat();
+	if (width == 0 || height == 0 || canvas.getPixelBuffer() == nullptr || format == PixelFormatIndex8) {
+		return 1;
+	}
+
+	// The rate as a fraction with a denominator of 1000, reduced.
+	uint32_t rateNumerator = (framesPerSecond > 0.0) ? (uint32_t)(framesPerSecond * 1000.0 + 0.5) : 0;
+	if (rateNumerator == 0) {
+		rateNumerator = 60000;
+	}
+	const uint32_t divisor = gcd(rateNumerator, 1000);
+
+	slotLength = width * height * getBytesPerPixel(format);
+	const uint32_t chromaLength = ((width + 1) / 2) * ((height + 1) / 2);
+	outputLength = FRAME_HEADER_LENGTH + width * height + 2 * chromaLength;
+	output = (uint8_t*)malloc(outputLength);
+	rows = (uint32_t*)malloc(2 * width * sizeof(uint32_t));
+	bool allocated = (output != nullptr && rows != nullptr);
+	for (uint32_t index = 0; index < slotCount && allocated; ++index) {
+		allocated = ((slots[index] = (uint8_t*)malloc(slotLength)) != nullptr);
+	}
+	if (!allocated || (file = fopen(path, "wb")) == nullptr) {
+		close();
+		return 2;
+	}
+	// Every write is a whole frame, stdio buffering would only add a copy.
+	setvbuf(file, nullptr, _IONBF, 0);
+	const int headerLength = fprintf(file, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n", width, height, rateNumerator / divisor, 1000 / divisor);
+	if (headerLength < 0) {
+		close();
+		return 3;
+	}
+	memcpy(output, FRAME_HEADER, FRAME_HEADER_LENGTH);
+
+	for (uint32_t index = 0; index < slotCount; ++index) {
+		available.push(index);
+	}
+	failed = false;
+	frameCount = 0;
+	droppedCount = 0;
+	bytesWritten = headerLength;
+	running = true;
+	if (thread.start(run, this) != 0) {
+		running = false;
+		close();
+		return 4;
+	}
+	canvas.setFrameRecorder(this);
+	return 0;
+}
+
+void FrameRecorder::close() {
+	if (thread.isRunning()) {
+		canvas.setFrameRecorder(nullptr);
+		running = false;
+		filledCount.post();
+		thread.join();
+	}
+	// Leave both queues empty for the next recording.
+	uint32_t index;
+	while (filled.pop(index)) {
+	}
+	while (available.pop(index)) {
+	}
+	while (filledCount.tryWait()) {
+	}
+	for (uint8_t*& slot : slots) {
+		free(slot);
+		slot = nullptr;
+	}
+	free(output);
+	output = nullptr;
+	free(rows);
+	rows = nullptr;
+	if (file != nullptr) {
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+bool FrameRecorder::isOpen() const {
+	return running;
+}
+
+bool FrameRecorder::capture(const uint8_t* pixels, uint32_t pitch, uint32_t width, uint32_t height) {
+	if (!running) {
+		return false;
+	}
+	uint32_t index;
+	if (width != this->width || height != this->height || failed || !available.pop(index)) {
+		droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	const uint32_t rowLength = width * getBytesPerPixel(format);
+	uint8_t* slot = slots[index];
+	for (uint32_t row = 0; row < height; ++row) {
+		memcpy(slot + row * rowLength, pixels + row * pitch, rowLength);
+	}
+	filled.push(index);
+	filledCount.post();
+	return true;
+}
+
+// Convert a frame to full range BT.601 4:2:0, each chroma sample taken from
+// the average of a 2x2 block. Odd sizes repeat the last column and row.
+void FrameRecorder::encode(const uint8_t* frame) {
+	const uint32_t rowLength = width * getBytesPerPixel(format);
+	const uint32_t chromaWidth = (width + 1) / 2;
+	uint8_t* lumaPlane = output + FRAME_HEADER_LENGTH;
+	uint8_t* cbPlane = lumaPlane + width * height;
+	uint8_t* crPlane = cbPlane + chromaWidth * ((height + 1) / 2);
+	uint32_t* top = rows;
+	uint32_t* bottom = rows + width;
+
+	for (uint32_t y = 0; y < height; y += 2) {
+		const uint32_t next = (y + 1 < height) ? y + 1 : y;
+		convertPixels((uint8_t*)top, width * 4, PixelFormatXRGB8888, frame + y * rowLength, rowLength, format, width, 1);
+		convertPixels((uint8_t*)bottom, width * 4, PixelFormatXRGB8888, frame + next * rowLength, rowLength, format, width, 1);
+		for (uint32_t x = 0; x < width; ++x) {
+			const uint32_t p = top[x], q = bottom[x];
+			lumaPlane[y * width + x] = (uint8_t)((19595 * ((p >> 16) & 0xFF) + 38470 * ((p >> 8) & 0xFF) + 7471 * (p & 0xFF) + 32768) >> 16);
+			if (next != y) {
+				lumaPlane[next * width + x] = (uint8_t)((19595 * ((q >> 16) & 0xFF) + 38470 * ((q >> 8) & 0xFF) + 7471 * (q & 0xFF) + 32768) >> 16);
+			}
+		}
+		uint8_t* cb = cbPlane + (y / 2) * chromaWidth;
+		uint8_t* cr = crPlane + (y / 2) * chromaWidth;
+		for (uint32_t x = 0; x < width; x += 2) {
+			const uint32_t right = (x + 1 < width) ? x + 1 : x;
+			const uint32_t block[4] = {top[x], top[right], bottom[x], bottom[right]};
+			int32_t r = 0, g = 0, b = 0;
+			for (uint32_t pixel : block) {
+				r += (pixel >> 16) & 0xFF;
+				g += (pixel >> 8) & 0xFF;
+				b += pixel & 0xFF;
+			}
+			// Sums of four pixels, hence the two extra bits of shift.
+			// The 128 offset keeps the sums positive.
+			cb[x / 2] = clampByte((-11056 * r - 21712 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18);
+			cr[x / 2] = clampByte((32768 * r - 27440 * g - 5328 * b + (128 << 18) + (1 << 17)) >> 18);
+		}
+	}
+}
+
+void FrameRecorder::run(void* user) {
+	FrameRecorder& recorder = *(FrameRecorder*)user;
+	for (;;) {
+		recorder.filledCount.wait();
+		uint32_t index;
+		if (!recorder.filled.pop(index)) {
+			if (!recorder.running) {
+				break;
+			}
+			continue;
+		}
+		if (!recorder.failed) {
+			recorder.encode(recorder.slots[index]);
+			if (fwrite(recorder.output, 1, recorder.outputLength, recorder.file) == recorder.outputLength) {
+				recorder.frameCount.fetch_add(1, std::memory_order_relaxed);
+				recorder.bytesWritten.fetch_add(recorder.outputLength, std::memory_order_relaxed);
+			} else {
+				recorder.failed = true;
+			}
+		}
+		recorder.available.push(index);
+	}
+}
+
+uint64_t FrameRecorder::getFrameCount() const {
+	return frameCount.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameRecorder::getDroppedFrameCount() const {
+	return droppedCount.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameRecorder::getBytesWritten() const {
+	return bytesWritten.load(std::memory_order_relaxed);
+}
+
+bool FrameRecorder::hasFailed() const {
+	return failed;
+}
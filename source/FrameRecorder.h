@@ -0,0 +1,88 @@
+#ifndef __WC_FRAME_RECORDER_H__
+#define __WC_FRAME_RECORDER_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+#include "PixelFormat.h"
+#include "Thread.h"
+
+class WindowCanvas;
+
+// Records the frames presented by a canvas to a YUV4MPEG2 (.y4m) stream,
+// readable by ffmpeg and most players. blit() copies every frame into a ring
+// of slots, a writer thread converts them to 4:2:0 and writes one frame per
+// call. When the disk falls behind the ring fills up and frames are dropped
+// and counted instead of stalling the render thread.
+class FrameRecorder {
+public:
+	// Upper limit for the slot count.
+	static const uint32_t MAX_SLOT_COUNT = 32;
+
+private:
+	WindowCanvas& canvas;
+	FILE* file;
+	uint32_t width;
+	uint32_t height;
+	PixelFormat format;
+	uint32_t slotCount;
+	// Packed rows in the canvas format, one frame per slot.
+	uint8_t* slots[MAX_SLOT_COUNT];
+	uint32_t slotLength;
+	// Slot indices move between the canvas and the writer like the buffers
+	// of the presenter, the semaphore only parks an idle writer.
+	SpscQueue<uint32_t, MAX_SLOT_COUNT + 1> filled;
+	SpscQueue<uint32_t, MAX_SLOT_COUNT + 1> available;
+	Semaphore filledCount;
+	// "FRAME" header and the Y, Cb and Cr planes of the frame being written.
+	uint8_t* output;
+	uint32_t outputLength;
+	uint32_t* rows;
+	std::atomic<bool> running;
+	std::atomic<bool> failed;
+	std::atomic<uint64_t> frameCount;
+	std::atomic<uint64_t> droppedCount;
+	std::atomic<uint64_t> bytesWritten;
+	Thread thread;
+
+	void encode(const uint8_t* frame);
+	static void run(void* user);
+
+	FrameRecorder(const FrameRecorder&);
+	FrameRecorder& operator=(const FrameRecorder&);
+
+public:
+	// 'slotCount' frames can wait for the writer before frames are dropped.
+	// The recorder has to be destroyed before the canvas.
+	FrameRecorder(WindowCanvas& canvas, uint32_t slotCount = 8);
+
+	~FrameRecorder();
+
+	// Start recording the canvas at its current size to 'path'. The rate is
+	// only written to the stream header. 8 bit canvases can't be recorded.
+	// Returns 0 on success.
+	int open(const char* path, double framesPerSecond = 60.0);
+
+	// Stop recording, waiting for the queued frames to be written.
+	void close();
+
+	bool isOpen() const;
+
+	// Called by the canvas with every presented frame. Copies the frame and
+	// returns immediately, returns false if it had to be dropped because no
+	// slot was free, the size changed or writing failed.
+	bool capture(const uint8_t* pixels, uint32_t pitch, uint32_t width, uint32_t height);
+
+	// Frames written to the file so far.
+	uint64_t getFrameCount() const;
+
+	uint64_t getDroppedFrameCount() const;
+
+	uint64_t getBytesWritten() const;
+
+	// True once a write failed, later frames are dropped.
+	bool hasFailed() const;
+};
+
+#endif // __WC_FRAME_RECORDER_H__
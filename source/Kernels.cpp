@@ -0,0 +1,932 @@
+#include "Kernels.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WC_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(WC_KERNELS_X86)
+#define WC_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/******************************************************************************/
+/** Scalar                                                                    */
+/******************************************************************************/
+static void fill32Scalar(uint32_t* dst, uint32_t count, uint32_t color) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = color;
+	}
+}
+
+static void swizzle32Scalar(uint32_t* dst, const uint32_t* src, uint32_t count, const uint8_t shuffle[4]) {
+	for (uint32_t index = 0; index < count; ++index) {
+		const uint8_t* in = (const uint8_t*)(src + index);
+		uint8_t* out = (uint8_t*)(dst + index);
+		const uint8_t b0 = in[shuffle[0]], b1 = in[shuffle[1]], b2 = in[shuffle[2]], b3 = in[shuffle[3]];
+		out[0] = b0;
+		out[1] = b1;
+		out[2] = b2;
+		out[3] = b3;
+	}
+}
+
+static void expand888Scalar(uint32_t* dst, const uint8_t* src, uint32_t count) {
+	for (uint32_t index = 0; index < count; ++index, src += 3) {
+		dst[index] = 0xFF000000u | (uint32_t)src[2] << 16 | (uint32_t)src[1] << 8 | src[0];
+	}
+}
+
+static void pack888Scalar(uint8_t* dst, const uint32_t* src, uint32_t count) {
+	for (uint32_t index = 0; index < count; ++index, dst += 3) {
+		dst[0] = src[index] & 0xFF;
+		dst[1] = (src[index] >> 8) & 0xFF;
+		dst[2] = (src[index] >> 16) & 0xFF;
+	}
+}
+
+static inline uint32_t expand565Pixel(uint32_t value) {
+	// Replicate the top bits so that full intensity maps to 0xFF.
+	return 0xFF000000u
+		| (value & 0xF800) << 8 | (value & 0xE000) << 3
+		| (value & 0x07E0) << 5 | (value & 0x0600) >> 1
+		| (value & 0x001F) << 3 | (value & 0x001C) >> 2;
+}
+
+static inline uint16_t pack565Pixel(uint32_t value) {
+	return (uint16_t)(((value >> 8) & 0xF800) | ((value >> 5) & 0x07E0) | ((value >> 3) & 0x001F));
+}
+
+static void expand565Scalar(uint32_t* dst, const uint16_t* src, uint32_t count) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = expand565Pixel(src[index]);
+	}
+}
+
+static void pack565Scalar(uint16_t* dst, const uint32_t* src, uint32_t count) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = pack565Pixel(src[index]);
+	}
+}
+
+static inline uint32_t div255(uint32_t value) {
+	// Exact round(value / 255) for value <= 255 * 255.
+	value += 128;
+	return (value + (value >> 8)) >> 8;
+}
+
+template <BlendMode MODE, bool ALPHA>
+static inline uint32_t compositePixel(uint32_t dst, uint32_t src, uint32_t alpha) {
+	if (ALPHA) {
+		src = div255((src & 0xFF) * alpha)
+			| div255(((src >> 8) & 0xFF) * alpha) << 8
+			| div255(((src >> 16) & 0xFF) * alpha) << 16
+			| div255((src >> 24) * alpha) << 24;
+	}
+	const uint32_t srcAlpha = src >> 24;
+	const uint32_t dstAlpha = dst >> 24;
+	uint32_t result = 0;
+	for (uint32_t shift = 0; shift < 32; shift += 8) {
+		const uint32_t s = (src >> shift) & 0xFF;
+		const uint32_t d = (dst >> shift) & 0xFF;
+		uint32_t value;
+		switch (MODE) {
+		case BlendSrcOver :
+			value = s + div255(d * (255 - srcAlpha));
+			break;
+		case BlendAdd :
+			value = s + d;
+			break;
+		default :
+			value = div255(s * d) + div255(s * (255 - dstAlpha)) + div255(d * (255 - srcAlpha));
+			break;
+		}
+		result |= (value > 255 ? 255 : value) << shift;
+	}
+	return result;
+}
+
+template <BlendMode MODE, bool ALPHA>
+static void compositeScalar(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t alpha) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = compositePixel<MODE, ALPHA>(dst[index], src[index], alpha);
+	}
+}
+
+// Picks the constant alpha variant only when it does something.
+#define WC_COMPOSITE_ENTRY(name, kernel) \
+template <BlendMode MODE> \
+static void name(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t alpha) { \
+	if (alpha == 255) { \
+		kernel<MODE, false>(dst, src, count, alpha); \
+	} else { \
+		kernel<MODE, true>(dst, src, count, alpha); \
+	} \
+}
+
+WC_COMPOSITE_ENTRY(compositeScalarEntry, compositeScalar)
+
+static void scaleNearestScalar(uint32_t* dst, const uint32_t* src, const uint32_t* columns, uint32_t count) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = src[columns[index]];
+	}
+}
+
+// a + (b - a) * weight / 256 on every channel. Two channels share a 32 bit
+// word, their products stay below 65536 so they never overlap.
+static inline uint32_t lerpPixel(uint32_t a, uint32_t b, uint32_t weight) {
+	const uint32_t inverse = 256 - weight;
+	const uint32_t rb = ((((a & 0x00FF00FF) * inverse + (b & 0x00FF00FF) * weight)) >> 8) & 0x00FF00FF;
+	const uint32_t ag = (((a >> 8) & 0x00FF00FF) * inverse + ((b >> 8) & 0x00FF00FF) * weight) & 0xFF00FF00;
+	return ag | rb;
+}
+
+static inline uint32_t bilinearPixel(const uint32_t* row0, const uint32_t* row1, uint32_t column, uint32_t across, uint32_t down) {
+	const uint32_t top = lerpPixel(row0[column], row0[column + 1], across);
+	const uint32_t bottom = lerpPixel(row1[column], row1[column + 1], across);
+	return lerpPixel(top, bottom, down);
+}
+
+// The hash runs four 64 bit lanes over 32 byte blocks. Each lane mixes its
+// word as in XXH3, acc = rotl(acc + lo32(w ^ key) * hi32(w ^ key) + w), the
+// rotation making the result depend on the block order. Row tails are
+// zero padded to a whole block.
+static const uint64_t HASH_KEYS[4] = {
+	0x9E3779B185EBCA87ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x85EBCA77C2B2AE63ull,
+};
+static const uint32_t HASH_BLOCK_SIZE = 32;
+static const uint32_t HASH_ROTATION = 23;
+
+static inline uint64_t hashLane(uint64_t acc, uint64_t word, uint64_t key) {
+	const uint64_t mixed = word ^ key;
+	acc += (mixed & 0xFFFFFFFF) * (mixed >> 32) + word;
+	return (acc << HASH_ROTATION) | (acc >> (64 - HASH_ROTATION));
+}
+
+static inline void hashBlock(uint64_t acc[4], const uint8_t* block) {
+	for (uint32_t lane = 0; lane < 4; ++lane) {
+		uint64_t word;
+		memcpy(&word, block + lane * 8, 8);
+		acc[lane] = hashLane(acc[lane], word, HASH_KEYS[lane]);
+	}
+}
+
+static inline void hashTail(uint64_t acc[4], const uint8_t* src, uint32_t length) {
+	uint8_t block[HASH_BLOCK_SIZE] = {};
+	memcpy(block, src, length);
+	hashBlock(acc, block);
+}
+
+static inline uint64_t hashFinish(const uint64_t acc[4], uint32_t length, uint32_t rows) {
+	uint64_t hash = acc[0] ^ (acc[1] << 16 | acc[1] >> 48) ^ (acc[2] << 32 | acc[2] >> 32) ^ (acc[3] << 48 | acc[3] >> 16);
+	hash ^= ((uint64_t)length << 32) | rows;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	return hash ^ (hash >> 33);
+}
+
+static uint64_t hashRowsScalar(const uint8_t* src, uint32_t pitch, uint32_t length, uint32_t rows) {
+	uint64_t acc[4] = {HASH_KEYS[1], HASH_KEYS[2], HASH_KEYS[3], HASH_KEYS[0]};
+	for (uint32_t row = 0; row < rows; ++row, src += pitch) {
+		uint32_t offset = 0;
+		for (; offset + HASH_BLOCK_SIZE <= length; offset += HASH_BLOCK_SIZE) {
+			hashBlock(acc, src + offset);
+		}
+		if (offset < length) {
+			hashTail(acc, src + offset, length - offset);
+		}
+	}
+	return hashFinish(acc, length, rows);
+}
+
+static void scaleBilinearScalar(uint32_t* dst, const uint32_t* row0, const uint32_t* row1, const uint32_t* columns, const uint32_t* weights, uint32_t weight, uint32_t count) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = bilinearPixel(row0, row1, columns[index], weights[index], weight);
+	}
+}
+
+// Up to 16 bits of 'mask' from bit 'position' on, in the low bits.
+static inline uint32_t readMaskBits(const uint8_t* mask, uint32_t position, uint32_t count) {
+	const uint8_t* bytes = mask + (position >> 3);
+	const uint32_t shift = position & 7;
+	const uint32_t length = (shift + count + 7) >> 3;
+	uint32_t bits = 0;
+	for (uint32_t index = 0; index < length; ++index) {
+		bits |= (uint32_t)bytes[index] << (index * 8);
+	}
+	return (bits >> shift) & ((1u << count) - 1);
+}
+
+static void maskFill32Scalar(uint32_t* dst, const uint8_t* mask, uint32_t offset, uint32_t count, uint32_t color) {
+	for (uint32_t index = 0; index < count; index += 8) {
+		const uint32_t length = (count - index < 8) ? count - index : 8;
+		const uint32_t bits = readMaskBits(mask, offset + index, length);
+		for (uint32_t bit = 0; bit < length; ++bit) {
+			if (bits & (1u << bit)) {
+				dst[index + bit] = color;
+			}
+		}
+	}
+}
+
+static void expandIndex8Scalar(uint32_t* dst, const uint8_t* src, uint32_t count, const uint32_t* palette) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = palette[src[index]];
+	}
+}
+
+#if defined(WC_KERNELS_X86)
+/******************************************************************************/
+/** SSE2                                                                      */
+/******************************************************************************/
+static void fill32SSE2(uint32_t* dst, uint32_t count, uint32_t color) {
+	const __m128i value = _mm_set1_epi32(color);
+	uint32_t index = 0;
+	for (; index < count && ((uintptr_t)(dst + index) & 15) != 0; ++index) {
+		dst[index] = color;
+	}
+	for (; index + 16 <= count; index += 16) {
+		_mm_store_si128((__m128i*)(dst + index), value);
+		_mm_store_si128((__m128i*)(dst + index + 4), value);
+		_mm_store_si128((__m128i*)(dst + index + 8), value);
+		_mm_store_si128((__m128i*)(dst + index + 12), value);
+	}
+	for (; index + 4 <= count; index += 4) {
+		_mm_store_si128((__m128i*)(dst + index), value);
+	}
+	for (; index < count; ++index) {
+		dst[index] = color;
+	}
+}
+
+static void fill32StreamSSE2(uint32_t* dst, uint32_t count, uint32_t color) {
+	const __m128i value = _mm_set1_epi32(color);
+	uint32_t index = 0;
+	for (; index < count && ((uintptr_t)(dst + index) & 15) != 0; ++index) {
+		dst[index] = color;
+	}
+	for (; index + 16 <= count; index += 16) {
+		_mm_stream_si128((__m128i*)(dst + index), value);
+		_mm_stream_si128((__m128i*)(dst + index + 4), value);
+		_mm_stream_si128((__m128i*)(dst + index + 8), value);
+		_mm_stream_si128((__m128i*)(dst + index + 12), value);
+	}
+	_mm_sfence();
+	for (; index < count; ++index) {
+		dst[index] = color;
+	}
+}
+
+static void expand565SSE2(uint32_t* dst, const uint16_t* src, uint32_t count) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const __m128i words = _mm_loadu_si128((const __m128i*)(src + index));
+		__m128i halves[2] = { _mm_unpacklo_epi16(words, zero), _mm_unpackhi_epi16(words, zero) };
+		for (uint32_t half = 0; half < 2; ++half) {
+			const __m128i v = halves[half];
+			const __m128i r = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xF800)), 8), _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xE000)), 3));
+			const __m128i g = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x07E0)), 5), _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x0600)), 1));
+			const __m128i b = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x001F)), 3), _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x001C)), 2));
+			_mm_storeu_si128((__m128i*)(dst + index + half * 4), _mm_or_si128(_mm_or_si128(alpha, r), _mm_or_si128(g, b)));
+		}
+	}
+	for (; index < count; ++index) {
+		dst[index] = expand565Pixel(src[index]);
+	}
+}
+
+static inline __m128i pack565Words(__m128i v) {
+	const __m128i r = _mm_and_si128(_mm_srli_epi32(v, 8), _mm_set1_epi32(0xF800));
+	const __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x07E0));
+	const __m128i b = _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0x001F));
+	// Sign extend so the signed saturating pack keeps the 16 bits intact.
+	return _mm_srai_epi32(_mm_slli_epi32(_mm_or_si128(_mm_or_si128(r, g), b), 16), 16);
+}
+
+static void pack565SSE2(uint16_t* dst, const uint32_t* src, uint32_t count) {
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const __m128i low = pack565Words(_mm_loadu_si128((const __m128i*)(src + index)));
+		const __m128i high = pack565Words(_mm_loadu_si128((const __m128i*)(src + index + 4)));
+		_mm_storeu_si128((__m128i*)(dst + index), _mm_packs_epi32(low, high));
+	}
+	for (; index < count; ++index) {
+		dst[index] = pack565Pixel(src[index]);
+	}
+}
+
+// Whole groups of 4 set pixels are one store. Partial groups are written
+// pixel by pixel, a blend through a full store would also write back the
+// pixels left out, and MASKMOVDQU bypasses the caches.
+static void maskFill32SSE2(uint32_t* dst, const uint8_t* mask, uint32_t offset, uint32_t count, uint32_t color) {
+	const __m128i value = _mm_set1_epi32(color);
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const uint32_t bits = readMaskBits(mask, offset + index, 8);
+		if (bits == 0) {
+			continue;
+		}
+		for (uint32_t half = 0; half < 2; ++half) {
+			const uint32_t nibble = (bits >> (half * 4)) & 15;
+			uint32_t* target = dst + index + half * 4;
+			if (nibble == 15) {
+				_mm_storeu_si128((__m128i*)target, value);
+				continue;
+			}
+			for (uint32_t bit = 0; bit < 4; ++bit) {
+				if (nibble & (1u << bit)) {
+					target[bit] = color;
+				}
+			}
+		}
+	}
+	if (index < count) {
+		maskFill32Scalar(dst + index, mask, offset + index, count - index, color);
+	}
+}
+
+// Same as lerpPixel() on four pixels, 'weight' and 'inverse' hold the
+// weights in both halves of every pixel.
+static inline __m128i lerpSSE2(__m128i a, __m128i b, __m128i weight, __m128i inverse) {
+	const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+	const __m128i rb = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(a, mask), inverse), _mm_mullo_epi16(_mm_and_si128(b, mask), weight)), 8);
+	const __m128i ag = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(a, 8), mask), inverse), _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 8), mask), weight));
+	return _mm_or_si128(rb, _mm_andnot_si128(mask, ag));
+}
+
+// Two lanes per register. The multiply only reads the low halves.
+static inline __m128i hashLaneSSE2(__m128i acc, __m128i word, __m128i key) {
+	const __m128i mixed = _mm_xor_si128(word, key);
+	acc = _mm_add_epi64(acc, _mm_add_epi64(_mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32)), word));
+	return _mm_or_si128(_mm_slli_epi64(acc, HASH_ROTATION), _mm_srli_epi64(acc, 64 - HASH_ROTATION));
+}
+
+static uint64_t hashRowsSSE2(const uint8_t* src, uint32_t pitch, uint32_t length, uint32_t rows) {
+	const __m128i key0 = _mm_loadu_si128((const __m128i*)HASH_KEYS);
+	const __m128i key1 = _mm_loadu_si128((const __m128i*)(HASH_KEYS + 2));
+	__m128i acc0 = _mm_set_epi64x(HASH_KEYS[2], HASH_KEYS[1]);
+	__m128i acc1 = _mm_set_epi64x(HASH_KEYS[0], HASH_KEYS[3]);
+	for (uint32_t row = 0; row < rows; ++row, src += pitch) {
+		uint32_t offset = 0;
+		for (; offset + HASH_BLOCK_SIZE <= length; offset += HASH_BLOCK_SIZE) {
+			acc0 = hashLaneSSE2(acc0, _mm_loadu_si128((const __m128i*)(src + offset)), key0);
+			acc1 = hashLaneSSE2(acc1, _mm_loadu_si128((const __m128i*)(src + offset + 16)), key1);
+		}
+		if (offset < length) {
+			uint8_t block[HASH_BLOCK_SIZE] = {};
+			memcpy(block, src + offset, length - offset);
+			acc0 = hashLaneSSE2(acc0, _mm_loadu_si128((const __m128i*)block), key0);
+			acc1 = hashLaneSSE2(acc1, _mm_loadu_si128((const __m128i*)(block + 16)), key1);
+		}
+	}
+	uint64_t acc[4];
+	_mm_storeu_si128((__m128i*)acc, acc0);
+	_mm_storeu_si128((__m128i*)(acc + 2), acc1);
+	return hashFinish(acc, length, rows);
+}
+
+static void scaleBilinearSSE2(uint32_t* dst, const uint32_t* row0, const uint32_t* row1, const uint32_t* columns, const uint32_t* weights, uint32_t weight, uint32_t count) {
+	const __m128i one = _mm_set1_epi16(256);
+	const __m128i down = _mm_set1_epi16(weight);
+	const __m128i up = _mm_sub_epi16(one, down);
+	uint32_t index = 0;
+	for (; index + 4 <= count; index += 4) {
+		const uint32_t* c = columns + index;
+		const __m128i p00 = _mm_setr_epi32(row0[c[0]], row0[c[1]], row0[c[2]], row0[c[3]]);
+		const __m128i p01 = _mm_setr_epi32(row0[c[0] + 1], row0[c[1] + 1], row0[c[2] + 1], row0[c[3] + 1]);
+		const __m128i p10 = _mm_setr_epi32(row1[c[0]], row1[c[1]], row1[c[2]], row1[c[3]]);
+		const __m128i p11 = _mm_setr_epi32(row1[c[0] + 1], row1[c[1] + 1], row1[c[2] + 1], row1[c[3] + 1]);
+		__m128i across = _mm_loadu_si128((const __m128i*)(weights + index));
+		across = _mm_or_si128(across, _mm_slli_epi32(across, 16));
+		const __m128i left = _mm_sub_epi16(one, across);
+		const __m128i top = lerpSSE2(p00, p01, across, left);
+		const __m128i bottom = lerpSSE2(p10, p11, across, left);
+		_mm_storeu_si128((__m128i*)(dst + index), lerpSSE2(top, bottom, down, up));
+	}
+	for (; index < count; ++index) {
+		dst[index] = bilinearPixel(row0, row1, columns[index], weights[index], weight);
+	}
+}
+
+/******************************************************************************/
+/** SSE4.1                                                                    */
+/******************************************************************************/
+// The byte shuffles only need SSSE3, which every SSE4.1 CPU has.
+WC_TARGET("sse4.1") static void swizzle32SSE41(uint32_t* dst, const uint32_t* src, uint32_t count, const uint8_t shuffle[4]) {
+	const __m128i mask = _mm_setr_epi8(
+		shuffle[0], shuffle[1], shuffle[2], shuffle[3],
+		shuffle[0] + 4, shuffle[1] + 4, shuffle[2] + 4, shuffle[3] + 4,
+		shuffle[0] + 8, shuffle[1] + 8, shuffle[2] + 8, shuffle[3] + 8,
+		shuffle[0] + 12, shuffle[1] + 12, shuffle[2] + 12, shuffle[3] + 12);
+	uint32_t index = 0;
+	for (; index + 4 <= count; index += 4) {
+		_mm_storeu_si128((__m128i*)(dst + index), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + index)), mask));
+	}
+	swizzle32Scalar(dst + index, src + index, count - index, shuffle);
+}
+
+WC_TARGET("sse4.1") static void expand888SSE41(uint32_t* dst, const uint8_t* src, uint32_t count) {
+	const __m128i mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+	uint32_t index = 0;
+	// Every load reads 16 bytes for 4 pixels, stop while 6 pixels are left.
+	for (; index + 6 <= count; index += 4) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i*)(src + index * 3));
+		_mm_storeu_si128((__m128i*)(dst + index), _mm_or_si128(_mm_shuffle_epi8(bytes, mask), alpha));
+	}
+	expand888Scalar(dst + index, src + index * 3, count - index);
+}
+
+WC_TARGET("sse4.1") static void pack888SSE41(uint8_t* dst, const uint32_t* src, uint32_t count) {
+	const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	uint32_t index = 0;
+	for (; index + 4 <= count; index += 4) {
+		const __m128i bytes = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + index)), mask);
+		_mm_storel_epi64((__m128i*)(dst + index * 3), bytes);
+		const uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(bytes, 8));
+		memcpy(dst + index * 3 + 8, &tail, 4);
+	}
+	pack888Scalar(dst + index * 3, src + index, count - index);
+}
+
+// The blend helpers work on pixels widened to 16 bit lanes, where every
+// product of two channels fits.
+WC_TARGET("sse4.1") static inline __m128i div255SSE41(__m128i value) {
+	value = _mm_add_epi16(value, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+WC_TARGET("sse4.1") static inline __m128i alphaSSE41(__m128i pixels) {
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+template <BlendMode MODE>
+WC_TARGET("sse4.1") static inline __m128i blendSSE41(__m128i src, __m128i dst) {
+	const __m128i one = _mm_set1_epi16(255);
+	switch (MODE) {
+	case BlendSrcOver :
+		return _mm_add_epi16(src, div255SSE41(_mm_mullo_epi16(dst, _mm_sub_epi16(one, alphaSSE41(src)))));
+	case BlendAdd :
+		return _mm_add_epi16(src, dst);
+	default :
+		return _mm_add_epi16(_mm_add_epi16(
+			div255SSE41(_mm_mullo_epi16(src, dst)),
+			div255SSE41(_mm_mullo_epi16(src, _mm_sub_epi16(one, alphaSSE41(dst))))),
+			div255SSE41(_mm_mullo_epi16(dst, _mm_sub_epi16(one, alphaSSE41(src)))));
+	}
+}
+
+template <BlendMode MODE, bool ALPHA>
+WC_TARGET("sse4.1") static void compositeSSE41(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t alpha) {
+	const __m128i scale = _mm_set1_epi16(alpha);
+	uint32_t index = 0;
+	for (; index + 4 <= count; index += 4) {
+		const __m128i s = _mm_loadu_si128((const __m128i*)(src + index));
+		const __m128i d = _mm_loadu_si128((const __m128i*)(dst + index));
+		if (MODE == BlendAdd && !ALPHA) {
+			_mm_storeu_si128((__m128i*)(dst + index), _mm_adds_epu8(s, d));
+			continue;
+		}
+		__m128i sLow = _mm_cvtepu8_epi16(s);
+		__m128i sHigh = _mm_cvtepu8_epi16(_mm_srli_si128(s, 8));
+		if (ALPHA) {
+			sLow = div255SSE41(_mm_mullo_epi16(sLow, scale));
+			sHigh = div255SSE41(_mm_mullo_epi16(sHigh, scale));
+		}
+		const __m128i low = blendSSE41<MODE>(sLow, _mm_cvtepu8_epi16(d));
+		const __m128i high = blendSSE41<MODE>(sHigh, _mm_cvtepu8_epi16(_mm_srli_si128(d, 8)));
+		_mm_storeu_si128((__m128i*)(dst + index), _mm_packus_epi16(low, high));
+	}
+	for (; index < count; ++index) {
+		dst[index] = compositePixel<MODE, ALPHA>(dst[index], src[index], alpha);
+	}
+}
+
+WC_COMPOSITE_ENTRY(compositeSSE41Entry, compositeSSE41)
+
+/******************************************************************************/
+/** AVX2                                                                      */
+/******************************************************************************/
+WC_TARGET("avx2") static void fill32AVX2(uint32_t* dst, uint32_t count, uint32_t color) {
+	const __m256i value = _mm256_set1_epi32(color);
+	uint32_t index = 0;
+	for (; index < count && ((uintptr_t)(dst + index) & 31) != 0; ++index) {
+		dst[index] = color;
+	}
+	for (; index + 32 <= count; index += 32) {
+		_mm256_store_si256((__m256i*)(dst + index), value);
+		_mm256_store_si256((__m256i*)(dst + index + 8), value);
+		_mm256_store_si256((__m256i*)(dst + index + 16), value);
+		_mm256_store_si256((__m256i*)(dst + index + 24), value);
+	}
+	for (; index + 8 <= count; index += 8) {
+		_mm256_store_si256((__m256i*)(dst + index), value);
+	}
+	for (; index < count; ++index) {
+		dst[index] = color;
+	}
+}
+
+WC_TARGET("avx2") static void fill32StreamAVX2(uint32_t* dst, uint32_t count, uint32_t color) {
+	const __m256i value = _mm256_set1_epi32(color);
+	uint32_t index = 0;
+	for (; index < count && ((uintptr_t)(dst + index) & 31) != 0; ++index) {
+		dst[index] = color;
+	}
+	for (; index + 32 <= count; index += 32) {
+		_mm256_stream_si256((__m256i*)(dst + index), value);
+		_mm256_stream_si256((__m256i*)(dst + index + 8), value);
+		_mm256_stream_si256((__m256i*)(dst + index + 16), value);
+		_mm256_stream_si256((__m256i*)(dst + index + 24), value);
+	}
+	_mm_sfence();
+	for (; index < count; ++index) {
+		dst[index] = color;
+	}
+}
+
+WC_TARGET("avx2") static void swizzle32AVX2(uint32_t* dst, const uint32_t* src, uint32_t count, const uint8_t shuffle[4]) {
+	const __m256i mask = _mm256_setr_epi8(
+		shuffle[0], shuffle[1], shuffle[2], shuffle[3],
+		shuffle[0] + 4, shuffle[1] + 4, shuffle[2] + 4, shuffle[3] + 4,
+		shuffle[0] + 8, shuffle[1] + 8, shuffle[2] + 8, shuffle[3] + 8,
+		shuffle[0] + 12, shuffle[1] + 12, shuffle[2] + 12, shuffle[3] + 12,
+		shuffle[0], shuffle[1], shuffle[2], shuffle[3],
+		shuffle[0] + 4, shuffle[1] + 4, shuffle[2] + 4, shuffle[3] + 4,
+		shuffle[0] + 8, shuffle[1] + 8, shuffle[2] + 8, shuffle[3] + 8,
+		shuffle[0] + 12, shuffle[1] + 12, shuffle[2] + 12, shuffle[3] + 12);
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		_mm256_storeu_si256((__m256i*)(dst + index), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + index)), mask));
+	}
+	swizzle32Scalar(dst + index, src + index, count - index, shuffle);
+}
+
+WC_TARGET("avx2") static void expand565AVX2(uint32_t* dst, const uint16_t* src, uint32_t count) {
+	const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + index)));
+		const __m256i r = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xF800)), 8), _mm256_slli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xE000)), 3));
+		const __m256i g = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0x07E0)), 5), _mm256_srli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0x0600)), 1));
+		const __m256i b = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0x001F)), 3), _mm256_srli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0x001C)), 2));
+		_mm256_storeu_si256((__m256i*)(dst + index), _mm256_or_si256(_mm256_or_si256(alpha, r), _mm256_or_si256(g, b)));
+	}
+	for (; index < count; ++index) {
+		dst[index] = expand565Pixel(src[index]);
+	}
+}
+
+WC_TARGET("avx2") static void pack565AVX2(uint16_t* dst, const uint32_t* src, uint32_t count) {
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)(src + index));
+		const __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 8), _mm256_set1_epi32(0xF800));
+		const __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 5), _mm256_set1_epi32(0x07E0));
+		const __m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 3), _mm256_set1_epi32(0x001F));
+		const __m256i words = _mm256_or_si256(_mm256_or_si256(r, g), b);
+		// Unsigned pack per 128 bit lane, then join the two halves.
+		const __m256i packed = _mm256_packus_epi32(words, words);
+		_mm_storeu_si128((__m128i*)(dst + index), _mm256_castsi256_si128(_mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0))));
+	}
+	for (; index < count; ++index) {
+		dst[index] = pack565Pixel(src[index]);
+	}
+}
+
+WC_TARGET("avx2") static inline __m256i div255AVX2(__m256i value) {
+	value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+
+WC_TARGET("avx2") static inline __m256i alphaAVX2(__m256i pixels) {
+	return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+template <BlendMode MODE>
+WC_TARGET("avx2") static inline __m256i blendAVX2(__m256i src, __m256i dst) {
+	const __m256i one = _mm256_set1_epi16(255);
+	switch (MODE) {
+	case BlendSrcOver :
+		return _mm256_add_epi16(src, div255AVX2(_mm256_mullo_epi16(dst, _mm256_sub_epi16(one, alphaAVX2(src)))));
+	case BlendAdd :
+		return _mm256_add_epi16(src, dst);
+	default :
+		return _mm256_add_epi16(_mm256_add_epi16(
+			div255AVX2(_mm256_mullo_epi16(src, dst)),
+			div255AVX2(_mm256_mullo_epi16(src, _mm256_sub_epi16(one, alphaAVX2(dst))))),
+			div255AVX2(_mm256_mullo_epi16(dst, _mm256_sub_epi16(one, alphaAVX2(src)))));
+	}
+}
+
+template <BlendMode MODE, bool ALPHA>
+WC_TARGET("avx2") static void compositeAVX2(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t alpha) {
+	const __m256i scale = _mm256_set1_epi16(alpha);
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const __m256i s = _mm256_loadu_si256((const __m256i*)(src + index));
+		const __m256i d = _mm256_loadu_si256((const __m256i*)(dst + index));
+		if (MODE == BlendAdd && !ALPHA) {
+			_mm256_storeu_si256((__m256i*)(dst + index), _mm256_adds_epu8(s, d));
+			continue;
+		}
+		__m256i sLow = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(s));
+		__m256i sHigh = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(s, 1));
+		if (ALPHA) {
+			sLow = div255AVX2(_mm256_mullo_epi16(sLow, scale));
+			sHigh = div255AVX2(_mm256_mullo_epi16(sHigh, scale));
+		}
+		const __m256i low = blendAVX2<MODE>(sLow, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(d)));
+		const __m256i high = blendAVX2<MODE>(sHigh, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(d, 1)));
+		// packus works per 128 bit lane, put the pixels back in order.
+		const __m256i packed = _mm256_packus_epi16(low, high);
+		_mm256_storeu_si256((__m256i*)(dst + index), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	for (; index < count; ++index) {
+		dst[index] = compositePixel<MODE, ALPHA>(dst[index], src[index], alpha);
+	}
+}
+
+WC_COMPOSITE_ENTRY(compositeAVX2Entry, compositeAVX2)
+
+WC_TARGET("avx2") static void scaleNearestAVX2(uint32_t* dst, const uint32_t* src, const uint32_t* columns, uint32_t count) {
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const __m256i offsets = _mm256_loadu_si256((const __m256i*)(columns + index));
+		_mm256_storeu_si256((__m256i*)(dst + index), _mm256_i32gather_epi32((const int*)src, offsets, 4));
+	}
+	for (; index < count; ++index) {
+		dst[index] = src[columns[index]];
+	}
+}
+
+// The 1 KiB palette stays in L1, two independent gathers per step hide
+// part of their latency.
+WC_TARGET("avx2") static void expandIndex8AVX2(uint32_t* dst, const uint8_t* src, uint32_t count, const uint32_t* palette) {
+	uint32_t index = 0;
+	for (; index + 16 <= count; index += 16) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i*)(src + index));
+		const __m256i low = _mm256_cvtepu8_epi32(bytes);
+		const __m256i high = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+		_mm256_storeu_si256((__m256i*)(dst + index), _mm256_i32gather_epi32((const int*)palette, low, 4));
+		_mm256_storeu_si256((__m256i*)(dst + index + 8), _mm256_i32gather_epi32((const int*)palette, high, 4));
+	}
+	expandIndex8Scalar(dst + index, src + index, count - index, palette);
+}
+
+// Masked stores write only the selected pixels, the tail needs no scalar
+// loop since the mask is cut at 'count'.
+WC_TARGET("avx2") static void maskFill32AVX2(uint32_t* dst, const uint8_t* mask, uint32_t offset, uint32_t count, uint32_t color) {
+	const __m256i value = _mm256_set1_epi32(color);
+	const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	for (uint32_t index = 0; index < count; index += 8) {
+		const uint32_t length = (count - index < 8) ? count - index : 8;
+		const uint32_t bits = readMaskBits(mask, offset + index, length);
+		if (bits == 0xFF) {
+			_mm256_storeu_si256((__m256i*)(dst + index), value);
+		} else if (bits != 0) {
+			const __m256i select = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lanes), lanes);
+			_mm256_maskstore_epi32((int*)(dst + index), select, value);
+		}
+	}
+}
+
+WC_TARGET("avx2") static inline __m256i lerpAVX2(__m256i a, __m256i b, __m256i weight, __m256i inverse) {
+	const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+	const __m256i rb = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(a, mask), inverse), _mm256_mullo_epi16(_mm256_and_si256(b, mask), weight)), 8);
+	const __m256i ag = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(a, 8), mask), inverse), _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(b, 8), mask), weight));
+	return _mm256_or_si256(rb, _mm256_andnot_si256(mask, ag));
+}
+
+WC_TARGET("avx2") static inline __m256i hashLaneAVX2(__m256i acc, __m256i word, __m256i key) {
+	const __m256i mixed = _mm256_xor_si256(word, key);
+	acc = _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32)), word));
+	return _mm256_or_si256(_mm256_slli_epi64(acc, HASH_ROTATION), _mm256_srli_epi64(acc, 64 - HASH_ROTATION));
+}
+
+WC_TARGET("avx2") static uint64_t hashRowsAVX2(const uint8_t* src, uint32_t pitch, uint32_t length, uint32_t rows) {
+	const __m256i key = _mm256_loadu_si256((const __m256i*)HASH_KEYS);
+	__m256i acc = _mm256_setr_epi64x(HASH_KEYS[1], HASH_KEYS[2], HASH_KEYS[3], HASH_KEYS[0]);
+	for (uint32_t row = 0; row < rows; ++row, src += pitch) {
+		uint32_t offset = 0;
+		for (; offset + HASH_BLOCK_SIZE <= length; offset += HASH_BLOCK_SIZE) {
+			acc = hashLaneAVX2(acc, _mm256_loadu_si256((const __m256i*)(src + offset)), key);
+		}
+		if (offset < length) {
+			uint8_t block[HASH_BLOCK_SIZE] = {};
+			memcpy(block, src + offset, length - offset);
+			acc = hashLaneAVX2(acc, _mm256_loadu_si256((const __m256i*)block), key);
+		}
+	}
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	return hashFinish(lanes, length, rows);
+}
+
+WC_TARGET("avx2") static void scaleBilinearAVX2(uint32_t* dst, const uint32_t* row0, const uint32_t* row1, const uint32_t* columns, const uint32_t* weights, uint32_t weight, uint32_t count) {
+	const __m256i one = _mm256_set1_epi16(256);
+	const __m256i down = _mm256_set1_epi16(weight);
+	const __m256i up = _mm256_sub_epi16(one, down);
+	const __m256i next = _mm256_set1_epi32(1);
+	uint32_t index = 0;
+	for (; index + 8 <= count; index += 8) {
+		const __m256i offsets = _mm256_loadu_si256((const __m256i*)(columns + index));
+		const __m256i p00 = _mm256_i32gather_epi32((const int*)row0, offsets, 4);
+		const __m256i p01 = _mm256_i32gather_epi32((const int*)row0, _mm256_add_epi32(offsets, next), 4);
+		const __m256i p10 = _mm256_i32gather_epi32((const int*)row1, offsets, 4);
+		const __m256i p11 = _mm256_i32gather_epi32((const int*)row1, _mm256_add_epi32(offsets, next), 4);
+		__m256i across = _mm256_loadu_si256((const __m256i*)(weights + index));
+		across = _mm256_or_si256(across, _mm256_slli_epi32(across, 16));
+		const __m256i left = _mm256_sub_epi16(one, across);
+		const __m256i top = lerpAVX2(p00, p01, across, left);
+		const __m256i bottom = lerpAVX2(p10, p11, across, left);
+		_mm256_storeu_si256((__m256i*)(dst + index), lerpAVX2(top, bottom, down, up));
+	}
+	for (; index < count; ++index) {
+		dst[index] = bilinearPixel(row0, row1, columns[index], weights[index], weight);
+	}
+}
+
+/******************************************************************************/
+/** AVX-512                                                                   */
+/******************************************************************************/
+WC_TARGET("avx512f") static void fill32AVX512(uint32_t* dst, uint32_t count, uint32_t color) {
+	const __m512i value = _mm512_set1_epi32(color);
+	uint32_t index = 0;
+	for (; index < count && ((uintptr_t)(dst + index) & 63) != 0; ++index) {
+		dst[index] = color;
+	}
+	for (; index + 64 <= count; index += 64) {
+		_mm512_store_si512((void*)(dst + index), value);
+		_mm512_store_si512((void*)(dst + index + 16), value);
+		_mm512_store_si512((void*)(dst + index + 32), value);
+		_mm512_store_si512((void*)(dst + index + 48), value);
+	}
+	for (; index + 16 <= count; index += 16) {
+		_mm512_store_si512((void*)(dst + index), value);
+	}
+	if (index < count) {
+		// Masked store for the tail instead of a scalar loop.
+		const __mmask16 mask = (__mmask16)((1u << (count - index)) - 1);
+		_mm512_mask_storeu_epi32(dst + index, mask, value);
+	}
+}
+
+WC_TARGET("avx512f") static void fill32StreamAVX512(uint32_t* dst, uint32_t count, uint32_t color) {
+	const __m512i value = _mm512_set1_epi32(color);
+	uint32_t index = 0;
+	for (; index < count && ((uintptr_t)(dst + index) & 63) != 0; ++index) {
+		dst[index] = color;
+	}
+	for (; index + 64 <= count; index += 64) {
+		_mm512_stream_si512((__m512i*)(dst + index), value);
+		_mm512_stream_si512((__m512i*)(dst + index + 16), value);
+		_mm512_stream_si512((__m512i*)(dst + index + 32), value);
+		_mm512_stream_si512((__m512i*)(dst + index + 48), value);
+	}
+	_mm_sfence();
+	for (; index < count; ++index) {
+		dst[index] = color;
+	}
+}
+
+WC_TARGET("avx512f") static void maskFill32AVX512(uint32_t* dst, const uint8_t* mask, uint32_t offset, uint32_t count, uint32_t color) {
+	const __m512i value = _mm512_set1_epi32(color);
+	for (uint32_t index = 0; index < count; index += 16) {
+		const uint32_t length = (count - index < 16) ? count - index : 16;
+		_mm512_mask_storeu_epi32(dst + index, (__mmask16)readMaskBits(mask, offset + index, length), value);
+	}
+}
+
+// The masked forms start from zero, the unmasked ones from an undefined
+// register GCC warns about.
+WC_TARGET("avx512f") static void expandIndex8AVX512(uint32_t* dst, const uint8_t* src, uint32_t count, const uint32_t* palette) {
+	const __m512i zero = _mm512_setzero_si512();
+	uint32_t index = 0;
+	for (; index + 32 <= count; index += 32) {
+		const __m512i low = _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128((const __m128i*)(src + index)));
+		const __m512i high = _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128((const __m128i*)(src + index + 16)));
+		_mm512_storeu_si512(dst + index, _mm512_mask_i32gather_epi32(zero, 0xFFFF, low, palette, 4));
+		_mm512_storeu_si512(dst + index + 16, _mm512_mask_i32gather_epi32(zero, 0xFFFF, high, palette, 4));
+	}
+	expandIndex8Scalar(dst + index, src + index, count - index, palette);
+}
+#endif // WC_KERNELS_X86
+
+/******************************************************************************/
+/** Dispatch                                                                  */
+/******************************************************************************/
+#if defined(WC_KERNELS_X86)
+static Kernels::Level getLevelLimit() {
+	const char* name = getenv("WCANVAS_SIMD");
+	if (name == nullptr) {
+		return Kernels::AVX512;
+	}
+	if (strcmp(name, "scalar") == 0) {
+		return Kernels::Scalar;
+	}
+	if (strcmp(name, "sse2") == 0) {
+		return Kernels::SSE2;
+	}
+	if (strcmp(name, "sse4.1") == 0) {
+		return Kernels::SSE41;
+	}
+	if (strcmp(name, "avx2") == 0) {
+		return Kernels::AVX2;
+	}
+	return Kernels::AVX512;
+}
+#endif
+
+#define WC_SET_COMPOSITE(kernels, entry) \
+	kernels.composite32[BlendSrcOver] = entry<BlendSrcOver>; \
+	kernels.composite32[BlendAdd] = entry<BlendAdd>; \
+	kernels.composite32[BlendMultiply] = entry<BlendMultiply>;
+
+static Kernels createReferenceKernels() {
+	Kernels kernels;
+	kernels.fill32 = fill32Scalar;
+	kernels.fill32Stream = fill32Scalar;
+	WC_SET_COMPOSITE(kernels, compositeScalarEntry)
+	kernels.swizzle32 = swizzle32Scalar;
+	kernels.expand888 = expand888Scalar;
+	kernels.pack888 = pack888Scalar;
+	kernels.expand565 = expand565Scalar;
+	kernels.pack565 = pack565Scalar;
+	kernels.scaleNearest32 = scaleNearestScalar;
+	kernels.scaleBilinear32 = scaleBilinearScalar;
+	kernels.hashRows = hashRowsScalar;
+	kernels.maskFill32 = maskFill32Scalar;
+	kernels.expandIndex8 = expandIndex8Scalar;
+	kernels.level = Kernels::Scalar;
+	kernels.name = "scalar";
+	return kernels;
+}
+
+static Kernels createKernels() {
+	Kernels kernels = createReferenceKernels();
+
+#if defined(WC_KERNELS_X86)
+	const Kernels::Level limit = getLevelLimit();
+	__builtin_cpu_init();
+	if (limit >= Kernels::SSE2 && __builtin_cpu_supports("sse2")) {
+		kernels.fill32 = fill32SSE2;
+		kernels.fill32Stream = fill32StreamSSE2;
+		kernels.expand565 = expand565SSE2;
+		kernels.pack565 = pack565SSE2;
+		kernels.scaleBilinear32 = scaleBilinearSSE2;
+		kernels.hashRows = hashRowsSSE2;
+		kernels.maskFill32 = maskFill32SSE2;
+		kernels.level = Kernels::SSE2;
+		kernels.name = "sse2";
+	}
+	if (limit >= Kernels::SSE41 && __builtin_cpu_supports("sse4.1")) {
+		WC_SET_COMPOSITE(kernels, compositeSSE41Entry)
+		kernels.swizzle32 = swizzle32SSE41;
+		kernels.expand888 = expand888SSE41;
+		kernels.pack888 = pack888SSE41;
+		kernels.level = Kernels::SSE41;
+		kernels.name = "sse4.1";
+	}
+	if (limit >= Kernels::AVX2 && __builtin_cpu_supports("avx2")) {
+		kernels.fill32 = fill32AVX2;
+		kernels.fill32Stream = fill32StreamAVX2;
+		WC_SET_COMPOSITE(kernels, compositeAVX2Entry)
+		kernels.swizzle32 = swizzle32AVX2;
+		kernels.expand565 = expand565AVX2;
+		kernels.pack565 = pack565AVX2;
+		kernels.scaleNearest32 = scaleNearestAVX2;
+		kernels.scaleBilinear32 = scaleBilinearAVX2;
+		kernels.hashRows = hashRowsAVX2;
+		kernels.maskFill32 = maskFill32AVX2;
+		kernels.expandIndex8 = expandIndex8AVX2;
+		kernels.level = Kernels::AVX2;
+		kernels.name = "avx2";
+	}
+	if (limit >= Kernels::AVX512 && __builtin_cpu_supports("avx512f")) {
+		kernels.fill32 = fill32AVX512;
+		kernels.fill32Stream = fill32StreamAVX512;
+		kernels.maskFill32 = maskFill32AVX512;
+		kernels.expandIndex8 = expandIndex8AVX512;
+		kernels.level = Kernels::AVX512;
+		kernels.name = "avx512";
+	}
+#endif
+	return kernels;
+}
+
+const Kernels& getKernels() {
+	static const Kernels kernels = createKernels();
+	return kernels;
+}
+
+const Kernels& getReferenceKernels() {
+	static const Kernels kernels = createReferenceKernels();
+	return kernels;
+}
@@ -0,0 +1,74 @@
+#ifndef __WC_KERNELS_H__
+#define __WC_KERNELS_H__
+
+#include <stdint.h>
+#include "Composite.h"
+
+// Pixel kernels shared by the canvas and the drawing modules. The table is
+// filled once with the widest instruction set the CPU supports. The
+// WCANVAS_SIMD environment variable ("scalar", "sse2", "sse4.1", "avx2",
+// "avx512") caps the selection.
+struct Kernels {
+	enum Level {
+		Scalar,
+		SSE2,
+		SSE41,
+		AVX2,
+		AVX512,
+	};
+
+	// Fill 'count' 32 bit pixels with 'color'.
+	void (*fill32)(uint32_t* dst, uint32_t count, uint32_t color);
+
+	// Same as fill32 with non-temporal stores, for spans larger than the caches.
+	void (*fill32Stream)(uint32_t* dst, uint32_t count, uint32_t color);
+
+	// Composite premultiplied 'src' onto 'dst', the source scaled by 'alpha'
+	// (255 leaves it unchanged). Indexed by BlendMode.
+	void (*composite32[BlendModeCount])(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t alpha);
+
+	// Reorder the bytes of every pixel, byte 'i' of a destination pixel is
+	// byte 'shuffle[i]' of the source pixel.
+	void (*swizzle32)(uint32_t* dst, const uint32_t* src, uint32_t count, const uint8_t shuffle[4]);
+
+	// Packed B, G, R to and from XRGB8888. Expanded pixels get alpha 0xFF.
+	void (*expand888)(uint32_t* dst, const uint8_t* src, uint32_t count);
+	void (*pack888)(uint8_t* dst, const uint32_t* src, uint32_t count);
+
+	// RGB565 to and from XRGB8888. Expanded pixels get alpha 0xFF.
+	void (*expand565)(uint32_t* dst, const uint16_t* src, uint32_t count);
+	void (*pack565)(uint16_t* dst, const uint32_t* src, uint32_t count);
+
+	// dst[i] = src[columns[i]], one row of a nearest neighbour scale.
+	void (*scaleNearest32)(uint32_t* dst, const uint32_t* src, const uint32_t* columns, uint32_t count);
+
+	// One row of a bilinear scale. Pixel 'i' blends the pixels at columns[i]
+	// and the next column of 'row0' and 'row1'. 'weights[i]' is the weight of
+	// the next column and 'weight' the one of 'row1', both in 1/256 up to 256.
+	void (*scaleBilinear32)(uint32_t* dst, const uint32_t* row0, const uint32_t* row1, const uint32_t* columns, const uint32_t* weights, uint32_t weight, uint32_t count);
+
+	// 64 bit hash of 'length' bytes of 'rows' rows 'pitch' bytes apart, used
+	// to spot changed regions. Not cryptographic, the same on every level.
+	uint64_t (*hashRows)(const uint8_t* src, uint32_t pitch, uint32_t length, uint32_t rows);
+
+	// Set dst[i] to 'color' where bit 'offset' + i of 'mask' is set, bits
+	// LSB first. The other pixels are not written. Only the bytes holding
+	// the bits are read.
+	void (*maskFill32)(uint32_t* dst, const uint8_t* mask, uint32_t offset, uint32_t count, uint32_t color);
+
+	// dst[i] = palette[src[i]], 8 bit indices looked up in a 256 entry table.
+	void (*expandIndex8)(uint32_t* dst, const uint8_t* src, uint32_t count, const uint32_t* palette);
+
+	Level level;
+	const char* name;
+};
+
+// Spans at least this big use the non-temporal kernels.
+static const uint32_t KERNEL_STREAM_THRESHOLD = 4 * 1024 * 1024;
+
+const Kernels& getKernels();
+
+// The scalar table, reference for the vector kernels.
+const Kernels& getReferenceKernels();
+
+#endif // __WC_KERNELS_H__
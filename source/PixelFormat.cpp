@@ -0,0 +1,143 @@
+#include "PixelFormat.h"
+#include "Kernels.h"
+
+#include <string.h>
+
+// Memory position of the blue, green, red and padding bytes of the 32 bit
+// formats, indexed by PixelFormat.
+static const uint8_t CHANNEL_OFFSETS[3][4] = {
+	{ 0, 1, 2, 3 }, // XRGB8888
+	{ 2, 1, 0, 3 }, // XBGR8888
+	{ 3, 2, 1, 0 }, // BGRX8888
+};
+
+// Pixels converted per step through the intermediate XRGB8888 row.
+static const uint32_t CHUNK_SIZE = 256;
+
+static bool is32Bit(PixelFormat format) {
+	return format <= PixelFormatBGRX8888;
+}
+
+uint32_t getBytesPerPixel(PixelFormat format) {
+	switch (format) {
+	case PixelFormatRGB888 :
+		return 3;
+	case PixelFormatRGB565 :
+		return 2;
+	case PixelFormatIndex8 :
+		return 1;
+	default :
+		return 4;
+	}
+}
+
+// Byte shuffle moving every channel of 'src' to its place in 'dst'.
+static void getShuffle(PixelFormat dst, PixelFormat src, uint8_t shuffle[4]) {
+	for (uint32_t channel = 0; channel < 4; ++channel) {
+		shuffle[CHANNEL_OFFSETS[dst][channel]] = CHANNEL_OFFSETS[src][channel];
+	}
+}
+
+// Convert to XRGB8888. Returns 'src' itself when it is already XRGB8888.
+static const uint32_t* toXRGB(uint32_t* scratch, const uint8_t* src, PixelFormat format, uint32_t count, const Kernels& kernels) {
+	uint8_t shuffle[4];
+	switch (format) {
+	case PixelFormatXRGB8888 :
+		return (const uint32_t*)src;
+	case PixelFormatRGB888 :
+		kernels.expand888(scratch, src, count);
+		return scratch;
+	case PixelFormatRGB565 :
+		kernels.expand565(scratch, (const uint16_t*)src, count);
+		return scratch;
+	default :
+		getShuffle(PixelFormatXRGB8888, format, shuffle);
+		kernels.swizzle32(scratch, (const uint32_t*)src, count, shuffle);
+		return scratch;
+	}
+}
+
+static void fromXRGB(uint8_t* dst, PixelFormat format, const uint32_t* src, uint32_t count, const Kernels& kernels) {
+	uint8_t shuffle[4];
+	switch (format) {
+	case PixelFormatXRGB8888 :
+		memcpy(dst, src, count * 4);
+		break;
+	case PixelFormatRGB888 :
+		kernels.pack888(dst, src, count);
+		break;
+	case PixelFormatRGB565 :
+		kernels.pack565((uint16_t*)dst, src, count);
+		break;
+	default :
+		getShuffle(format, PixelFormatXRGB8888, shuffle);
+		kernels.swizzle32((uint32_t*)dst, src, count, shuffle);
+		break;
+	}
+}
+
+void convertPixels(uint8_t* dst, uint32_t dstPitch, PixelFormat dstFormat, const uint8_t* src, uint32_t srcPitch, PixelFormat srcFormat, uint32_t width, uint32_t height) {
+	const Kernels& kernels = getKernels();
+	const uint32_t dstBytes = getBytesPerPixel(dstFormat);
+	const uint32_t srcBytes = getBytesPerPixel(srcFormat);
+
+	if (dstFormat == srcFormat) {
+		for (uint32_t row = 0; row < height; ++row, dst += dstPitch, src += srcPitch) {
+			memcpy(dst, src, width * dstBytes);
+		}
+		return;
+	}
+
+	// Any pair of 32 bit formats is a single byte shuffle.
+	if (is32Bit(dstFormat) && is32Bit(srcFormat)) {
+		uint8_t shuffle[4];
+		getShuffle(dstFormat, srcFormat, shuffle);
+		for (uint32_t row = 0; row < height; ++row, dst += dstPitch, src += srcPitch) {
+			kernels.swizzle32((uint32_t*)dst, (const uint32_t*)src, width, shuffle);
+		}
+		return;
+	}
+
+	uint32_t scratch[CHUNK_SIZE];
+	for (uint32_t row = 0; row < height; ++row, dst += dstPitch, src += srcPitch) {
+		for (uint32_t column = 0; column < width; column += CHUNK_SIZE) {
+			const uint32_t count = (width - column < CHUNK_SIZE) ? width - column : CHUNK_SIZE;
+			const uint32_t* xrgb = toXRGB(scratch, src + column * srcBytes, srcFormat, count, kernels);
+			fromXRGB(dst + column * dstBytes, dstFormat, xrgb, count, kernels);
+		}
+	}
+}
+
+void expandIndexed(uint8_t* dst, uint32_t dstPitch, PixelFormat dstFormat, const uint8_t* src, uint32_t srcPitch, const uint32_t* palette, uint32_t width, uint32_t height) {
+	const Kernels& kernels = getKernels();
+
+	// 32 bit targets look up a palette already in their own layout, which
+	// writes straight into 'dst' without an intermediate row.
+	if (is32Bit(dstFormat)) {
+		uint32_t converted[256];
+		if (dstFormat != PixelFormatXRGB8888) {
+			uint8_t shuffle[4];
+			getShuffle(dstFormat, PixelFormatXRGB8888, shuffle);
+			kernels.swizzle32(converted, palette, 256, shuffle);
+			palette = converted;
+		}
+		for (uint32_t row = 0; row < height; ++row, dst += dstPitch, src += srcPitch) {
+			kernels.expandIndex8((uint32_t*)dst, src, width, palette);
+		}
+		return;
+	}
+
+	const uint32_t dstBytes = getBytesPerPixel(dstFormat);
+	uint32_t scratch[CHUNK_SIZE];
+	for (uint32_t row = 0; row < height; ++row, dst += dstPitch, src += srcPitch) {
+		for (uint32_t column = 0; column < width; column += CHUNK_SIZE) {
+			const uint32_t count = (width - column < CHUNK_SIZE) ? width - column : CHUNK_SIZE;
+			kernels.expandIndex8(scratch, src + column, count, palette);
+			if (dstFormat == PixelFormatRGB565) {
+				kernels.pack565((uint16_t*)(dst + column * dstBytes), scratch, count);
+			} else {
+				kernels.pack888(dst + column * dstBytes, scratch, count);
+			}
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef __WC_PIXEL_FORMAT_H__
+#define __WC_PIXEL_FORMAT_H__
+
+#include <stdint.h>
+
+// Pixel layouts, named after the channel order of a native word on a little
+// endian CPU. The byte order in memory is listed for each one.
+enum PixelFormat {
+	// Memory B, G, R, X. Native layout of 32 bit canvases.
+	PixelFormatXRGB8888,
+	// Memory R, G, B, X.
+	PixelFormatXBGR8888,
+	// Memory X, R, G, B. A XRGB visual on a big endian server.
+	PixelFormatBGRX8888,
+	// Memory B, G, R, packed. Native layout of 24 bit canvases.
+	PixelFormatRGB888,
+	// 16 bit word rrrrrggggggbbbbb. Native layout of 16 bit canvases.
+	PixelFormatRGB565,
+	// 8 bit palette index. Native layout of 8 bit canvases.
+	PixelFormatIndex8,
+	PixelFormatCount,
+};
+
+uint32_t getBytesPerPixel(PixelFormat format);
+
+// Convert a 'width' x 'height' block of pixels. Pitches are in bytes. The
+// source and destination must not overlap. PixelFormatIndex8 is only
+// accepted when both formats are PixelFormatIndex8, see expandIndexed().
+void convertPixels(uint8_t* dst, uint32_t dstPitch, PixelFormat dstFormat, const uint8_t* src, uint32_t srcPitch, PixelFormat srcFormat, uint32_t width, uint32_t height);
+
+// Look up a 'width' x 'height' block of PixelFormatIndex8 pixels in a 256
+// entry XRGB8888 'palette'. 'dstFormat' can't be PixelFormatIndex8.
+void expandIndexed(uint8_t* dst, uint32_t dstPitch, PixelFormat dstFormat, const uint8_t* src, uint32_t srcPitch, const uint32_t* palette, uint32_t width, uint32_t height);
+
+#endif // __WC_PIXEL_FORMAT_H__
@@ -0,0 +1,107 @@
+#include "Scale.h"
+#include "Kernels.h"
+
+#include <string.h>
+
+// Destination columns per pass. The source pixels they read are converted in
+// chunks of the same size, so everything stays on the stack.
+static const uint32_t SPAN_SIZE = 256;
+
+// 16.16 fixed point source coordinate of the centre of destination pixel
+// 'index'.
+static uint32_t getSamplePosition(uint32_t index, uint32_t srcSize, uint32_t dstSize) {
+	return (uint32_t)((((uint64_t)index * 2 + 1) * srcSize << 16) / ((uint64_t)dstSize * 2));
+}
+
+static uint32_t getNearest(uint32_t index, uint32_t srcSize, uint32_t dstSize) {
+	const uint32_t nearest = getSamplePosition(index, srcSize, dstSize) >> 16;
+	return (nearest < srcSize) ? nearest : srcSize - 1;
+}
+
+// First of the two source pixels blended for destination pixel 'index' and
+// the weight of the second one, in 1/256. Needs 'srcSize' >= 2.
+static uint32_t getBilinear(uint32_t index, uint32_t srcSize, uint32_t dstSize, uint32_t& weight) {
+	uint32_t position = getSamplePosition(index, srcSize, dstSize);
+	position = (position > 0x8000) ? position - 0x8000 : 0;
+	const uint32_t first = position >> 16;
+	if (first >= srcSize - 1) {
+		weight = 256;
+		return srcSize - 2;
+	}
+	weight = (position >> 8) & 0xFF;
+	return first;
+}
+
+// Pixels 'first' to 'first + count' of row 'row' as XRGB8888, converted into
+// 'scratch' unless they already are.
+static const uint32_t* loadRow(uint32_t* scratch, const uint8_t* src, uint32_t srcPitch, PixelFormat srcFormat, uint32_t row, uint32_t first, uint32_t count) {
+	const uint8_t* pixels = src + (size_t)row * srcPitch + first * getBytesPerPixel(srcFormat);
+	if (srcFormat == PixelFormatXRGB8888) {
+		return (const uint32_t*)pixels;
+	}
+	convertPixels((uint8_t*)scratch, count * 4, PixelFormatXRGB8888, pixels, srcPitch, srcFormat, count, 1);
+	return scratch;
+}
+
+void scalePixels(uint8_t* dst, uint32_t dstPitch, PixelFormat dstFormat, uint32_t dstWidth, uint32_t dstHeight,
+                 const uint8_t* src, uint32_t srcPitch, PixelFormat srcFormat, uint32_t srcWidth, uint32_t srcHeight,
+                 uint32_t x, uint32_t y, uint32_t width, uint32_t height, ScaleFilter filter) {
+	if (srcWidth < 2 || srcHeight < 2) {
+		filter = ScaleNearest;
+	}
+	const Kernels& kernels = getKernels();
+	const uint32_t dstBytes = getBytesPerPixel(dstFormat);
+	const uint32_t end = x + width;
+
+	uint32_t columns[SPAN_SIZE];
+	uint32_t weights[SPAN_SIZE];
+	uint32_t row0[SPAN_SIZE];
+	uint32_t row1[SPAN_SIZE];
+	uint32_t output[SPAN_SIZE];
+	for (uint32_t column = x; column < end;) {
+		// Take columns while the source pixels they read fit in a chunk.
+		uint32_t first = 0, count = 0, sourceCount = 0;
+		for (; column + count < end && count < SPAN_SIZE; ++count) {
+			uint32_t source;
+			if (filter == ScaleBilinear) {
+				source = getBilinear(column + count, srcWidth, dstWidth, weights[count]);
+			} else {
+				source = getNearest(column + count, srcWidth, dstWidth);
+			}
+			if (count == 0) {
+				first = source;
+			}
+			if (source - first + 2 > SPAN_SIZE) {
+				break;
+			}
+			columns[count] = source - first;
+			sourceCount = source - first + ((filter == ScaleBilinear) ? 2 : 1);
+		}
+
+		uint8_t* dstRow = dst + (size_t)y * dstPitch + column * dstBytes;
+		uint32_t lastSource = UINT32_MAX;
+		for (uint32_t row = y; row < y + height; ++row, dstRow += dstPitch) {
+			uint32_t* target = (dstFormat == PixelFormatXRGB8888) ? (uint32_t*)dstRow : output;
+			if (filter == ScaleBilinear) {
+				uint32_t weight;
+				const uint32_t source = getBilinear(row, srcHeight, dstHeight, weight);
+				const uint32_t* top = loadRow(row0, src, srcPitch, srcFormat, source, first, sourceCount);
+				const uint32_t* bottom = loadRow(row1, src, srcPitch, srcFormat, source + 1, first, sourceCount);
+				kernels.scaleBilinear32(target, top, bottom, columns, weights, weight, count);
+			} else {
+				const uint32_t source = getNearest(row, srcHeight, dstHeight);
+				if (source == lastSource) {
+					// Repeated rows are plain copies of the one above.
+					memcpy(dstRow, dstRow - dstPitch, count * dstBytes);
+					continue;
+				}
+				lastSource = source;
+				kernels.scaleNearest32(target, loadRow(row0, src, srcPitch, srcFormat, source, first, sourceCount), columns, count);
+			}
+			if (target == output) {
+				convertPixels(dstRow, dstPitch, dstFormat, (const uint8_t*)output, count * 4, PixelFormatXRGB8888, count, 1);
+			}
+		}
+		column += count;
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef __WC_SCALE_H__
+#define __WC_SCALE_H__
+
+#include <stdint.h>
+#include "PixelFormat.h"
+
+enum ScaleFilter {
+	// Repeat the closest source pixel, keeps pixel art sharp.
+	ScaleNearest,
+	// Blend the four closest source pixels.
+	ScaleBilinear,
+};
+
+// Scale the 'srcWidth' x 'srcHeight' image 'src' to 'dstWidth' x 'dstHeight'
+// and write the 'width' x 'height' block at 'x', 'y' of the result to 'dst',
+// converting between the formats on the way. 'dst' and 'src' point to the
+// first pixel of their images, pitches are in bytes. Pixel centres are
+// aligned, so integer factors repeat every pixel the same number of times.
+void scalePixels(uint8_t* dst, uint32_t dstPitch, PixelFormat dstFormat, uint32_t dstWidth, uint32_t dstHeight,
+                 const uint8_t* src, uint32_t srcPitch, PixelFormat srcFormat, uint32_t srcWidth, uint32_t srcHeight,
+                 uint32_t x, uint32_t y, uint32_t width, uint32_t height, ScaleFilter filter);
+
+#endif // __WC_SCALE_H__
@@ -0,0 +1,189 @@
+#include "Sprite.h"
+#include "Kernels.h"
+#include "WindowCanvas.h"
+
+#include <string.h>
+
+// Pixels mirrored per step through the stack before blending.
+static const uint32_t CHUNK_SIZE = 64;
+
+enum PixelClass {
+	PixelSkip,
+	PixelCopy,
+	PixelBlend,
+};
+
+static PixelClass classify(uint32_t pixel, Sprite::Mode mode, uint32_t key) {
+	switch (mode) {
+	case Sprite::ColorKey :
+		return ((pixel ^ key) & 0x00FFFFFF) == 0 ? PixelSkip : PixelCopy;
+	case Sprite::Alpha :
+		return (pixel >> 24) == 0 ? PixelSkip : (pixel >> 24) == 0xFF ? PixelCopy : PixelBlend;
+	default :
+		return PixelCopy;
+	}
+}
+
+Sprite::Sprite()
+	: width(0), height(0), pixels(nullptr), runs(nullptr), rowRuns(nullptr), runCount(0) {
+}
+
+Sprite::Sprite(const Image& image, Mode mode, uint32_t key)
+	: Sprite() {
+	create(image, mode, key);
+}
+
+Sprite::~Sprite() {
+	destroy();
+}
+
+int Sprite::create(const Image& image, Mode mode, uint32_t key) {
+	destroy();
+	if (image.pixels == nullptr || image.width == 0 || image.height == 0) {
+		return 1;
+	}
+
+	// Count first, so that everything is allocated once.
+	uint32_t pixelCount = 0;
+	for (uint32_t y = 0; y < image.height; ++y) {
+		const uint32_t* row = image.pixels + (size_t)y * image.pitch;
+		PixelClass previous = PixelSkip;
+		for (uint32_t x = 0; x < image.width; ++x) {
+			const PixelClass current = classify(row[x], mode, key);
+			if (current != PixelSkip) {
+				++pixelCount;
+				if (current != previous) {
+					++runCount;
+				}
+			}
+			previous = current;
+		}
+	}
+
+	pixels = new uint32_t[pixelCount > 0 ? pixelCount : 1];
+	runs = new Run[runCount > 0 ? runCount : 1];
+	rowRuns = new uint32_t[image.height + 1];
+	width = image.width;
+	height = image.height;
+
+	uint32_t run = 0, offset = 0;
+	for (uint32_t y = 0; y < image.height; ++y) {
+		const uint32_t* row = image.pixels + (size_t)y * image.pitch;
+		rowRuns[y] = run;
+		PixelClass previous = PixelSkip;
+		for (uint32_t x = 0; x < image.width; ++x) {
+			const PixelClass current = classify(row[x], mode, key);
+			if (current != PixelSkip) {
+				if (current != previous) {
+					runs[run].x = x;
+					runs[run].count = 0;
+					runs[run].offset = offset;
+					runs[run].blend = (current == PixelBlend);
+					++run;
+				}
+				++runs[run - 1].count;
+				pixels[offset++] = row[x];
+			}
+			previous = current;
+		}
+	}
+	rowRuns[image.height] = run;
+	return 0;
+}
+
+void Sprite::destroy() {
+	delete [] pixels;
+	delete [] runs;
+	delete [] rowRuns;
+	pixels = nullptr;
+	runs = nullptr;
+	rowRuns = nullptr;
+	width = 0;
+	height = 0;
+	runCount = 0;
+}
+
+uint32_t Sprite::getWidth() const {
+	return width;
+}
+
+uint32_t Sprite::getHeight() const {
+	return height;
+}
+
+uint32_t Sprite::getRunCount() const {
+	return runCount;
+}
+
+static void copyReversed(uint32_t* dst, const uint32_t* src, uint32_t count) {
+	for (uint32_t index = 0; index < count; ++index) {
+		dst[index] = *(src - index);
+	}
+}
+
+void drawSprite(WindowCanvas& canvas, const Sprite& sprite, int32_t x, int32_t y, uint32_t flags) {
+	const SpriteDraw draw = {&sprite, x, y, flags};
+	drawSprites(canvas, &draw, 1);
+}
+
+void drawSprites(WindowCanvas& canvas, const SpriteDraw* draws, uint32_t count) {
+	if (canvas.getDepth() != 32 || canvas.getPixelBuffer() == nullptr) {
+		return;
+	}
+	const Kernels& kernels = getKernels();
+	const int64_t canvasWidth = canvas.getWidth();
+	const int64_t canvasHeight = canvas.getHeight();
+	const uint32_t pitch = canvas.getStride() / 4;
+	uint32_t* buffer = (uint32_t*)canvas.getPixelBuffer();
+	uint32_t scratch[CHUNK_SIZE];
+
+	for (uint32_t index = 0; index < count; ++index) {
+		const SpriteDraw& draw = draws[index];
+		const Sprite& sprite = *draw.sprite;
+		const bool flip = (draw.flags & SpriteFlipX) != 0;
+		// Visible rows of the sprite.
+		const int64_t top = (draw.y < 0) ? -(int64_t)draw.y : 0;
+		const int64_t bottom = (draw.y + (int64_t)sprite.height > canvasHeight) ? canvasHeight - draw.y : sprite.height;
+		if (top >= bottom || draw.x >= canvasWidth || draw.x + (int64_t)sprite.width <= 0) {
+			continue;
+		}
+
+		for (int64_t row = top; row < bottom; ++row) {
+			uint32_t* dstRow = buffer + (draw.y + row) * pitch;
+			for (uint32_t run = sprite.rowRuns[row]; run < sprite.rowRuns[row + 1]; ++run) {
+				const Sprite::Run& r = sprite.runs[run];
+				// Canvas columns covered by the run, mirrored when flipped.
+				int64_t start = draw.x + (flip ? (int64_t)sprite.width - r.x - r.count : r.x);
+				int64_t end = start + r.count;
+				const int64_t skip = (start < 0) ? -start : 0;
+				start += skip;
+				end = (end > canvasWidth) ? canvasWidth : end;
+				if (start >= end) {
+					continue;
+				}
+				const uint32_t length = (uint32_t)(end - start);
+				uint32_t* dst = dstRow + start;
+				if (!flip) {
+					const uint32_t* src = sprite.pixels + r.offset + skip;
+					if (r.blend) {
+						kernels.composite32[BlendSrcOver](dst, src, length, 255);
+					} else {
+						memcpy(dst, src, length * sizeof(uint32_t));
+					}
+					continue;
+				}
+				// The leftmost canvas pixel shows the last pixel of the run.
+				const uint32_t* src = sprite.pixels + r.offset + r.count - 1 - skip;
+				if (!r.blend) {
+					copyReversed(dst, src, length);
+					continue;
+				}
+				for (uint32_t done = 0; done < length; done += CHUNK_SIZE) {
+					const uint32_t chunk = (length - done < CHUNK_SIZE) ? length - done : CHUNK_SIZE;
+					copyReversed(scratch, src - done, chunk);
+					kernels.composite32[BlendSrcOver](dst + done, scratch, chunk, 255);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef __WC_SPRITE_H__
+#define __WC_SPRITE_H__
+
+#include <stdint.h>
+
+class WindowCanvas;
+struct SpriteDraw;
+
+// Pixels owned by the caller, premultiplied 0xAARRGGBB. 'pitch' is the row
+// length in pixels, 0 means 'width'.
+struct Image {
+	const uint32_t* pixels;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+
+	Image(const uint32_t* pixels = nullptr, uint32_t width = 0, uint32_t height = 0, uint32_t pitch = 0)
+		: pixels(pixels), width(width), height(height), pitch(pitch != 0 ? pitch : width) {
+	}
+};
+
+// An image preprocessed into runs of visible pixels. Transparent pixels are
+// not stored, opaque runs are plain copies and only the translucent pixels
+// of an alpha sprite are blended.
+class Sprite {
+public:
+	enum Mode {
+		// Every pixel is copied.
+		Opaque,
+		// Pixels with the RGB of the key are skipped, the others copied.
+		ColorKey,
+		// Alpha 0 is skipped, 255 copied, anything else blended (SrcOver).
+		Alpha,
+	};
+
+private:
+	friend void drawSprites(WindowCanvas&, const SpriteDraw*, uint32_t);
+
+	struct Run {
+		// First column and length of the run, offset of its first pixel.
+		uint32_t x;
+		uint32_t count;
+		uint32_t offset;
+		bool blend;
+	};
+
+	uint32_t width;
+	uint32_t height;
+	// The visible pixels, row after row.
+	uint32_t* pixels;
+	Run* runs;
+	// Runs of row 'y' are rowRuns[y] to rowRuns[y + 1].
+	uint32_t* rowRuns;
+	uint32_t runCount;
+
+	Sprite(const Sprite&);
+	Sprite& operator=(const Sprite&);
+
+public:
+	Sprite();
+
+	// Same as create().
+	Sprite(const Image& image, Mode mode = Alpha, uint32_t key = 0);
+
+	~Sprite();
+
+	// Build the runs of 'image', which can be released afterwards. 'key' is
+	// the transparent color of ColorKey sprites. Returns 0 on success.
+	int create(const Image& image, Mode mode = Alpha, uint32_t key = 0);
+
+	void destroy();
+
+	uint32_t getWidth() const;
+
+	uint32_t getHeight() const;
+
+	uint32_t getRunCount() const;
+};
+
+enum SpriteFlags {
+	// Mirror the sprite around its vertical axis.
+	SpriteFlipX = 1,
+};
+
+struct SpriteDraw {
+	const Sprite* sprite;
+	int32_t x;
+	int32_t y;
+	// SpriteFlags.
+	uint32_t flags;
+};
+
+// Draw 'sprite' with its top left corner at 'x', 'y', clipped to the canvas.
+// Only 32 bit canvases are supported.
+void drawSprite(WindowCanvas& canvas, const Sprite& sprite, int32_t x, int32_t y, uint32_t flags = 0);
+
+// Draw 'count' sprites in order, sharing the setup between them. Meant for
+// large numbers of small sprites.
+void drawSprites(WindowCanvas& canvas, const SpriteDraw* draws, uint32_t count);
+
+#endif // __WC_SPRITE_H__
@@ -0,0 +1,179 @@
+#include "Thread.h"
+
+#if !defined (_WIN32)
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/******************************************************************************/
+/** Thread                                                                    */
+/******************************************************************************/
+#if defined (_WIN32)
+DWORD WINAPI Thread::entry(LPVOID param) {
+	Thread* thread = (Thread*)param;
+	thread->function(thread->user);
+	return 0;
+}
+#else
+void* Thread::entry(void* param) {
+	Thread* thread = (Thread*)param;
+	thread->function(thread->user);
+	return nullptr;
+}
+#endif
+
+Thread::Thread()
+	: handle(), running(false), function(nullptr), user(nullptr) {
+}
+
+Thread::~Thread() {
+	join();
+}
+
+int Thread::start(Function function, void* user) {
+	if (running) {
+		return 1;
+	}
+	this->function = function;
+	this->user = user;
+#if defined (_WIN32)
+	if ((handle = CreateThread(nullptr, 0, entry, this, 0, nullptr)) == nullptr) {
+		return 2;
+	}
+#else
+	if (pthread_create(&handle, nullptr, entry, this) != 0) {
+		return 2;
+	}
+#endif
+	running = true;
+	return 0;
+}
+
+void Thread::join() {
+	if (!running) {
+		return;
+	}
+#if defined (_WIN32)
+	WaitForSingleObject(handle, INFINITE);
+	CloseHandle(handle);
+#else
+	pthread_join(handle, nullptr);
+#endif
+	running = false;
+}
+
+bool Thread::isRunning() const {
+	return running;
+}
+
+uint32_t Thread::getProcessorCount() {
+#if defined (_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	const long count = info.dwNumberOfProcessors;
+#else
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (count > 0) ? (uint32_t)count : 1;
+}
+
+/******************************************************************************/
+/** Semaphore                                                                 */
+/******************************************************************************/
+Semaphore::Semaphore(uint32_t initial) {
+#if defined (_WIN32)
+	handle = CreateSemaphore(nullptr, initial, 0x7FFFFFFF, nullptr);
+#else
+	sem_init(&handle, 0, initial);
+#endif
+}
+
+Semaphore::~Semaphore() {
+#if defined (_WIN32)
+	CloseHandle(handle);
+#else
+	sem_destroy(&handle);
+#endif
+}
+
+void Semaphore::post(uint32_t count) {
+#if defined (_WIN32)
+	ReleaseSemaphore(handle, count, nullptr);
+#else
+	while (count-- > 0) {
+		sem_post(&handle);
+	}
+#endif
+}
+
+void Semaphore::wait() {
+#if defined (_WIN32)
+	WaitForSingleObject(handle, INFINITE);
+#else
+	while (sem_wait(&handle) != 0 && errno == EINTR) {
+	}
+#endif
+}
+
+bool Semaphore::wait(uint32_t timeoutMs) {
+#if defined (_WIN32)
+	return WaitForSingleObject(handle, timeoutMs) == WAIT_OBJECT_0;
+#else
+	timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeoutMs / 1000;
+	deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	int result;
+	while ((result = sem_timedwait(&handle, &deadline)) != 0 && errno == EINTR) {
+	}
+	return result == 0;
+#endif
+}
+
+bool Semaphore::tryWait() {
+#if defined (_WIN32)
+	return WaitForSingleObject(handle, 0) == WAIT_OBJECT_0;
+#else
+	return sem_trywait(&handle) == 0;
+#endif
+}
+
+/******************************************************************************/
+/** Time                                                                      */
+/******************************************************************************/
+uint64_t getMonotonicTime() {
+#if defined (_WIN32)
+	static LARGE_INTEGER frequency = {};
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ull
+		+ (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / frequency.QuadPart;
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+void sleepUntil(uint64_t time) {
+#if defined (_WIN32)
+	const uint64_t now = getMonotonicTime();
+	if (time > now) {
+		Sleep((DWORD)((time - now) / 1000000ull));
+	}
+#else
+	timespec deadline;
+	deadline.tv_sec = time / 1000000000ull;
+	deadline.tv_nsec = time % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+	}
+#endif
+}
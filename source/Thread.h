@@ -0,0 +1,129 @@
+#ifndef __WC_THREAD_H__
+#define __WC_THREAD_H__
+
+#include <stdint.h>
+#include <atomic>
+
+#if defined (_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+// Minimal native threading helpers used by the library internals.
+class Thread {
+public:
+	typedef void (*Function)(void* user);
+
+private:
+#if defined (_WIN32)
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	bool running;
+	Function function;
+	void* user;
+
+#if defined (_WIN32)
+	static DWORD WINAPI entry(LPVOID param);
+#else
+	static void* entry(void* param);
+#endif
+
+	Thread(const Thread&);
+	Thread& operator=(const Thread&);
+
+public:
+	Thread();
+
+	~Thread();
+
+	// Returns 0 if the thread was started.
+	int start(Function function, void* user);
+
+	void join();
+
+	bool isRunning() const;
+
+	// Number of logical processors, at least 1.
+	static uint32_t getProcessorCount();
+};
+
+// Counting semaphore, used only to park idle threads.
+class Semaphore {
+#if defined (_WIN32)
+	HANDLE handle;
+#else
+	sem_t handle;
+#endif
+
+	Semaphore(const Semaphore&);
+	Semaphore& operator=(const Semaphore&);
+
+public:
+	Semaphore(uint32_t initial = 0);
+
+	~Semaphore();
+
+	void post(uint32_t count = 1);
+
+	void wait();
+
+	// Returns false if nothing was posted within 'timeoutMs'.
+	bool wait(uint32_t timeoutMs);
+
+	// Returns false if the count is 0.
+	bool tryWait();
+};
+
+// Nanoseconds of CLOCK_MONOTONIC (QueryPerformanceCounter on Win32).
+uint64_t getMonotonicTime();
+
+// Sleep until getMonotonicTime() reaches 'time'. Can return late by the
+// scheduler granularity.
+void sleepUntil(uint64_t time);
+
+// Lock-free single producer / single consumer queue of 'N' - 1 elements.
+template <typename T, uint32_t N>
+class SpscQueue {
+	T items[N];
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+
+public:
+	SpscQueue() : head(0), tail(0) {
+	}
+
+	// Producer side. Returns false if the queue is full.
+	bool push(const T& item) {
+		const uint32_t current = tail.load(std::memory_order_relaxed);
+		const uint32_t next = (current + 1) % N;
+		if (next == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		items[current] = item;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false if the queue is empty.
+	bool pop(T& item) {
+		const uint32_t current = head.load(std::memory_order_relaxed);
+		if (current == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = items[current];
+		head.store((current + 1) % N, std::memory_order_release);
+		return true;
+	}
+
+	uint32_t size() const {
+		const uint32_t h = head.load(std::memory_order_acquire);
+		const uint32_t t = tail.load(std::memory_order_acquire);
+		return (t + N - h) % N;
+	}
+};
+
+#endif // __WC_THREAD_H__
@@ -0,0 +1,141 @@
+#include "TilePool.h"
+
+#include <stdlib.h>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// 'count' cache line aligned ranges, nullptr on failure.
+static void* allocateRanges(uint32_t count, size_t size) {
+#if defined(_WIN32)
+	return _aligned_malloc(count * size, 64);
+#else
+	void* memory = nullptr;
+	return (posix_memalign(&memory, 64, count * size) == 0) ? memory : nullptr;
+#endif
+}
+
+static void freeRanges(void* memory) {
+#if defined(_WIN32)
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+TilePool::TilePool(uint32_t threadCount)
+	: workers(nullptr), workerCount(0), ranges(nullptr), function(nullptr), user(nullptr), activeWorkers(0), busy(false), stopping(false) {
+	if (threadCount == 0) {
+		threadCount = Thread::getProcessorCount();
+	}
+	ranges = (Range*)allocateRanges(threadCount, sizeof(Range));
+	if (ranges == nullptr) {
+		// Run every task on the calling thread, in the embedded range.
+		threadCount = 1;
+		ranges = &singleRange;
+	}
+	for (uint32_t index = 0; index < threadCount; ++index) {
+		new (&ranges[index]) Range();
+		ranges[index].next = 0;
+		ranges[index].end = 0;
+	}
+	workerCount = threadCount - 1;
+	if (workerCount > 0) {
+		workers = new Worker[workerCount];
+		for (uint32_t index = 0; index < workerCount; ++index) {
+			workers[index].pool = this;
+			workers[index].index = index;
+			if (workers[index].thread.start(run, &workers[index]) != 0) {
+				// Run with the threads that did start.
+				workerCount = index;
+				break;
+			}
+		}
+	}
+}
+
+TilePool::~TilePool() {
+	wait();
+	stopping = true;
+	for (uint32_t index = 0; index < workerCount; ++index) {
+		workers[index].wake.post();
+		workers[index].thread.join();
+	}
+	delete [] workers;
+	// Range is trivially destructible, only the memory is released.
+	if (ranges != &singleRange) {
+		freeRanges(ranges);
+	}
+}
+
+void TilePool::runTasks(uint32_t thread) {
+	const uint32_t rangeCount = workerCount + 1;
+	for (uint32_t offset = 0; offset < rangeCount; ++offset) {
+		Range& range = ranges[(thread + offset) % rangeCount];
+		for (;;) {
+			const uint32_t index = range.next.fetch_add(1, std::memory_order_relaxed);
+			if (index >= range.end) {
+				break;
+			}
+			function(index, thread, user);
+		}
+	}
+}
+
+void TilePool::run(void* param) {
+	Worker& worker = *(Worker*)param;
+	TilePool& pool = *worker.pool;
+	for (;;) {
+		worker.wake.wait();
+		if (pool.stopping) {
+			break;
+		}
+		pool.runTasks(worker.index);
+		if (pool.activeWorkers.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			pool.done.post();
+		}
+	}
+}
+
+void TilePool::dispatch(uint32_t count, Function function, void* user) {
+	wait();
+	if (count == 0) {
+		return;
+	}
+	this->function = function;
+	this->user = user;
+
+	// Contiguous ranges keep neighbouring tasks on the same thread.
+	const uint32_t rangeCount = workerCount + 1;
+	for (uint32_t index = 0; index < rangeCount; ++index) {
+		ranges[index].next.store((uint32_t)((uint64_t)count * index / rangeCount), std::memory_order_relaxed);
+		ranges[index].end = (uint32_t)((uint64_t)count * (index + 1) / rangeCount);
+	}
+	busy = true;
+	activeWorkers.store(workerCount, std::memory_order_relaxed);
+	// The semaphores publish the ranges to the workers.
+	for (uint32_t index = 0; index < workerCount; ++index) {
+		workers[index].wake.post();
+	}
+}
+
+void TilePool::wait() {
+	if (!busy) {
+		return;
+	}
+	runTasks(workerCount);
+	if (workerCount > 0) {
+		done.wait();
+	}
+	busy = false;
+}
+
+bool TilePool::isBusy() const {
+	return busy;
+}
+
+uint32_t TilePool::getThreadCount() const {
+	return workerCount + 1;
+}
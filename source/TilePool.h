@@ -0,0 +1,69 @@
+#ifndef __WC_TILE_POOL_H__
+#define __WC_TILE_POOL_H__
+
+#include <stdint.h>
+#include <atomic>
+
+#include "Thread.h"
+
+// Work-stealing pool running 'count' independent tasks. The task indices are
+// split into one contiguous range per thread, each thread drains its own
+// range first and then steals from the others. The thread calling wait()
+// takes part as well.
+class TilePool {
+public:
+	typedef void (*Function)(uint32_t index, uint32_t thread, void* user);
+
+private:
+	// One per cache line so that claiming tasks never shares a line. The
+	// array is allocated 64 byte aligned, new only guarantees 16 bytes.
+	struct alignas(64) Range {
+		std::atomic<uint32_t> next;
+		uint32_t end;
+	};
+
+	struct Worker {
+		TilePool* pool;
+		uint32_t index;
+		Semaphore wake;
+		Thread thread;
+	};
+
+	Worker* workers;
+	uint32_t workerCount;
+	Range* ranges;
+	// Used when the range array can't be allocated.
+	Range singleRange;
+	Function function;
+	void* user;
+	std::atomic<uint32_t> activeWorkers;
+	Semaphore done;
+	bool busy;
+	bool stopping;
+
+	void runTasks(uint32_t thread);
+	static void run(void* user);
+
+	TilePool(const TilePool&);
+	TilePool& operator=(const TilePool&);
+
+public:
+	// 'threadCount' includes the calling thread. 0 uses every processor.
+	TilePool(uint32_t threadCount = 0);
+
+	~TilePool();
+
+	// Start running function(index, thread, user) for every index below
+	// 'count' and return. Waits for the previous batch first.
+	void dispatch(uint32_t count, Function function, void* user);
+
+	// Help with the current batch, then block until all its tasks are done.
+	void wait();
+
+	bool isBusy() const;
+
+	// Number of threads running tasks, the caller of wait() included.
+	uint32_t getThreadCount() const;
+};
+
+#endif // __WC_TILE_POOL_H__
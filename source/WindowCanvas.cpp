@@ -1,618 +1,3450 @@
-#include "WindowCanvas.h"
-
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <assert.h>
-#include <dlfcn.h>
-
-#if defined(_DEBUG)
-#define WC_INFO(...)     fprintf(stdout, __VA_ARGS__)
-#define WC_WARNING(...)  WC_INFO(__VA_ARGS__)
-#define WC_ERROR(...)    fprintf(stderr, __VA_ARGS__)
-#else
-#define WC_INFO(...)     /* EMPTY */
-#define WC_WARNING(...)  /* EMPTY */
-#define WC_ERROR(...)    /* EMPTY */
-#endif
-
-#if defined(__linux__)
-/*****************************************************************************/
-/** Linux - X11                                                              */
-/*****************************************************************************/
-#include <X11/keysym.h>
-#include <X11/Xatom.h>
-#include <X11/Xutil.h>
-
-#ifdef XDestroyImage
-#undef XDestroyImage
-#endif
-
-#define X11_LIB_NAME "libX11.so"
-
-#define X11_PROC_LIST \
-	X11_PROC(XOpenDisplay) \
-	X11_PROC(XCloseDisplay) \
-	X11_PROC(XCreateGC) \
-	X11_PROC(XFreeGC) \
-	X11_PROC(XCreateSimpleWindow) \
-	X11_PROC(XDestroyWindow) \
-	X11_PROC(XStoreName) \
-	X11_PROC(XSelectInput) \
-	X11_PROC(XGetWMNormalHints) \
-	X11_PROC(XSetWMNormalHints) \
-	X11_PROC(XMapRaised) \
-	X11_PROC(XPending) \
-	X11_PROC(XSendEvent) \
-	X11_PROC(XNextEvent) \
-	X11_PROC(XLookupString) \
-	X11_PROC(XCreateImage) \
-	X11_PROC(XPutImage) \
-	X11_PROC(XDestroyImage) \
-	X11_PROC(XInternAtom) \
-	X11_PROC(XSetWMProtocols) \
-	/* EMPTY_LINE */
-
-struct X11 {
-	// X11 function pointers
-	typedef Display* (*PFN_XOpenDisplay)(char*);
-	typedef void     (*PFN_XCloseDisplay)(Display*);
-	typedef Window   (*PFN_XCreateSimpleWindow)(Display*, Window, int, int, unsigned int, unsigned int, unsigned int, unsigned long, unsigned long);
-	typedef int      (*PFN_XDestroyWindow)(Display*, Window);
-	typedef int      (*PFN_XStoreName)(Display *display, Window w, char *window_name); 
-	typedef int      (*PFN_XSelectInput)(Display*, Window, long);
-	typedef int      (*PFN_XMapRaised)(Display*, Window);
-	typedef int      (*PFN_XPending)(Display*);
-	typedef Status   (*PFN_XSendEvent)(Display *display, Window w, Bool propagate, long event_mask, XEvent *event_send); 
-	typedef int      (*PFN_XNextEvent)(Display*, XEvent*); 
-	typedef int      (*PFN_XLookupString)(XKeyEvent*, char*, int, KeySym*, XComposeStatus*);
-	typedef Status   (*PFN_XGetWMNormalHints)(Display*, Window, XSizeHints*, long*);
-	typedef void     (*PFN_XSetWMNormalHints)(Display*, Window, XSizeHints*);
-	typedef GC       (*PFN_XCreateGC)(Display*, Drawable, unsigned long, XGCValues*);
-	typedef int      (*PFN_XFreeGC)(Display*, GC);
-	typedef XImage*  (*PFN_XCreateImage)(Display*, Visual*, unsigned int, int, int, char*, unsigned int, unsigned int, int, int);
-	typedef int      (*PFN_XPutImage)(Display*, Drawable, GC, XImage*, int, int, int, int, unsigned int, unsigned int); 
-	typedef int      (*PFN_XDestroyImage)(XImage*);
-	typedef Atom     (*PFN_XInternAtom)(Display *display, const char *atom_name, Bool only_if_exists); 
-	typedef Status   (*PFN_XSetWMProtocols)(Display *display, Window w, Atom *protocols, int count); 
-
-	void* handle;
-
-	// Declare X11 functions
-	#define X11_PROC(name) PFN_##name name;
-	X11_PROC_LIST
-	#undef X11_PROC
-
-	X11() 
-		: handle(nullptr) {
-		init();
-	}
-
-	~X11() {
-		uninit();
-	}
-
-	int init(const char* filename = X11_LIB_NAME) {
-		if (handle != nullptr) {
-			return 0;
-		}
-		int count = 0;
-
-		if ((handle = dlopen(filename, RTLD_LAZY)) == nullptr) {
-			WC_ERROR("Cannot open library '%s'.\n", filename);
-			return 1;
-		}
-		WC_INFO("Opened dynamic library '%s', at %p.\n", filename, handle);
-
-		#define X11_PROC(name) \
-		if ((name = (PFN_##name)dlsym(handle, #name)) == nullptr) {\
-			WC_ERROR("Failed to load " #name "\n"); \
-			uninit(); \
-			return 1;\
-		} else {\
-			WC_INFO("Loaded function '%s', at %p.\n", #name, name); \
-			++count; \
-		}
-		X11_PROC_LIST
-		#undef X11_PROC
-
-		WC_INFO("Successfully loaded %u functions.\n", count);
-		return 0;
-	}
-
-	void uninit() {
-		if (handle != nullptr) {
-			dlclose(handle);
-			handle = nullptr;
-		}
-	}
-};
-static const X11 x11;
-
-#undef X11_PROC_LIST
-
-#elif defined(_WIN32)
-/*****************************************************************************/
-/** Windows - GDI                                                            */
-/*****************************************************************************/
-#include <windows.h>
-
-#define GDI_LIB_NAME "gdi32.dll"
-#define GDI_PROC_LIST \
-	GDI_PROC(CreateCompatibleDC) \
-	GDI_PROC(CreateDIBSection) \
-	GDI_PROC(SelectObject) \
-	GDI_PROC(DeleteObject) \
-	GDI_PROC(ExtFloodFill) \
-	GDI_PROC(BitBlt) \
-	/* Empty line */
-	
-/*
-	// WIN32 API
-	WIN32_PROC(RegisterClass) \
-	WIN32_PROC(SetWindowLongPtr) \
-	WIN32_PROC(GetWindowLongPtr) \
-	WIN32_PROC(DefWindowProc) \
-	WIN32_PROC(GetKeyboardState) \
-	WIN32_PROC(ToAscii) \
-	WIN32_PROC(AdjustWindowRect) \
-	WIN32_PROC(CreateWindowEx) \
-	WIN32_PROC(GetDC) \
-	
-	typedef ATOM     (*PFN_RegisterClass)(const WNDCLASSA *lpWndClass);
-	typedef LONG_PTR (*PFN_SetWindowLongPtr)(HWND hWnd, int nIndex, LONG_PTR dwNewLong);
-	typedef LONG_PTR (*PFN_GetWindowLongPtr)(HWND hWnd, int nIndex);
-	typedef LRESULT  (*PFN_DefWindowProc)(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
-	typedef BOOL     (*PFN_GetKeyboardState)(PBYTE lpKeyState);
-	typedef int      (*PFN_ToAscii)(UINT uVirtKey, UINT uScanCode, const BYTE *lpKeyState, LPWORD lpChar, UINT uFlags);
-	typedef BOOL     (*PFN_AdjustWindowRect)(LPRECT lpRect, DWORD dwStyle, BOOL bMenu);
-	typedef HWND     (*PFN_CreateWindowEx)(DWORD dwExStyle, LPCSTR lpClassName, LPCSTR lpWindowName, DWORD dwStyle, int X, int Y, int nWidth, int nHeight, HWND hWndParent, HMENU hMenu, HINSTANCE hInstance, LPVOID lpParam);
-	typedef HDC      (*PFN_GetDC)(HWND hWnd);
-*/
-
-struct GDI {
-	typedef HDC      (__stdcall *PFN_CreateCompatibleDC)(HDC hdc);
-	typedef HBITMAP  (__stdcall *PFN_CreateDIBSection)(HDC hdc, const BITMAPINFO *pbmi, UINT usage, VOID **ppvBits, HANDLE hSection, DWORD offset);
-	typedef HGDIOBJ  (__stdcall *PFN_SelectObject)(HDC hdc, HGDIOBJ h);
-	typedef BOOL     (__stdcall *PFN_DeleteObject)(HGDIOBJ ho);
-	typedef BOOL     (__stdcall *PFN_ExtFloodFill)(HDC hdc, int x, int y, COLORREF color, UINT type);
-	typedef BOOL     (__stdcall *PFN_BitBlt)(HDC hdc, int x, int y, int cx, int cy, HDC hdcSrc, int x1, int y1, DWORD rop);
-
-	HMODULE handle;
-	
-	// Declare GDI functions
-	#define GDI_PROC(name) PFN_##name name;
-	GDI_PROC_LIST
-	#undef GDI_PROC
-
-	GDI() : handle(nullptr) {
-		init();
-	}
-
-	~GDI() {
-		uninit();
-	}
-
-	int init(const char* filename = GDI_LIB_NAME) {
-		if (handle != nullptr) {
-			return 0;
-		}
-		int count = 0;
-
-		if ((handle = LoadLibrary(filename)) == nullptr) {
-			WC_ERROR("Cannot open library '%s'.\n", filename);
-			return 1;
-		}
-		WC_INFO("Opened dynamic library '%s', at %p.\n", filename, handle);
-
-		#define GDI_PROC(name) \
-		if ((name = (PFN_##name)GetProcAddress(handle, #name)) == nullptr) {\
-			WC_ERROR("Failed to load " #name "\n"); \
-			uninit(); \
-			return 1;\
-		} else {\
-			WC_INFO("Loaded function '%s', at %p.\n", #name, name); \
-			++count; \
-		}
-		GDI_PROC_LIST
-		#undef GDI_PROC
-
-		WC_INFO("Successfully loaded %u functions.\n", count);
-		return 0;
-	}
-	
-	void uninit() {
-		if (handle != nullptr) {
-			FreeLibrary(handle);
-			handle = nullptr;
-		}
-	}
-};
-
-static const GDI gdi;
-
-#undef GDI_PROC_LIST
-
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-	WindowCanvas* window = (WindowCanvas*)GetWindowLongPtr(hwnd, GWL_USERDATA);
-	if (window == nullptr) {
-		return DefWindowProc(hwnd, uMsg, wParam, lParam);
-	}
-
-	WindowEvent& event = *window->eventPtr;
-    static BYTE keyState[256];
-	char text[8];
-	switch (uMsg) {
-	case WM_CLOSE:
-		event.type = WindowEvent::WindowClose;
-		return 0;
-	case WM_MOUSEMOVE :
-		event.type = WindowEvent::CursorMove;
-		event.x = LOWORD(lParam);
-		event.y = HIWORD(lParam);
-		return 0;
-	case WM_LBUTTONDOWN :
-		event.type = WindowEvent::ButtonPressed;
-		event.button = 1;
-		return 0;
-	case WM_LBUTTONUP :
-		event.type = WindowEvent::ButtonReleased;
-		event.button = 1;
-		return 0;
-	case WM_MBUTTONDOWN :
-		event.type = WindowEvent::ButtonPressed;
-		event.button = 2;
-		return 0;
-	case WM_MBUTTONUP :
-		event.type = WindowEvent::ButtonReleased;
-		event.button = 2;
-		return 0;
-	case WM_RBUTTONDOWN :
-		event.type = WindowEvent::ButtonPressed;
-		event.button = 3;
-		return 0;
-	case WM_RBUTTONUP :
-		event.type = WindowEvent::ButtonReleased;
-		event.button = 3;
-		return 0;
-	case WM_MOUSEWHEEL :
-		event.type = (GET_WHEEL_DELTA_WPARAM(wParam) > 0 ? WindowEvent::WheelUp : WindowEvent::WheelDown);
-		return 0;
-	case WM_KEYDOWN :
-		event.type = WindowEvent::KeyPressed;
-		event.keyCode = wParam;
-		GetKeyboardState(keyState);
-		if (ToAscii(event.keyCode, MapVirtualKey(event.keyCode, MAPVK_VK_TO_VSC), keyState, (LPWORD)text, 0) == 1) {
-			switch (text[0]) {
-			case 0x1B : // escape
-			case 0x08 : // backspace
-			case 0x7F : // delete
-				event.ascii = '\0';
-				break;
-			default :
-				event.ascii = text[0];
-				break;
-			}
-		} else {
-			event.ascii = '\0';
-		}
-		return 0;
-	case WM_KEYUP :
-		event.type = WindowEvent::KeyReleased;
-		event.keyCode = wParam;
-		return 0;
-	}
-
-	return DefWindowProc(hwnd, uMsg, wParam, lParam);
-}
-#else
-/*****************************************************************************/
-/** Unknown platform                                                         */
-/*****************************************************************************/
-	#error "Unknown platform"
-#endif
-
-/******************************************************************************/
-/** Window specific code                                                      */
-/******************************************************************************/
-int WindowCanvas::initialize(uint32_t width, uint32_t height, uint8_t depth, const char* title) {
-#if defined(_WIN32)
-	const DWORD dwstyle = WS_CAPTION | WS_POPUPWINDOW | WS_MINIMIZEBOX | WS_VISIBLE;
-
-	WNDCLASS wc = {};
-	wc.lpfnWndProc   = WindowProc;
-	wc.hInstance     = GetModuleHandle(nullptr);
-	wc.lpszClassName = "Sample Window Class";
-	wc.hCursor       = LoadCursor(nullptr, IDC_ARROW);
-	if (RegisterClass(&wc) == 0) {
-		WC_ERROR("Failed to register class.\n");
-		return 1;
-	}
-
-	RECT r = {0, 0, (LONG)width, (LONG)height};
-	if (AdjustWindowRect(&r, dwstyle, false) == 0) {
-		WC_WARNING("Failed to adjust window bounds.\n");
-	}
-
-	hwnd = CreateWindow(wc.lpszClassName, 
-	                    title,
-	                    dwstyle, 
-	                    0, 0, r.right - r.left, r.bottom - r.top,
-	                    nullptr,
-	                    nullptr,
-	                    wc.hInstance,
-	                    (LPVOID)nullptr);
-	if (hwnd == nullptr) {
-		WC_ERROR("Failed to create window.\n");
-		return 2;
-	}
-
-	SetLastError(0);
-	if (SetWindowLongPtr(hwnd, GWL_USERDATA, (LONG_PTR)this) == 0) {
-		if (GetLastError() != 0) {
-			WC_ERROR("Failed to set window long pointer.\n");
-			return 3;
-		}
-	}
-
-	if ((hdc = GetDC(hwnd)) == 0) {
-		WC_ERROR("Failed to retrieve the device context.\n");
-		return 4;
-	}
-
-	if ((hDCMem = gdi.CreateCompatibleDC(hdc)) == nullptr) {
-		WC_ERROR("Failed to create compatible device context.\n");
-		return 5;
-	}
-
-	BITMAPINFO bitmapinfo = {};
-	bitmapinfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-	bitmapinfo.bmiHeader.biWidth = width;
-	bitmapinfo.bmiHeader.biHeight = -height;
-	bitmapinfo.bmiHeader.biPlanes = 1;
-	bitmapinfo.bmiHeader.biBitCount = depth;
-
-	pixelBufferLength = width * height * depth / 8;
-	if ((bitmap = gdi.CreateDIBSection(hDCMem, &bitmapinfo, DIB_RGB_COLORS, (VOID**)&pixelBuffer, nullptr, 0)) == nullptr) {
-		WC_ERROR("Failed to create bitmap.\n");
-		return 6;
-	}
-
-	oldBitmap = gdi.SelectObject(hDCMem, bitmap);
-	
-	ShowWindow(hwnd, SW_SHOW);
-	WC_INFO("Successfully created WIN32 window %ux%u.\n", width, height);
-#else // __linux__
-	static const uint32_t DEFAULT_MARGIN = 5;
-	if ((display = x11.XOpenDisplay(nullptr)) == nullptr) {
-		WC_ERROR("Failed to connect X server.\n");
-		return 1;
-	}
-	if ((window = x11.XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, width, height, DEFAULT_MARGIN, 0, 0)) == None) {
-		WC_ERROR("Failed to create simple window.\n");
-		return 2;
-	}
-	x11.XStoreName(display, window, (char*)title);
-	x11.XSelectInput(display, window, ExposureMask | ButtonPressMask | ButtonReleaseMask | KeyReleaseMask | KeyPressMask | PointerMotionMask);
-
-	XSizeHints sizeHints;
-	memset(&sizeHints, 0, sizeof(sizeHints));
-	if (x11.XGetWMNormalHints(display, window, &sizeHints, nullptr) == 0) {
-		WC_WARNING("Failed to get normal hints.\n");
-	}
-	sizeHints.min_width = width;
-	sizeHints.max_width = width;
-	sizeHints.min_height = height;
-	sizeHints.max_height = height;
-	x11.XSetWMNormalHints(display, window, &sizeHints);
-
-    wm_delete_window = x11.XInternAtom(display, "WM_DELETE_WINDOW", False);
-    x11.XSetWMProtocols(display, window, &wm_delete_window, 1);
-	x11.XMapRaised(display, window);
-
-	gc = x11.XCreateGC(display, window, 0, 0);
-
-	pixelBufferLength = width * height * depth / 8;
-    pixelBuffer = (uint8_t*)malloc(pixelBufferLength);
-	if ((xImage = x11.XCreateImage(display, DefaultVisual(display, 0), 24, ZPixmap, 0, (char*)pixelBuffer, width, height, depth, 0)) == nullptr) {
-		WC_ERROR("Failed to create xImage.\n");
-		return 3;
-	}
-	WC_INFO("Successfully created X11 window %ux%u.\n", width, height);
-#endif
-	return 0;
-}
-
-int WindowCanvas::uninitialize() {
-#if defined(_WIN32)
-	if (hDCMem) {
-		if (oldBitmap) {
-			gdi.SelectObject(hDCMem, oldBitmap);
-		}
-		if (bitmap) {
-			gdi.DeleteObject(bitmap);
-		}
-		if (pixelBuffer) {
-			delete [] pixelBuffer;
-		}
-		gdi.DeleteObject(hDCMem);
-	}
-	if (hwnd) {
-		ReleaseDC(hwnd, hdc);
-		DestroyWindow(hwnd);
-	}
-#else // __linux__
-	if (xImage != nullptr) {
-		x11.XDestroyImage(xImage);
-		xImage = nullptr;
-	}
-	if (display != nullptr) {
-		x11.XFreeGC(display, gc);
-		x11.XDestroyWindow(display, window);
-		x11.XCloseDisplay(display);
-		display = nullptr;
-	}
-#endif
-	return 0;
-}
-
-WindowCanvas::WindowCanvas(uint32_t width, uint32_t height, uint8_t depth, const char* title) 
-	: width(width), height(height), depth(depth), pixelBuffer(nullptr), pixelBufferLength(0)
-#if defined(__linux__)
-	, display(nullptr), window(0), gc(0), xImage(nullptr)
-#elif defined (_WIN32)
-	, hwnd(0), hdc(0), hDCMem(0), bitmap(0), oldBitmap(0), eventPtr(nullptr)
-#endif
-{
-	initialize(width, height, depth, title);
-}
-
-WindowCanvas::~WindowCanvas() {
-	uninitialize();
-}
-
-uint32_t WindowCanvas::getWidth() const {
-	return width;
-}
-
-uint32_t WindowCanvas::getHeight() const {
-	return height;
-}
-
-uint32_t WindowCanvas::getDepth() const {
-	return depth;
-}
-
-void WindowCanvas::setTitle(const char* title) {
-#if defined(_WIN32)
-	SetWindowText(hwnd, title);
-#else // __linux__
-	x11.XStoreName(display, window, (char*)title);
-#endif
-}
-
-const char* WindowCanvas::getTitle() const {
-#if defined(_WIN32)
-	static char title[128];
-	return (GetWindowText(hwnd, title, sizeof(title)) > 0) ? title : "";
-#else // __linux__
-	assert(!"Not implemented");
-#endif
-	return "";
-}
-
-uint8_t* WindowCanvas::getPixelBuffer() const {
-	return pixelBuffer;
-}
-
-uint32_t WindowCanvas::getPixelBufferLength() const {
-	return pixelBufferLength;
-}
-#include <stdio.h>
-bool WindowCanvas::getEvent(WindowEvent& event) {
-	bool ans = false;
-#if defined(_WIN32)
-    MSG msg;
-	if (PeekMessage(&msg, hwnd, 0, 0, 0)) {
-		GetMessage(&msg, hwnd, 0, 0);
-		eventPtr = &event;
-		eventPtr->type = WindowEvent::Unknown;
-		
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-		
-		ans = (eventPtr->type != WindowEvent::Unknown);
-    }
-#else // __linux__
-	XEvent xEvent;
-	KeySym key;
-	char text[32];
-	if (x11.XPending(display) > 0) {
-		x11.XNextEvent(display, &xEvent);
-		switch (xEvent.type) {
-		case ClientMessage:
-			if((Atom)xEvent.xclient.data.l[0] == wm_delete_window) {
-				event.type = WindowEvent::WindowClose;
-				ans = true;
-			}
-			break;
-		case KeyPress :
-			event.type = WindowEvent::KeyPressed;
-			event.keyCode = xEvent.xkey.keycode;
-			if (x11.XLookupString(&xEvent.xkey, text, sizeof(text), &key, 0) == 1) {
-				switch (text[0]) {
-				case 0x1B : // escape
-				case 0x08 : // backspace
-				case 0x7F : // delete
-					event.ascii = '\0';
-					break;
-				case 0xD :
-					event.ascii = '\n';
-					break;
-				default :
-					event.ascii = text[0];
-					break;
-				}
-			} else {
-				event.ascii = '\0';
-			}
-			ans = true;
-			break;
-		case KeyRelease :
-			event.type = WindowEvent::KeyReleased;
-			event.keyCode = xEvent.xkey.keycode;
-			ans = true;
-			break;
-		case MotionNotify :
-			event.type = WindowEvent::CursorMove;
-			event.x = xEvent.xmotion.x;
-			event.y = xEvent.xmotion.y;
-			ans = true;
-			break;
-		case ButtonPress:
-			switch (xEvent.xbutton.button) {
-			case Button4 :
-				event.type = WindowEvent::WheelUp;
-				break;
-			case Button5 :
-				event.type = WindowEvent::WheelDown;
-				break;
-			default :
-				event.type = WindowEvent::ButtonPressed;
-				event.button = xEvent.xbutton.button;
-				break;
-			}
-			ans = true;
-			break;
-		case ButtonRelease:
-			switch (xEvent.xbutton.button) {
-			case Button4 :
-			case Button5 :
-				break;
-			default :
-				event.type = WindowEvent::ButtonReleased;
-				event.button = xEvent.xbutton.button;
-				ans = true;
-				break;
-			}
-			break;
-		}
-	}
-#endif
-	return ans;
-}
-
-void WindowCanvas::clear() {
-#if defined(_WIN32)
-	// gdi.ExtFloodFill(hdc, 0, 0, RGB(0, 0, 0), FLOODFILLSURFACE);
-#endif
-	memset(pixelBuffer, 0, pixelBufferLength);
-}
-
-void WindowCanvas::blit() {
-#if defined(_WIN32)
-	gdi.BitBlt(hdc, 0, 0, width, height, hDCMem, 0, 0, SRCCOPY);
-#else // __linux__
-	x11.XPutImage(display, window, gc, xImage, 0, 0, 0, 0, width, height);
-#endif
-}
\ No newline at end of file
+#include "WindowCanvas.h"
+#include "Thread.h"
+#include "Kernels.h"
+#include "PixelFormat.h"
+#include "TilePool.h"
+#include "FrameRecorder.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <dlfcn.h>
+
+#if defined(_DEBUG)
+#define WC_INFO(...)     fprintf(stdout, __VA_ARGS__)
+#define WC_WARNING(...)  WC_INFO(__VA_ARGS__)
+#define WC_ERROR(...)    fprintf(stderr, __VA_ARGS__)
+#else
+#define WC_INFO(...)     /* EMPTY */
+#define WC_WARNING(...)  /* EMPTY */
+#define WC_ERROR(...)    /* EMPTY */
+#endif
+
+/*****************************************************************************/
+/** Pixel memory                                                             */
+/*****************************************************************************/
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Buffers at least this big are mapped instead of allocated and backed by
+// huge pages unless WCANVAS_NO_HUGEPAGES is set. A 4K frame takes 16 to 32 MiB.
+static const size_t HUGE_BUFFER_THRESHOLD = 16 * 1024 * 1024;
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static bool useHugePages(size_t length) {
+	return length >= HUGE_BUFFER_THRESHOLD && getenv("WCANVAS_NO_HUGEPAGES") == nullptr;
+}
+
+// 64 byte aligned pixel storage. Release it with freePixels() and the same
+// length.
+static uint8_t* allocatePixels(size_t length) {
+#if defined(_WIN32)
+	// Large pages need SeLockMemoryPrivilege, stay with regular ones.
+	return (uint8_t*)_aligned_malloc(length, 64);
+#else
+	if (length >= HUGE_BUFFER_THRESHOLD) {
+		const size_t mapLength = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		void* memory = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+		if (useHugePages(length)) {
+			memory = mmap(nullptr, mapLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		}
+#endif
+		if (memory == MAP_FAILED) {
+			// No reserved huge pages, ask for transparent ones instead.
+			if ((memory = mmap(nullptr, mapLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+				return nullptr;
+			}
+#if defined(MADV_HUGEPAGE)
+			if (useHugePages(length)) {
+				madvise(memory, mapLength, MADV_HUGEPAGE);
+			}
+#endif
+		}
+		return (uint8_t*)memory;
+	}
+	void* memory = nullptr;
+	return (posix_memalign(&memory, 64, length) == 0) ? (uint8_t*)memory : nullptr;
+#endif
+}
+
+static void freePixels(uint8_t* pixels, size_t length) {
+	if (pixels == nullptr) {
+		return;
+	}
+#if defined(_WIN32)
+	(void)length;
+	_aligned_free(pixels);
+#else
+	if (length >= HUGE_BUFFER_THRESHOLD) {
+		munmap(pixels, (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+	} else {
+		free(pixels);
+	}
+#endif
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+	while (b != 0) {
+		const uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Row length in bytes for 'width' pixels: whole pixels, a multiple of 64
+// bytes, plus 'padding' rounded up to the same unit. AUTO_ROW_PADDING pads
+// rows that are a multiple of 4 KiB, which would otherwise map every row of a
+// column to the same cache sets.
+static uint32_t computeStride(uint32_t width, uint32_t bytesPerPixel, uint32_t padding) {
+	const uint32_t unit = 64 / gcd(64, bytesPerPixel) * bytesPerPixel;
+	const uint32_t stride = (width * bytesPerPixel + unit - 1) / unit * unit;
+	if (padding == WindowCanvas::AUTO_ROW_PADDING) {
+		padding = (stride % 4096 == 0) ? unit : 0;
+	}
+	return stride + (padding + unit - 1) / unit * unit;
+}
+
+#if defined(__linux__)
+/*****************************************************************************/
+/** Linux - X11                                                              */
+/*****************************************************************************/
+#include <X11/keysym.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <xcb/xcb.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef XDestroyImage
+#undef XDestroyImage
+#endif
+
+#define X11_LIB_NAME "libX11.so"
+
+#define X11_PROC_LIST \
+	X11_PROC(XOpenDisplay) \
+	X11_PROC(XCloseDisplay) \
+	X11_PROC(XCreateGC) \
+	X11_PROC(XFreeGC) \
+	X11_PROC(XCreateSimpleWindow) \
+	X11_PROC(XDestroyWindow) \
+	X11_PROC(XStoreName) \
+	X11_PROC(XSelectInput) \
+	X11_PROC(XGetWMNormalHints) \
+	X11_PROC(XSetWMNormalHints) \
+	X11_PROC(XMapRaised) \
+	X11_PROC(XResizeWindow) \
+	X11_PROC(XPending) \
+	X11_PROC(XSendEvent) \
+	X11_PROC(XNextEvent) \
+	X11_PROC(XPeekEvent) \
+	X11_PROC(XEventsQueued) \
+	X11_PROC(XLookupString) \
+	X11_PROC(XCreateImage) \
+	X11_PROC(XPutImage) \
+	X11_PROC(XDestroyImage) \
+	X11_PROC(XInternAtom) \
+	X11_PROC(XSetWMProtocols) \
+	X11_PROC(XSync) \
+	X11_PROC(XFlush) \
+	X11_PROC(XSetErrorHandler) \
+	X11_PROC(XListPixmapFormats) \
+	X11_PROC(XFree) \
+	X11_PROC(XGContextFromGC) \
+	/* EMPTY_LINE */
+
+struct X11 {
+	// X11 function pointers
+	typedef Display* (*PFN_XOpenDisplay)(char*);
+	typedef void     (*PFN_XCloseDisplay)(Display*);
+	typedef Window   (*PFN_XCreateSimpleWindow)(Display*, Window, int, int, unsigned int, unsigned int, unsigned int, unsigned long, unsigned long);
+	typedef int      (*PFN_XDestroyWindow)(Display*, Window);
+	typedef int      (*PFN_XStoreName)(Display *display, Window w, char *window_name); 
+	typedef int      (*PFN_XSelectInput)(Display*, Window, long);
+	typedef int      (*PFN_XMapRaised)(Display*, Window);
+	typedef int      (*PFN_XResizeWindow)(Display*, Window, unsigned int, unsigned int);
+	typedef int      (*PFN_XPending)(Display*);
+	typedef Status   (*PFN_XSendEvent)(Display *display, Window w, Bool propagate, long event_mask, XEvent *event_send); 
+	typedef int      (*PFN_XNextEvent)(Display*, XEvent*); 
+	typedef int      (*PFN_XPeekEvent)(Display*, XEvent*);
+	typedef int      (*PFN_XEventsQueued)(Display*, int);
+	typedef int      (*PFN_XLookupString)(XKeyEvent*, char*, int, KeySym*, XComposeStatus*);
+	typedef Status   (*PFN_XGetWMNormalHints)(Display*, Window, XSizeHints*, long*);
+	typedef void     (*PFN_XSetWMNormalHints)(Display*, Window, XSizeHints*);
+	typedef GC       (*PFN_XCreateGC)(Display*, Drawable, unsigned long, XGCValues*);
+	typedef int      (*PFN_XFreeGC)(Display*, GC);
+	typedef XImage*  (*PFN_XCreateImage)(Display*, Visual*, unsigned int, int, int, char*, unsigned int, unsigned int, int, int);
+	typedef int      (*PFN_XPutImage)(Display*, Drawable, GC, XImage*, int, int, int, int, unsigned int, unsigned int); 
+	typedef int      (*PFN_XDestroyImage)(XImage*);
+	typedef Atom     (*PFN_XInternAtom)(Display *display, const char *atom_name, Bool only_if_exists); 
+	typedef Status   (*PFN_XSetWMProtocols)(Display *display, Window w, Atom *protocols, int count); 
+	typedef int      (*PFN_XSync)(Display*, Bool);
+	typedef int      (*PFN_XFlush)(Display*);
+	typedef XErrorHandler (*PFN_XSetErrorHandler)(XErrorHandler);
+	typedef XPixmapFormatValues* (*PFN_XListPixmapFormats)(Display*, int*);
+	typedef int      (*PFN_XFree)(void*);
+	typedef GContext (*PFN_XGContextFromGC)(GC);
+
+	void* handle;
+
+	// Declare X11 functions
+	#define X11_PROC(name) PFN_##name name;
+	X11_PROC_LIST
+	#undef X11_PROC
+
+	// libX11 is loaded by the first native canvas, headless ones never need it.
+	X11() 
+		: handle(nullptr) {
+	}
+
+	~X11() {
+		uninit();
+	}
+
+	int init(const char* filename = X11_LIB_NAME) {
+		if (handle != nullptr) {
+			return 0;
+		}
+		int count = 0;
+
+		if ((handle = dlopen(filename, RTLD_LAZY)) == nullptr) {
+			WC_ERROR("Cannot open library '%s'.\n", filename);
+			return 1;
+		}
+		WC_INFO("Opened dynamic library '%s', at %p.\n", filename, handle);
+
+		#define X11_PROC(name) \
+		if ((name = (PFN_##name)dlsym(handle, #name)) == nullptr) {\
+			WC_ERROR("Failed to load " #name "\n"); \
+			uninit(); \
+			return 1;\
+		} else {\
+			WC_INFO("Loaded function '%s', at %p.\n", #name, name); \
+			++count; \
+		}
+		X11_PROC_LIST
+		#undef X11_PROC
+
+		WC_INFO("Successfully loaded %u functions.\n", count);
+		return 0;
+	}
+
+	void uninit() {
+		if (handle != nullptr) {
+			dlclose(handle);
+			handle = nullptr;
+		}
+	}
+};
+static X11 x11;
+
+#undef X11_PROC_LIST
+
+#define XEXT_LIB_NAME "libXext.so"
+
+#define XEXT_PROC_LIST \
+	XEXT_PROC(XShmQueryExtension) \
+	XEXT_PROC(XShmCreateImage) \
+	XEXT_PROC(XShmAttach) \
+	XEXT_PROC(XShmDetach) \
+	XEXT_PROC(XShmPutImage) \
+	/* EMPTY_LINE */
+
+struct XExt {
+	// MIT-SHM function pointers
+	typedef Bool     (*PFN_XShmQueryExtension)(Display*);
+	typedef XImage*  (*PFN_XShmCreateImage)(Display*, Visual*, unsigned int, int, char*, XShmSegmentInfo*, unsigned int, unsigned int);
+	typedef Bool     (*PFN_XShmAttach)(Display*, XShmSegmentInfo*);
+	typedef Bool     (*PFN_XShmDetach)(Display*, XShmSegmentInfo*);
+	typedef Bool     (*PFN_XShmPutImage)(Display*, Drawable, GC, XImage*, int, int, int, int, unsigned int, unsigned int, Bool);
+
+	void* handle;
+
+	// Declare Xext functions
+	#define XEXT_PROC(name) PFN_##name name;
+	XEXT_PROC_LIST
+	#undef XEXT_PROC
+
+	XExt()
+		: handle(nullptr) {
+	}
+
+	~XExt() {
+		uninit();
+	}
+
+	int init(const char* filename = XEXT_LIB_NAME) {
+		if (handle != nullptr) {
+			return 0;
+		}
+		int count = 0;
+
+		// libXext is optional, the canvas falls back to XPutImage without it.
+		if ((handle = dlopen(filename, RTLD_LAZY)) == nullptr) {
+			WC_WARNING("Cannot open library '%s'.\n", filename);
+			return 1;
+		}
+		WC_INFO("Opened dynamic library '%s', at %p.\n", filename, handle);
+
+		#define XEXT_PROC(name) \
+		if ((name = (PFN_##name)dlsym(handle, #name)) == nullptr) {\
+			WC_WARNING("Failed to load " #name "\n"); \
+			uninit(); \
+			return 1;\
+		} else {\
+			WC_INFO("Loaded function '%s', at %p.\n", #name, name); \
+			++count; \
+		}
+		XEXT_PROC_LIST
+		#undef XEXT_PROC
+
+		WC_INFO("Successfully loaded %u functions.\n", count);
+		return 0;
+	}
+
+	void uninit() {
+		if (handle != nullptr) {
+			dlclose(handle);
+			handle = nullptr;
+		}
+	}
+};
+static XExt xext;
+
+#undef XEXT_PROC_LIST
+
+// libX11-xcb and libxcb-shm may come without headers, the few declarations
+// used here are repeated.
+enum XEventQueueOwner {
+	XlibOwnsEventQueue = 0,
+	XCBOwnsEventQueue
+};
+typedef uint32_t xcb_shm_seg_t;
+
+#define XCB_LIB_NAME "libxcb.so.1"
+#define X11_XCB_LIB_NAME "libX11-xcb.so.1"
+
+#define XCB_PROC_LIST \
+	XCB_PROC(xcb_flush) \
+	XCB_PROC(xcb_poll_for_event) \
+	XCB_PROC(xcb_poll_for_queued_event) \
+	XCB_PROC(xcb_put_image) \
+	XCB_PROC(xcb_get_maximum_request_length) \
+	/* EMPTY_LINE */
+
+#define X11_XCB_PROC_LIST \
+	X11_XCB_PROC(XGetXCBConnection) \
+	X11_XCB_PROC(XSetEventQueueOwner) \
+	/* EMPTY_LINE */
+
+struct Xcb {
+	// XCB function pointers
+	typedef int                  (*PFN_xcb_flush)(xcb_connection_t*);
+	typedef xcb_generic_event_t* (*PFN_xcb_poll_for_event)(xcb_connection_t*);
+	typedef xcb_generic_event_t* (*PFN_xcb_poll_for_queued_event)(xcb_connection_t*);
+	typedef xcb_void_cookie_t    (*PFN_xcb_put_image)(xcb_connection_t*, uint8_t, xcb_drawable_t, xcb_gcontext_t, uint16_t, uint16_t, int16_t, int16_t, uint8_t, uint8_t, uint32_t, const uint8_t*);
+	typedef uint32_t             (*PFN_xcb_get_maximum_request_length)(xcb_connection_t*);
+	// Xlib to XCB bridge function pointers
+	typedef xcb_connection_t*    (*PFN_XGetXCBConnection)(Display*);
+	typedef void                 (*PFN_XSetEventQueueOwner)(Display*, XEventQueueOwner);
+
+	void* handle;
+	void* bridgeHandle;
+
+	// Declare XCB functions
+	#define XCB_PROC(name) PFN_##name name;
+	#define X11_XCB_PROC(name) PFN_##name name;
+	XCB_PROC_LIST
+	X11_XCB_PROC_LIST
+	#undef X11_XCB_PROC
+	#undef XCB_PROC
+
+	// Loaded by the first Xcb canvas only.
+	Xcb()
+		: handle(nullptr), bridgeHandle(nullptr) {
+	}
+
+	~Xcb() {
+		uninit();
+	}
+
+	int init() {
+		if (handle != nullptr) {
+			return 0;
+		}
+		int count = 0;
+
+		if ((handle = dlopen(XCB_LIB_NAME, RTLD_LAZY)) == nullptr) {
+			WC_ERROR("Cannot open library '%s'.\n", XCB_LIB_NAME);
+			return 1;
+		}
+		WC_INFO("Opened dynamic library '%s', at %p.\n", XCB_LIB_NAME, handle);
+		if ((bridgeHandle = dlopen(X11_XCB_LIB_NAME, RTLD_LAZY)) == nullptr) {
+			WC_ERROR("Cannot open library '%s'.\n", X11_XCB_LIB_NAME);
+			uninit();
+			return 1;
+		}
+		WC_INFO("Opened dynamic library '%s', at %p.\n", X11_XCB_LIB_NAME, bridgeHandle);
+
+		#define XCB_LOAD(library, name) \
+		if ((name = (PFN_##name)dlsym(library, #name)) == nullptr) {\
+			WC_ERROR("Failed to load " #name "\n"); \
+			uninit(); \
+			return 1;\
+		} else {\
+			WC_INFO("Loaded function '%s', at %p.\n", #name, name); \
+			++count; \
+		}
+		#define XCB_PROC(name) XCB_LOAD(handle, name)
+		#define X11_XCB_PROC(name) XCB_LOAD(bridgeHandle, name)
+		XCB_PROC_LIST
+		X11_XCB_PROC_LIST
+		#undef X11_XCB_PROC
+		#undef XCB_PROC
+		#undef XCB_LOAD
+
+		WC_INFO("Successfully loaded %u functions.\n", count);
+		return 0;
+	}
+
+	void uninit() {
+		if (bridgeHandle != nullptr) {
+			dlclose(bridgeHandle);
+			bridgeHandle = nullptr;
+		}
+		if (handle != nullptr) {
+			dlclose(handle);
+			handle = nullptr;
+		}
+	}
+};
+static Xcb xcb;
+
+#undef X11_XCB_PROC_LIST
+#undef XCB_PROC_LIST
+
+#define XCB_SHM_LIB_NAME "libxcb-shm.so.0"
+
+#define XCB_SHM_PROC_LIST \
+	XCB_SHM_PROC(xcb_shm_put_image) \
+	/* EMPTY_LINE */
+
+struct XcbShm {
+	// XCB MIT-SHM function pointers
+	typedef xcb_void_cookie_t (*PFN_xcb_shm_put_image)(xcb_connection_t*, xcb_drawable_t, xcb_gcontext_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, int16_t, int16_t, uint8_t, uint8_t, uint8_t, xcb_shm_seg_t, uint32_t);
+
+	void* handle;
+
+	// Declare XCB MIT-SHM functions
+	#define XCB_SHM_PROC(name) PFN_##name name;
+	XCB_SHM_PROC_LIST
+	#undef XCB_SHM_PROC
+
+	XcbShm()
+		: handle(nullptr) {
+	}
+
+	~XcbShm() {
+		uninit();
+	}
+
+	int init(const char* filename = XCB_SHM_LIB_NAME) {
+		if (handle != nullptr) {
+			return 0;
+		}
+		int count = 0;
+
+		// libxcb-shm is optional, shared images go through libXext without it.
+		if ((handle = dlopen(filename, RTLD_LAZY)) == nullptr) {
+			WC_WARNING("Cannot open library '%s'.\n", filename);
+			return 1;
+		}
+		WC_INFO("Opened dynamic library '%s', at %p.\n", filename, handle);
+
+		#define XCB_SHM_PROC(name) \
+		if ((name = (PFN_##name)dlsym(handle, #name)) == nullptr) {\
+			WC_WARNING("Failed to load " #name "\n"); \
+			uninit(); \
+			return 1;\
+		} else {\
+			WC_INFO("Loaded function '%s', at %p.\n", #name, name); \
+			++count; \
+		}
+		XCB_SHM_PROC_LIST
+		#undef XCB_SHM_PROC
+
+		WC_INFO("Successfully loaded %u functions.\n", count);
+		return 0;
+	}
+
+	void uninit() {
+		if (handle != nullptr) {
+			dlclose(handle);
+			handle = nullptr;
+		}
+	}
+};
+static XcbShm xcbShm;
+
+#undef XCB_SHM_PROC_LIST
+
+static bool shmAttachFailed = false;
+
+static int shmErrorHandler(Display*, XErrorEvent*) {
+	shmAttachFailed = true;
+	return 0;
+}
+
+// MIT-SHM only works when the server runs on the same host.
+static bool isLocalDisplay(Display* display) {
+	const char* name = DisplayString(display);
+	return (name != nullptr) && (name[0] == ':' || strncmp(name, "unix:", 5) == 0);
+}
+
+static bool isSharedMemoryAvailable(Display* display) {
+	if (getenv("WCANVAS_NO_SHM") != nullptr) {
+		WC_INFO("MIT-SHM disabled by WCANVAS_NO_SHM.\n");
+		return false;
+	}
+	return xext.init() == 0 && isLocalDisplay(display) && xext.XShmQueryExtension(display);
+}
+
+// Releases everything createSharedXImage() allocated. 'attached' tells if
+// the segment was attached to the server.
+static void destroySharedXImage(Display* display, XImage* image, XShmSegmentInfo& shmInfo, bool attached) {
+	if (attached) {
+		xext.XShmDetach(display, &shmInfo);
+		x11.XSync(display, False);
+	}
+	if (image != nullptr) {
+		// The image data belongs to the segment, not to malloc.
+		image->data = nullptr;
+		x11.XDestroyImage(image);
+	}
+	if (shmInfo.shmaddr != nullptr) {
+		shmdt(shmInfo.shmaddr);
+		shmInfo.shmaddr = nullptr;
+	}
+	if (shmInfo.shmid >= 0) {
+		shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+		shmInfo.shmid = -1;
+	}
+}
+
+// Describe 'image' as 'height' rows of 'stride' bytes. XShmPutImage only
+// sends the image width and the server derives the rows from it, so a shared
+// image is as wide as its padded rows. 'width' is kept by the caller then.
+static void setImageLayout(XImage* image, bool shared, uint32_t width, uint32_t height, uint32_t stride) {
+	image->width = shared ? stride * 8 / image->bits_per_pixel : width;
+	image->height = height;
+	image->bytes_per_line = stride;
+}
+
+// Creates a ZPixmap image in the server format whose data is a SysV segment
+// attached to 'display', at least 'capacity' bytes long. Returns nullptr on
+// failure, the segment size in 'capacity' otherwise.
+static XImage* createSharedXImage(Display* display, uint32_t width, uint32_t height, uint32_t stride, XShmSegmentInfo& shmInfo, uint32_t& capacity) {
+	memset(&shmInfo, 0, sizeof(shmInfo));
+	shmInfo.shmid = -1;
+
+	const int screen = DefaultScreen(display);
+	XImage* image = xext.XShmCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen), ZPixmap, nullptr, &shmInfo, width, height);
+	if (image == nullptr) {
+		WC_WARNING("Failed to create shared xImage.\n");
+		return nullptr;
+	}
+	// XShmCreateImage takes no row length, the padding becomes extra columns.
+	setImageLayout(image, true, width, height, stride);
+	uint32_t length = image->bytes_per_line * image->height;
+	if (length < capacity) {
+		length = capacity;
+	}
+#if defined(SHM_HUGETLB)
+	if (useHugePages(length)) {
+		const uint32_t hugeLength = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		if ((shmInfo.shmid = shmget(IPC_PRIVATE, hugeLength, IPC_CREAT | SHM_HUGETLB | 0600)) >= 0) {
+			length = hugeLength;
+		}
+	}
+#endif
+	if (shmInfo.shmid < 0 && (shmInfo.shmid = shmget(IPC_PRIVATE, length, IPC_CREAT | 0600)) < 0) {
+		WC_WARNING("Failed to allocate shared memory segment.\n");
+		destroySharedXImage(display, image, shmInfo, false);
+		return nullptr;
+	}
+	if ((shmInfo.shmaddr = (char*)shmat(shmInfo.shmid, nullptr, 0)) == (char*)-1) {
+		WC_WARNING("Failed to attach shared memory segment.\n");
+		shmInfo.shmaddr = nullptr;
+		destroySharedXImage(display, image, shmInfo, false);
+		return nullptr;
+	}
+	shmInfo.readOnly = False;
+	image->data = shmInfo.shmaddr;
+
+	// A remote or restricted server reports the failure asynchronously.
+	shmAttachFailed = false;
+	XErrorHandler oldHandler = x11.XSetErrorHandler(shmErrorHandler);
+	const Bool attached = xext.XShmAttach(display, &shmInfo);
+	x11.XSync(display, False);
+	x11.XSetErrorHandler(oldHandler);
+	if (!attached || shmAttachFailed) {
+		WC_WARNING("Failed to attach shared memory segment to the X server.\n");
+		destroySharedXImage(display, image, shmInfo, false);
+		return nullptr;
+	}
+
+	// Mark the segment for removal, it is released once both sides detach.
+	shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+	shmInfo.shmid = -1;
+	capacity = length;
+	return image;
+}
+
+// Bits per pixel of ZPixmap images at the default depth, 0 if unknown.
+static uint32_t getImageBitsPerPixel(Display* display) {
+	const int depth = DefaultDepth(display, DefaultScreen(display));
+	uint32_t bitsPerPixel = 0;
+	int count = 0;
+	XPixmapFormatValues* formats = x11.XListPixmapFormats(display, &count);
+	for (int index = 0; index < count; ++index) {
+		if (formats[index].depth == depth) {
+			bitsPerPixel = formats[index].bits_per_pixel;
+			break;
+		}
+	}
+	if (formats != nullptr) {
+		x11.XFree(formats);
+	}
+	return bitsPerPixel;
+}
+
+// Creates the image presented on 'display' in the server pixel format with
+// rows of 'stride' bytes, in a MIT-SHM segment when possible. The image owns
+// its data, which is at least 'capacity' bytes long. The allocated size is
+// returned in 'capacity'.
+static XImage* createPresentImage(Display* display, uint32_t width, uint32_t height, uint32_t stride, XShmSegmentInfo& shmInfo, bool& shared, uint32_t& capacity) {
+	memset(&shmInfo, 0, sizeof(shmInfo));
+	shmInfo.shmid = -1;
+	shared = false;
+	if (isSharedMemoryAvailable(display)) {
+		XImage* image = createSharedXImage(display, width, height, stride, shmInfo, capacity);
+		if (image != nullptr) {
+			shared = true;
+			return image;
+		}
+	}
+
+	const int screen = DefaultScreen(display);
+	XImage* image = x11.XCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen), ZPixmap, 0, nullptr, width, height, 32, stride);
+	if (image == nullptr) {
+		WC_ERROR("Failed to create xImage.\n");
+		return nullptr;
+	}
+	uint32_t length = image->bytes_per_line * image->height;
+	if (length < capacity) {
+		length = capacity;
+	}
+	if ((image->data = (char*)allocatePixels(length)) == nullptr) {
+		WC_ERROR("Failed to allocate the xImage data.\n");
+		x11.XDestroyImage(image);
+		return nullptr;
+	}
+	capacity = length;
+	return image;
+}
+
+// 'capacity' is the size returned by createPresentImage().
+static void destroyPresentImage(Display* display, XImage* image, XShmSegmentInfo& shmInfo, bool shared, uint32_t capacity) {
+	if (shared) {
+		destroySharedXImage(display, image, shmInfo, true);
+	} else if (image != nullptr) {
+		freePixels((uint8_t*)image->data, capacity);
+		image->data = nullptr;
+		x11.XDestroyImage(image);
+	}
+}
+
+// Memory layout of the pixels of 'image', derived from the visual masks.
+// The library assumes a little endian client.
+static bool getImageFormat(const XImage* image, PixelFormat& format) {
+	uint32_t red = image->red_mask;
+	uint32_t green = image->green_mask;
+	uint32_t blue = image->blue_mask;
+	const bool swapped = (image->byte_order == MSBFirst);
+	switch (image->bits_per_pixel) {
+	case 32 :
+		if (swapped) {
+			red = __builtin_bswap32(red);
+			green = __builtin_bswap32(green);
+			blue = __builtin_bswap32(blue);
+		}
+		if (red == 0xFF0000 && green == 0xFF00 && blue == 0xFF) {
+			format = PixelFormatXRGB8888;
+			return true;
+		}
+		if (red == 0xFF && green == 0xFF00 && blue == 0xFF0000) {
+			format = PixelFormatXBGR8888;
+			return true;
+		}
+		if (red == 0xFF00 && green == 0xFF0000 && blue == 0xFF000000) {
+			format = PixelFormatBGRX8888;
+			return true;
+		}
+		break;
+	case 24 :
+		if (!swapped && red == 0xFF0000 && green == 0xFF00 && blue == 0xFF) {
+			format = PixelFormatRGB888;
+			return true;
+		}
+		break;
+	case 16 :
+		if (!swapped && red == 0xF800 && green == 0x07E0 && blue == 0x001F) {
+			format = PixelFormatRGB565;
+			return true;
+		}
+		break;
+	}
+	WC_ERROR("Unsupported visual: %d bpp, masks %lx %lx %lx.\n", image->bits_per_pixel, image->red_mask, image->green_mask, image->blue_mask);
+	return false;
+}
+
+// Hands the event queue of 'display' to XCB, before any event is read. Xlib
+// keeps serving the other requests on the same connection.
+static int openXcbQueue(Display* display, XcbEventQueue& queue) {
+	if (xcb.init() != 0) {
+		WC_ERROR("Failed to load libxcb.\n");
+		return 1;
+	}
+	xcbShm.init();
+	queue.connection = xcb.XGetXCBConnection(display);
+	queue.hasHeld = false;
+	xcb.XSetEventQueueOwner(display, XCBOwnsEventQueue);
+	return 0;
+}
+
+// Send the regions of 'image' as unchecked XCB requests: nothing waits for
+// their cookies and errors come back as events. Plain images go row by row,
+// or in strips as long as the request size allows when the regions span
+// whole rows. Nothing is flushed.
+static void putXcbImage(Display* display, xcb_connection_t* connection, Window window, GC gc, XImage* image, bool shared, const WindowRect* rects, uint32_t count) {
+	const xcb_gcontext_t gcontext = x11.XGContextFromGC(gc);
+	if (shared) {
+		if (xcbShm.handle == nullptr) {
+			for (uint32_t index = 0; index < count; ++index) {
+				const WindowRect& r = rects[index];
+				xext.XShmPutImage(display, window, gc, image, r.x, r.y, r.x, r.y, r.width, r.height, False);
+			}
+			return;
+		}
+		// XShmCreateImage links the image to its segment.
+		const XShmSegmentInfo* segment = (const XShmSegmentInfo*)image->obdata;
+		const uint32_t offset = (uint32_t)(image->data - segment->shmaddr);
+		// The server derives the rows from this width, see setImageLayout().
+		const uint32_t totalWidth = image->bytes_per_line * 8 / image->bits_per_pixel;
+		for (uint32_t index = 0; index < count; ++index) {
+			const WindowRect& r = rects[index];
+			xcbShm.xcb_shm_put_image(connection, window, gcontext, totalWidth, image->height, r.x, r.y, r.width, r.height, r.x, r.y,
+			                         image->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, segment->shmseg, offset);
+		}
+		return;
+	}
+	if (image->bits_per_pixel != 32 && image->bits_per_pixel != 16) {
+		for (uint32_t index = 0; index < count; ++index) {
+			const WindowRect& r = rects[index];
+			x11.XPutImage(display, window, gc, image, r.x, r.y, r.x, r.y, r.width, r.height);
+		}
+		return;
+	}
+	const uint32_t bytesPerPixel = image->bits_per_pixel / 8;
+	// Rows of a ZPixmap request are padded to 4 bytes, 16 bit regions are
+	// widened to even columns so that they need none.
+	const int32_t align = 4 / bytesPerPixel;
+	// The maximum length is in 4 byte units, PutImage has a 24 byte header.
+	const uint32_t maxLength = xcb.xcb_get_maximum_request_length(connection) * 4 - 24;
+	for (uint32_t index = 0; index < count; ++index) {
+		const WindowRect& r = rects[index];
+		const int32_t left = r.x & ~(align - 1);
+		const int32_t right = (r.x + (int32_t)r.width + align - 1) & ~(align - 1);
+		const uint32_t rowLength = (right - left) * bytesPerPixel;
+		uint32_t stripHeight = 1;
+		if (rowLength == (uint32_t)image->bytes_per_line && rowLength <= maxLength) {
+			stripHeight = maxLength / rowLength;
+		}
+		for (uint32_t y = r.y; y < r.y + r.height; y += stripHeight) {
+			const uint32_t rows = (r.y + r.height - y < stripHeight) ? r.y + r.height - y : stripHeight;
+			const uint8_t* data = (const uint8_t*)image->data + y * image->bytes_per_line + left * bytesPerPixel;
+			xcb.xcb_put_image(connection, XCB_IMAGE_FORMAT_Z_PIXMAP, window, gcontext, right - left, rows, left, y, 0, image->depth, rowLength * rows, data);
+		}
+	}
+}
+
+// Fill 'xEvent' with the XCB event types translateEvent() handles. Returns
+// false for the others, logging the errors of unchecked requests.
+static bool toXEvent(Display* display, const xcb_generic_event_t* source, XEvent& xEvent) {
+	memset(&xEvent, 0, sizeof(xEvent));
+	xEvent.xany.serial = source->full_sequence;
+	xEvent.xany.send_event = (source->response_type & 0x80) ? True : False;
+	xEvent.xany.display = display;
+	switch (source->response_type & 0x7F) {
+	case 0 : {
+		const xcb_generic_error_t* error = (const xcb_generic_error_t*)source;
+		WC_WARNING("X error %u on request %u.%u.\n", error->error_code, error->major_code, error->minor_code);
+		(void)error;
+		return false;
+	}
+	case XCB_KEY_PRESS :
+	case XCB_KEY_RELEASE : {
+		const xcb_key_press_event_t* key = (const xcb_key_press_event_t*)source;
+		xEvent.type = ((source->response_type & 0x7F) == XCB_KEY_PRESS) ? KeyPress : KeyRelease;
+		xEvent.xkey.window = key->event;
+		xEvent.xkey.root = key->root;
+		xEvent.xkey.subwindow = key->child;
+		xEvent.xkey.time = key->time;
+		xEvent.xkey.x = key->event_x;
+		xEvent.xkey.y = key->event_y;
+		xEvent.xkey.x_root = key->root_x;
+		xEvent.xkey.y_root = key->root_y;
+		xEvent.xkey.state = key->state;
+		xEvent.xkey.keycode = key->detail;
+		xEvent.xkey.same_screen = key->same_screen;
+		return true;
+	}
+	case XCB_BUTTON_PRESS :
+	case XCB_BUTTON_RELEASE : {
+		const xcb_button_press_event_t* button = (const xcb_button_press_event_t*)source;
+		xEvent.type = ((source->response_type & 0x7F) == XCB_BUTTON_PRESS) ? ButtonPress : ButtonRelease;
+		xEvent.xbutton.window = button->event;
+		xEvent.xbutton.root = button->root;
+		xEvent.xbutton.subwindow = button->child;
+		xEvent.xbutton.time = button->time;
+		xEvent.xbutton.x = button->event_x;
+		xEvent.xbutton.y = button->event_y;
+		xEvent.xbutton.x_root = button->root_x;
+		xEvent.xbutton.y_root = button->root_y;
+		xEvent.xbutton.state = button->state;
+		xEvent.xbutton.button = button->detail;
+		xEvent.xbutton.same_screen = button->same_screen;
+		return true;
+	}
+	case XCB_MOTION_NOTIFY : {
+		const xcb_motion_notify_event_t* motion = (const xcb_motion_notify_event_t*)source;
+		xEvent.type = MotionNotify;
+		xEvent.xmotion.window = motion->event;
+		xEvent.xmotion.root = motion->root;
+		xEvent.xmotion.subwindow = motion->child;
+		xEvent.xmotion.time = motion->time;
+		xEvent.xmotion.x = motion->event_x;
+		xEvent.xmotion.y = motion->event_y;
+		xEvent.xmotion.x_root = motion->root_x;
+		xEvent.xmotion.y_root = motion->root_y;
+		xEvent.xmotion.state = motion->state;
+		xEvent.xmotion.is_hint = motion->detail;
+		xEvent.xmotion.same_screen = motion->same_screen;
+		return true;
+	}
+	case XCB_EXPOSE : {
+		const xcb_expose_event_t* expose = (const xcb_expose_event_t*)source;
+		xEvent.type = Expose;
+		xEvent.xexpose.window = expose->window;
+		xEvent.xexpose.x = expose->x;
+		xEvent.xexpose.y = expose->y;
+		xEvent.xexpose.width = expose->width;
+		xEvent.xexpose.height = expose->height;
+		xEvent.xexpose.count = expose->count;
+		return true;
+	}
+	case XCB_CONFIGURE_NOTIFY : {
+		const xcb_configure_notify_event_t* configure = (const xcb_configure_notify_event_t*)source;
+		xEvent.type = ConfigureNotify;
+		xEvent.xconfigure.event = configure->event;
+		xEvent.xconfigure.window = configure->window;
+		xEvent.xconfigure.above = configure->above_sibling;
+		xEvent.xconfigure.x = configure->x;
+		xEvent.xconfigure.y = configure->y;
+		xEvent.xconfigure.width = configure->width;
+		xEvent.xconfigure.height = configure->height;
+		xEvent.xconfigure.border_width = configure->border_width;
+		xEvent.xconfigure.override_redirect = configure->override_redirect;
+		return true;
+	}
+	case XCB_CLIENT_MESSAGE : {
+		const xcb_client_message_event_t* message = (const xcb_client_message_event_t*)source;
+		xEvent.type = ClientMessage;
+		xEvent.xclient.window = message->window;
+		xEvent.xclient.message_type = message->type;
+		xEvent.xclient.format = message->format;
+		for (uint32_t index = 0; index < 5; ++index) {
+			xEvent.xclient.data.l[index] = message->data.data32[index];
+		}
+		return true;
+	}
+	default :
+		return false;
+	}
+}
+
+// Next event of an XCB owned queue. With 'read' set the connection is read
+// when nothing is queued, otherwise only queued events are returned.
+static bool nextXcbEvent(Display* display, XcbEventQueue& queue, XEvent& xEvent, bool read) {
+	if (queue.hasHeld) {
+		xEvent = queue.held;
+		queue.hasHeld = false;
+		return true;
+	}
+	for (;;) {
+		xcb_generic_event_t* source = read ? xcb.xcb_poll_for_event(queue.connection) : xcb.xcb_poll_for_queued_event(queue.connection);
+		if (source == nullptr) {
+			return false;
+		}
+		const bool translated = toXEvent(display, source, xEvent);
+		free(source);
+		if (translated) {
+			return true;
+		}
+	}
+}
+
+// Look at the next queued event without reading the connection.
+static bool peekXcbEvent(Display* display, XcbEventQueue& queue, XEvent& xEvent) {
+	if (!queue.hasHeld) {
+		queue.hasHeld = nextXcbEvent(display, queue, queue.held, false);
+	}
+	if (queue.hasHeld) {
+		xEvent = queue.held;
+	}
+	return queue.hasHeld;
+}
+
+#elif defined(_WIN32)
+/*****************************************************************************/
+/** Windows - GDI                                                            */
+/*****************************************************************************/
+#include <windows.h>
+
+#define GDI_LIB_NAME "gdi32.dll"
+#define GDI_PROC_LIST \
+	GDI_PROC(CreateCompatibleDC) \
+	GDI_PROC(CreateDIBSection) \
+	GDI_PROC(SelectObject) \
+	GDI_PROC(DeleteObject) \
+	GDI_PROC(ExtFloodFill) \
+	GDI_PROC(BitBlt) \
+	GDI_PROC(SetDIBColorTable) \
+	/* Empty line */
+	
+/*
+	// WIN32 API
+	WIN32_PROC(RegisterClass) \
+	WIN32_PROC(SetWindowLongPtr) \
+	WIN32_PROC(GetWindowLongPtr) \
+	WIN32_PROC(DefWindowProc) \
+	WIN32_PROC(GetKeyboardState) \
+	WIN32_PROC(ToAscii) \
+	WIN32_PROC(AdjustWindowRect) \
+	WIN32_PROC(CreateWindowEx) \
+	WIN32_PROC(GetDC) \
+	
+	typedef ATOM     (*PFN_RegisterClass)(const WNDCLASSA *lpWndClass);
+	typedef LONG_PTR (*PFN_SetWindowLongPtr)(HWND hWnd, int nIndex, LONG_PTR dwNewLong);
+	typedef LONG_PTR (*PFN_GetWindowLongPtr)(HWND hWnd, int nIndex);
+	typedef LRESULT  (*PFN_DefWindowProc)(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+	typedef BOOL     (*PFN_GetKeyboardState)(PBYTE lpKeyState);
+	typedef int      (*PFN_ToAscii)(UINT uVirtKey, UINT uScanCode, const BYTE *lpKeyState, LPWORD lpChar, UINT uFlags);
+	typedef BOOL     (*PFN_AdjustWindowRect)(LPRECT lpRect, DWORD dwStyle, BOOL bMenu);
+	typedef HWND     (*PFN_CreateWindowEx)(DWORD dwExStyle, LPCSTR lpClassName, LPCSTR lpWindowName, DWORD dwStyle, int X, int Y, int nWidth, int nHeight, HWND hWndParent, HMENU hMenu, HINSTANCE hInstance, LPVOID lpParam);
+	typedef HDC      (*PFN_GetDC)(HWND hWnd);
+*/
+
+struct GDI {
+	typedef HDC      (__stdcall *PFN_CreateCompatibleDC)(HDC hdc);
+	typedef HBITMAP  (__stdcall *PFN_CreateDIBSection)(HDC hdc, const BITMAPINFO *pbmi, UINT usage, VOID **ppvBits, HANDLE hSection, DWORD offset);
+	typedef HGDIOBJ  (__stdcall *PFN_SelectObject)(HDC hdc, HGDIOBJ h);
+	typedef BOOL     (__stdcall *PFN_DeleteObject)(HGDIOBJ ho);
+	typedef BOOL     (__stdcall *PFN_ExtFloodFill)(HDC hdc, int x, int y, COLORREF color, UINT type);
+	typedef BOOL     (__stdcall *PFN_BitBlt)(HDC hdc, int x, int y, int cx, int cy, HDC hdcSrc, int x1, int y1, DWORD rop);
+	typedef UINT     (__stdcall *PFN_SetDIBColorTable)(HDC hdc, UINT iStart, UINT cEntries, const RGBQUAD *prgbq);
+
+	HMODULE handle;
+	
+	// Declare GDI functions
+	#define GDI_PROC(name) PFN_##name name;
+	GDI_PROC_LIST
+	#undef GDI_PROC
+
+	GDI() : handle(nullptr) {
+		init();
+	}
+
+	~GDI() {
+		uninit();
+	}
+
+	int init(const char* filename = GDI_LIB_NAME) {
+		if (handle != nullptr) {
+			return 0;
+		}
+		int count = 0;
+
+		if ((handle = LoadLibrary(filename)) == nullptr) {
+			WC_ERROR("Cannot open library '%s'.\n", filename);
+			return 1;
+		}
+		WC_INFO("Opened dynamic library '%s', at %p.\n", filename, handle);
+
+		#define GDI_PROC(name) \
+		if ((name = (PFN_##name)GetProcAddress(handle, #name)) == nullptr) {\
+			WC_ERROR("Failed to load " #name "\n"); \
+			uninit(); \
+			return 1;\
+		} else {\
+			WC_INFO("Loaded function '%s', at %p.\n", #name, name); \
+			++count; \
+		}
+		GDI_PROC_LIST
+		#undef GDI_PROC
+
+		WC_INFO("Successfully loaded %u functions.\n", count);
+		return 0;
+	}
+	
+	void uninit() {
+		if (handle != nullptr) {
+			FreeLibrary(handle);
+			handle = nullptr;
+		}
+	}
+};
+
+static const GDI gdi;
+
+#undef GDI_PROC_LIST
+
+// Input events carry the message time, like the X server time on Linux.
+static LRESULT stampInput(WindowEvent& event) {
+	event.time = GetMessageTime();
+	event.receiveTime = getMonotonicTime();
+	return 0;
+}
+
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+	WindowCanvas* window = (WindowCanvas*)GetWindowLongPtr(hwnd, GWL_USERDATA);
+	if (window == nullptr) {
+		return DefWindowProc(hwnd, uMsg, wParam, lParam);
+	}
+
+	switch (uMsg) {
+	case WM_CLOSE:
+		// Reported as an event, DefWindowProc would destroy the window.
+		if (window->eventPtr != nullptr) {
+			window->eventPtr->type = WindowEvent::WindowClose;
+		}
+		return 0;
+	case WM_PAINT :
+		// Painting is left to DefWindowProc, the next frame is sent whole.
+		window->tileHashesValid = false;
+		return DefWindowProc(hwnd, uMsg, wParam, lParam);
+	case WM_SIZE :
+		// Only the last size of a burst is applied, see applyPendingResize().
+		if (window->resizable && wParam != SIZE_MINIMIZED) {
+			window->pendingWidth = LOWORD(lParam);
+			window->pendingHeight = HIWORD(lParam);
+			window->resizePending = true;
+		}
+		return 0;
+	}
+
+	// Messages sent outside of the event pumps, e.g. by ShowWindow() or
+	// SetWindowPos(), have no event to fill.
+	if (window->eventPtr == nullptr) {
+		return DefWindowProc(hwnd, uMsg, wParam, lParam);
+	}
+	WindowEvent& event = *window->eventPtr;
+    static BYTE keyState[256];
+	char text[8];
+	switch (uMsg) {
+	case WM_MOUSEMOVE :
+		event.type = WindowEvent::CursorMove;
+		event.x = LOWORD(lParam);
+		event.y = HIWORD(lParam);
+		return stampInput(event);
+	case WM_LBUTTONDOWN :
+		event.type = WindowEvent::ButtonPressed;
+		event.button = 1;
+		return stampInput(event);
+	case WM_LBUTTONUP :
+		event.type = WindowEvent::ButtonReleased;
+		event.button = 1;
+		return stampInput(event);
+	case WM_MBUTTONDOWN :
+		event.type = WindowEvent::ButtonPressed;
+		event.button = 2;
+		return stampInput(event);
+	case WM_MBUTTONUP :
+		event.type = WindowEvent::ButtonReleased;
+		event.button = 2;
+		return stampInput(event);
+	case WM_RBUTTONDOWN :
+		event.type = WindowEvent::ButtonPressed;
+		event.button = 3;
+		return stampInput(event);
+	case WM_RBUTTONUP :
+		event.type = WindowEvent::ButtonReleased;
+		event.button = 3;
+		return stampInput(event);
+	case WM_MOUSEWHEEL :
+		event.type = (GET_WHEEL_DELTA_WPARAM(wParam) > 0 ? WindowEvent::WheelUp : WindowEvent::WheelDown);
+		return stampInput(event);
+	case WM_KEYDOWN :
+		event.type = WindowEvent::KeyPressed;
+		event.keyCode = wParam;
+		GetKeyboardState(keyState);
+		if (ToAscii(event.keyCode, MapVirtualKey(event.keyCode, MAPVK_VK_TO_VSC), keyState, (LPWORD)text, 0) == 1) {
+			switch (text[0]) {
+			case 0x1B : // escape
+			case 0x08 : // backspace
+			case 0x7F : // delete
+				event.ascii = '\0';
+				break;
+			default :
+				event.ascii = text[0];
+				break;
+			}
+		} else {
+			event.ascii = '\0';
+		}
+		return stampInput(event);
+	case WM_KEYUP :
+		event.type = WindowEvent::KeyReleased;
+		event.keyCode = wParam;
+		return stampInput(event);
+	}
+
+	return DefWindowProc(hwnd, uMsg, wParam, lParam);
+}
+
+struct DibInfo {
+	BITMAPINFOHEADER header;
+	// Channel masks of 16 bit sections, color table of 8 bit ones.
+	DWORD colors[256];
+};
+
+// Top-down DIB description, 16 bit sections use RGB565 instead of the
+// default 555 layout, 8 bit ones 'palette' as their color table.
+static void getDibInfo(DibInfo& info, uint32_t width, uint32_t height, uint8_t depth, const uint32_t* palette) {
+	memset(&info, 0, sizeof(info));
+	info.header.biSize = sizeof(BITMAPINFOHEADER);
+	info.header.biWidth = width;
+	info.header.biHeight = -(LONG)height;
+	info.header.biPlanes = 1;
+	info.header.biBitCount = depth;
+	info.header.biCompression = BI_RGB;
+	if (depth == 16) {
+		info.header.biCompression = BI_BITFIELDS;
+		info.colors[0] = 0xF800;
+		info.colors[1] = 0x07E0;
+		info.colors[2] = 0x001F;
+	} else if (depth == 8) {
+		// RGBQUAD is XRGB8888 with a reserved zero byte.
+		info.header.biClrUsed = 256;
+		for (uint32_t index = 0; index < 256; ++index) {
+			info.colors[index] = palette[index] & 0x00FFFFFF;
+		}
+	}
+}
+#else
+/*****************************************************************************/
+/** Unknown platform                                                         */
+/*****************************************************************************/
+	#error "Unknown platform"
+#endif
+
+/******************************************************************************/
+/** Dirty rectangles                                                          */
+/******************************************************************************/
+static uint64_t rectArea(const WindowRect& r) {
+	return (uint64_t)r.width * r.height;
+}
+
+static bool rectsOverlap(const WindowRect& a, const WindowRect& b) {
+	return a.x < b.x + (int32_t)b.width && b.x < a.x + (int32_t)a.width
+		&& a.y < b.y + (int32_t)b.height && b.y < a.y + (int32_t)a.height;
+}
+
+static WindowRect rectUnion(const WindowRect& a, const WindowRect& b) {
+	const int32_t x0 = a.x < b.x ? a.x : b.x;
+	const int32_t y0 = a.y < b.y ? a.y : b.y;
+	const int32_t x1 = a.x + (int32_t)a.width > b.x + (int32_t)b.width ? a.x + (int32_t)a.width : b.x + (int32_t)b.width;
+	const int32_t y1 = a.y + (int32_t)a.height > b.y + (int32_t)b.height ? a.y + (int32_t)a.height : b.y + (int32_t)b.height;
+	return WindowRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+static bool clipRect(WindowRect& r, uint32_t width, uint32_t height) {
+	int64_t x0 = r.x, y0 = r.y;
+	int64_t x1 = x0 + r.width, y1 = y0 + r.height;
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 > width ? width : x1;
+	y1 = y1 > height ? height : y1;
+	if (x0 >= x1 || y0 >= y1) {
+		return false;
+	}
+	r = WindowRect((int32_t)x0, (int32_t)y0, (uint32_t)(x1 - x0), (uint32_t)(y1 - y0));
+	return true;
+}
+
+// Add 'rect' to the set, merging it with every rectangle it overlaps. When the
+// set is full the rectangle is folded into the one that grows the least.
+static void mergeRect(WindowRect* rects, uint32_t& count, uint32_t maxCount, WindowRect rect) {
+	for (;;) {
+		bool merged = false;
+		for (uint32_t index = 0; index < count; ++index) {
+			if (rectsOverlap(rects[index], rect)) {
+				rect = rectUnion(rects[index], rect);
+				rects[index] = rects[--count];
+				merged = true;
+				break;
+			}
+		}
+		if (merged) {
+			continue;
+		}
+		if (count < maxCount) {
+			rects[count++] = rect;
+			return;
+		}
+
+		uint32_t best = 0;
+		uint64_t bestGrowth = UINT64_MAX;
+		for (uint32_t index = 0; index < count; ++index) {
+			const uint64_t growth = rectArea(rectUnion(rects[index], rect)) - rectArea(rects[index]);
+			if (growth < bestGrowth) {
+				bestGrowth = growth;
+				best = index;
+			}
+		}
+		rect = rectUnion(rects[best], rect);
+		rects[best] = rects[--count];
+	}
+}
+
+/******************************************************************************/
+/** Presenter thread                                                          */
+/******************************************************************************/
+// Owns the back buffers of a multi-buffered canvas and uploads submitted
+// buffers from its own thread. The X11 version opens a second connection so
+// the render thread keeps using its own one without Xlib locking.
+// Buffer indices move between the application and the presenter through two
+// lock-free queues; the semaphores only park the side that has nothing to do.
+struct WindowCanvas::Presenter {
+	struct Buffer {
+		uint8_t* pixels;
+#if defined(_WIN32)
+		HDC dc;
+		HBITMAP bitmap;
+		HGDIOBJ oldBitmap;
+#else
+		XImage* image;
+		XShmSegmentInfo shmInfo;
+		bool shared;
+		uint32_t capacity;
+#endif
+	};
+
+	Buffer buffers[MAX_BUFFER_COUNT];
+	uint32_t bufferCount;
+	uint32_t current;
+	uint32_t width;
+	uint32_t height;
+	uint8_t depth;
+	uint32_t length;
+	// Pixel buffer the canvas owned before the presenter was started.
+	uint8_t* primaryBuffer;
+	SpscQueue<uint32_t, MAX_BUFFER_COUNT + 1> submitted;
+	SpscQueue<uint32_t, MAX_BUFFER_COUNT + 1> released;
+	Semaphore submittedCount;
+	Semaphore releasedCount;
+	std::atomic<uint32_t> queued;
+	std::atomic<bool> running;
+	Thread thread;
+#if defined(_WIN32)
+	HDC hdc;
+#else
+	Display* display;
+	// Set with the Xcb backend, events stay with the canvas connection.
+	xcb_connection_t* connection;
+	Window window;
+	GC gc;
+	PixelFormat pixelFormat;
+	PixelFormat imageFormat;
+	uint32_t pitch;
+	bool convert;
+#endif
+
+	Presenter()
+		: bufferCount(0), current(0), width(0), height(0), depth(0), length(0), primaryBuffer(nullptr), queued(0), running(false)
+#if defined(_WIN32)
+		, hdc(0)
+#else
+		, display(nullptr), connection(nullptr), window(0), gc(0), pixelFormat(PixelFormatXRGB8888), imageFormat(PixelFormatXRGB8888), pitch(0), convert(false)
+#endif
+	{
+		memset(buffers, 0, sizeof(buffers));
+	}
+
+	~Presenter() {
+		uninit();
+	}
+
+	int init(const WindowCanvas& canvas, uint32_t count) {
+		width = canvas.width;
+		height = canvas.height;
+		depth = canvas.depth;
+		primaryBuffer = canvas.pixelBuffer;
+		length = canvas.pixelBufferLength;
+#if defined(_WIN32)
+		hdc = canvas.hdc;
+		// Same row length as the canvas bitmap.
+		DibInfo bitmapinfo;
+		getDibInfo(bitmapinfo, canvas.bitmapWidth, height, depth, canvas.palette);
+		for (bufferCount = 0; bufferCount < count; ++bufferCount) {
+			Buffer& buffer = buffers[bufferCount];
+			if ((buffer.dc = gdi.CreateCompatibleDC(hdc)) == nullptr) {
+				WC_ERROR("Failed to create compatible device context.\n");
+				return 1;
+			}
+			if ((buffer.bitmap = gdi.CreateDIBSection(buffer.dc, (const BITMAPINFO*)&bitmapinfo, DIB_RGB_COLORS, (VOID**)&buffer.pixels, nullptr, 0)) == nullptr) {
+				WC_ERROR("Failed to create bitmap.\n");
+				return 2;
+			}
+			buffer.oldBitmap = gdi.SelectObject(buffer.dc, buffer.bitmap);
+		}
+#else // __linux__
+		window = canvas.window;
+		if ((display = x11.XOpenDisplay(DisplayString(canvas.display))) == nullptr) {
+			WC_ERROR("Failed to open the presenter connection.\n");
+			return 1;
+		}
+		if (canvas.backend == Xcb) {
+			connection = xcb.XGetXCBConnection(display);
+		}
+		gc = x11.XCreateGC(display, window, 0, 0);
+		pixelFormat = canvas.pixelFormat;
+		imageFormat = canvas.imageFormat;
+		pitch = canvas.pitch;
+		convert = canvas.convertOnPresent;
+		for (bufferCount = 0; bufferCount < count; ++bufferCount) {
+			Buffer& buffer = buffers[bufferCount];
+			buffer.capacity = 0;
+			if ((buffer.image = createPresentImage(display, width, height, canvas.xImage->bytes_per_line, buffer.shmInfo, buffer.shared, buffer.capacity)) == nullptr) {
+				return 2;
+			}
+			buffer.pixels = convert ? allocatePixels(length) : (uint8_t*)buffer.image->data;
+			if (buffer.pixels == nullptr) {
+				WC_ERROR("Failed to allocate the pixel buffer.\n");
+				return 2;
+			}
+		}
+#endif
+		// The application keeps drawing into buffer 0, which starts with the
+		// current frame. The others are free.
+		memcpy(buffers[0].pixels, primaryBuffer, length);
+		current = 0;
+		for (uint32_t index = 1; index < bufferCount; ++index) {
+			released.push(index);
+		}
+		releasedCount.post(bufferCount - 1);
+
+		running = true;
+		if (thread.start(run, this) != 0) {
+			WC_ERROR("Failed to start the presenter thread.\n");
+			running = false;
+			return 3;
+		}
+		return 0;
+	}
+
+	// Uploads everything still queued, then ends the thread.
+	void stop() {
+		if (thread.isRunning()) {
+			running = false;
+			submittedCount.post();
+			thread.join();
+		}
+	}
+
+	void uninit() {
+		stop();
+		for (uint32_t index = 0; index < MAX_BUFFER_COUNT; ++index) {
+			Buffer& buffer = buffers[index];
+#if defined(_WIN32)
+			if (buffer.dc) {
+				if (buffer.oldBitmap) {
+					gdi.SelectObject(buffer.dc, buffer.oldBitmap);
+				}
+				if (buffer.bitmap) {
+					gdi.DeleteObject(buffer.bitmap);
+				}
+				gdi.DeleteObject(buffer.dc);
+			}
+#else
+			if (convert) {
+				freePixels(buffer.pixels, length);
+			}
+			destroyPresentImage(display, buffer.image, buffer.shmInfo, buffer.shared, buffer.capacity);
+#endif
+		}
+		memset(buffers, 0, sizeof(buffers));
+		bufferCount = 0;
+#if !defined(_WIN32)
+		if (display != nullptr) {
+			x11.XFreeGC(display, gc);
+			x11.XCloseDisplay(display);
+			display = nullptr;
+		}
+#endif
+	}
+
+	// Application side: queue the current buffer and switch to a free one,
+	// waiting for the presenter if every buffer is in flight.
+	uint8_t* present() {
+		queued.fetch_add(1, std::memory_order_relaxed);
+		submitted.push(current);
+		submittedCount.post();
+
+		releasedCount.wait();
+		released.pop(current);
+		return buffers[current].pixels;
+	}
+
+	void upload(const Buffer& buffer) {
+#if defined(_WIN32)
+		gdi.BitBlt(hdc, 0, 0, width, height, buffer.dc, 0, 0, SRCCOPY);
+		GdiFlush();
+#else
+		if (convert) {
+			convertPixels((uint8_t*)buffer.image->data, buffer.image->bytes_per_line, imageFormat, buffer.pixels, pitch, pixelFormat, width, height);
+		}
+		if (connection != nullptr) {
+			const WindowRect frame(0, 0, width, height);
+			putXcbImage(display, connection, window, gc, buffer.image, buffer.shared, &frame, 1);
+			if (buffer.shared) {
+				x11.XSync(display, False);
+			} else {
+				xcb.xcb_flush(connection);
+			}
+		} else if (buffer.shared) {
+			xext.XShmPutImage(display, window, gc, buffer.image, 0, 0, 0, 0, width, height, False);
+			x11.XSync(display, False);
+		} else {
+			x11.XPutImage(display, window, gc, buffer.image, 0, 0, 0, 0, width, height);
+			x11.XFlush(display);
+		}
+#endif
+	}
+
+	static void run(void* user) {
+		Presenter& presenter = *(Presenter*)user;
+		for (;;) {
+			presenter.submittedCount.wait();
+			uint32_t index;
+			if (!presenter.submitted.pop(index)) {
+				if (!presenter.running) {
+					break;
+				}
+				continue;
+			}
+			presenter.upload(presenter.buffers[index]);
+			presenter.queued.fetch_sub(1, std::memory_order_relaxed);
+			presenter.released.push(index);
+			presenter.releasedCount.post();
+		}
+	}
+};
+
+/******************************************************************************/
+/** Window specific code                                                      */
+/******************************************************************************/
+int WindowCanvas::initialize(uint32_t width, uint32_t height, uint8_t depth, const char* title) {
+	if (depth != 8 && depth != 16 && depth != 24 && depth != 32) {
+		WC_ERROR("Unsupported depth %u.\n", depth);
+		return 1;
+	}
+	if (backend == Headless) {
+		pitch = computeStride(width, depth / 8, rowPadding);
+		pixelBufferLength = pitch * height;
+		if ((pixelBuffer = allocatePixels(pixelBufferLength)) == nullptr) {
+			WC_ERROR("Failed to allocate the pixel buffer.\n");
+			return 1;
+		}
+		bufferCapacity = pixelBufferLength;
+		memset(pixelBuffer, 0, pixelBufferLength);
+#if !defined(_WIN32)
+		if (pipe2(wakePipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+			WC_WARNING("Failed to create the event pipe, getNativeFd() is not available.\n");
+			wakePipe[0] = wakePipe[1] = -1;
+		}
+#endif
+		WC_INFO("Successfully created headless canvas %ux%u.\n", width, height);
+		return 0;
+	}
+#if defined(_WIN32)
+	const DWORD dwstyle = WS_CAPTION | WS_POPUPWINDOW | WS_MINIMIZEBOX | WS_VISIBLE;
+
+	WNDCLASS wc = {};
+	wc.lpfnWndProc   = WindowProc;
+	wc.hInstance     = GetModuleHandle(nullptr);
+	wc.lpszClassName = "Sample Window Class";
+	wc.hCursor       = LoadCursor(nullptr, IDC_ARROW);
+	if (RegisterClass(&wc) == 0) {
+		WC_ERROR("Failed to register class.\n");
+		return 1;
+	}
+
+	RECT r = {0, 0, (LONG)width, (LONG)height};
+	if (AdjustWindowRect(&r, dwstyle, false) == 0) {
+		WC_WARNING("Failed to adjust window bounds.\n");
+	}
+
+	hwnd = CreateWindow(wc.lpszClassName, 
+	                    title,
+	                    dwstyle, 
+	                    0, 0, r.right - r.left, r.bottom - r.top,
+	                    nullptr,
+	                    nullptr,
+	                    wc.hInstance,
+	                    (LPVOID)nullptr);
+	if (hwnd == nullptr) {
+		WC_ERROR("Failed to create window.\n");
+		return 2;
+	}
+
+	SetLastError(0);
+	if (SetWindowLongPtr(hwnd, GWL_USERDATA, (LONG_PTR)this) == 0) {
+		if (GetLastError() != 0) {
+			WC_ERROR("Failed to set window long pointer.\n");
+			return 3;
+		}
+	}
+
+	if ((hdc = GetDC(hwnd)) == 0) {
+		WC_ERROR("Failed to retrieve the device context.\n");
+		return 4;
+	}
+
+	if ((hDCMem = gdi.CreateCompatibleDC(hdc)) == nullptr) {
+		WC_ERROR("Failed to create compatible device context.\n");
+		return 5;
+	}
+
+	// The DIB row length follows its width, so the padding is made of extra
+	// pixels. GDI converts to the screen format.
+	bitmapWidth = computeStride(width, depth / 8, rowPadding) / (depth / 8);
+	bitmapHeight = height;
+	DibInfo bitmapinfo;
+	getDibInfo(bitmapinfo, bitmapWidth, height, depth, palette);
+
+	pitch = bitmapWidth * depth / 8;
+	pixelBufferLength = pitch * height;
+	if ((bitmap = gdi.CreateDIBSection(hDCMem, (const BITMAPINFO*)&bitmapinfo, DIB_RGB_COLORS, (VOID**)&pixelBuffer, nullptr, 0)) == nullptr) {
+		WC_ERROR("Failed to create bitmap.\n");
+		return 6;
+	}
+
+	oldBitmap = gdi.SelectObject(hDCMem, bitmap);
+	
+	ShowWindow(hwnd, SW_SHOW);
+	WC_INFO("Successfully created WIN32 window %ux%u.\n", width, height);
+#else // __linux__
+	static const uint32_t DEFAULT_MARGIN = 5;
+	if (x11.init() != 0) {
+		WC_ERROR("Failed to load libX11.\n");
+		return 1;
+	}
+	if (context != nullptr) {
+		if ((display = context->display) == nullptr) {
+			WC_ERROR("The canvas context has no X server connection.\n");
+			return 1;
+		}
+		xcbQueue.connection = context->xcbQueue.connection;
+	} else if ((display = x11.XOpenDisplay(nullptr)) == nullptr) {
+		WC_ERROR("Failed to connect X server.\n");
+		return 1;
+	} else if (backend == Xcb && openXcbQueue(display, xcbQueue) != 0) {
+		return 1;
+	}
+	if ((window = x11.XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, width, height, DEFAULT_MARGIN, 0, 0)) == None) {
+		WC_ERROR("Failed to create simple window.\n");
+		return 2;
+	}
+	x11.XStoreName(display, window, (char*)title);
+	x11.XSelectInput(display, window, ExposureMask | ButtonPressMask | ButtonReleaseMask | KeyReleaseMask | KeyPressMask | PointerMotionMask | StructureNotifyMask);
+	updateSizeHints();
+
+    wm_delete_window = x11.XInternAtom(display, "WM_DELETE_WINDOW", False);
+    x11.XSetWMProtocols(display, window, &wm_delete_window, 1);
+	x11.XMapRaised(display, window);
+
+	gc = x11.XCreateGC(display, window, 0, 0);
+
+	const uint32_t imageBitsPerPixel = getImageBitsPerPixel(display);
+	if (imageBitsPerPixel == 0) {
+		WC_ERROR("No pixmap format for the default depth.\n");
+		return 3;
+	}
+	pitch = computeStride(width, depth / 8, rowPadding);
+	pixelBufferLength = pitch * height;
+	imageCapacity = 0;
+	if ((xImage = createPresentImage(display, width, height, computeStride(width, imageBitsPerPixel / 8, rowPadding), shmInfo, shmEnabled, imageCapacity)) == nullptr) {
+		return 3;
+	}
+	if (!getImageFormat(xImage, imageFormat)) {
+		return 4;
+	}
+	// Draw straight into the image when the layouts match, convert otherwise.
+	if (imageFormat == pixelFormat && (uint32_t)xImage->bytes_per_line == pitch) {
+		pixelBuffer = (uint8_t*)xImage->data;
+	} else if ((pixelBuffer = allocatePixels(pixelBufferLength)) != nullptr) {
+		bufferCapacity = pixelBufferLength;
+		convertOnPresent = true;
+	} else {
+		WC_ERROR("Failed to allocate the pixel buffer.\n");
+		return 5;
+	}
+	WC_INFO("Successfully created X11 window %ux%u (%s, MIT-SHM %s, %s).\n", width, height, (backend == Xcb) ? "XCB" : "Xlib", shmEnabled ? "on" : "off", convertOnPresent ? "converted" : "zero copy");
+#endif
+	return 0;
+}
+
+int WindowCanvas::uninitialize() {
+	delete tilePool;
+	tilePool = nullptr;
+	delete [] tileHashes;
+	tileHashes = nullptr;
+	tileHashCapacity = 0;
+	if (context != nullptr) {
+		context->removeCanvas(this);
+	}
+	if (backend == Headless) {
+		freePixels(pixelBuffer, bufferCapacity);
+		pixelBuffer = nullptr;
+#if !defined(_WIN32)
+		for (int& fd : wakePipe) {
+			if (fd >= 0) {
+				close(fd);
+				fd = -1;
+			}
+		}
+#endif
+		return 0;
+	}
+	setBufferCount(1);
+	releaseScaleTarget();
+#if defined(_WIN32)
+	if (hDCMem) {
+		if (oldBitmap) {
+			gdi.SelectObject(hDCMem, oldBitmap);
+		}
+		if (bitmap) {
+			gdi.DeleteObject(bitmap);
+		}
+		if (pixelBuffer) {
+			delete [] pixelBuffer;
+		}
+		gdi.DeleteObject(hDCMem);
+		hDCMem = 0;
+	}
+	if (hwnd) {
+		ReleaseDC(hwnd, hdc);
+		DestroyWindow(hwnd);
+		hwnd = 0;
+	}
+#else // __linux__
+	if (convertOnPresent) {
+		freePixels(pixelBuffer, bufferCapacity);
+		convertOnPresent = false;
+	}
+	pixelBuffer = nullptr;
+	if (xImage != nullptr) {
+		destroyPresentImage(display, xImage, shmInfo, shmEnabled, imageCapacity);
+		xImage = nullptr;
+		shmEnabled = false;
+	}
+	if (display != nullptr) {
+		x11.XFreeGC(display, gc);
+		x11.XDestroyWindow(display, window);
+		if (context == nullptr) {
+			x11.XCloseDisplay(display);
+		}
+		display = nullptr;
+		xcbQueue.connection = nullptr;
+	}
+#endif
+	return 0;
+}
+
+static PixelFormat getFormatForDepth(uint8_t depth) {
+	switch (depth) {
+	case 8 :
+		return PixelFormatIndex8;
+	case 16 :
+		return PixelFormatRGB565;
+	case 24 :
+		return PixelFormatRGB888;
+	default :
+		return PixelFormatXRGB8888;
+	}
+}
+
+// Resolves Default through the WCANVAS_BACKEND environment variable, then
+// the WCANVAS_XCB build flag.
+static WindowCanvas::Backend resolveBackend(WindowCanvas::Backend backend) {
+#if defined(_WIN32)
+	if (backend == WindowCanvas::Xcb) {
+		return WindowCanvas::Native;
+	}
+#endif
+	if (backend != WindowCanvas::Default) {
+		return backend;
+	}
+	const char* name = getenv("WCANVAS_BACKEND");
+	if (name != nullptr && strcmp(name, "headless") == 0) {
+		return WindowCanvas::Headless;
+	}
+#if defined(__linux__)
+	if (name != nullptr && strcmp(name, "xcb") == 0) {
+		return WindowCanvas::Xcb;
+	}
+#if defined(WCANVAS_XCB)
+	if (name == nullptr || strcmp(name, "xlib") != 0) {
+		return WindowCanvas::Xcb;
+	}
+#endif
+#endif
+	return WindowCanvas::Native;
+}
+
+WindowCanvas::WindowCanvas(uint32_t width, uint32_t height, uint8_t depth, const char* title, Backend backend)
+	: WindowCanvas(nullptr, width, height, depth, title, backend) {
+}
+
+WindowCanvas::WindowCanvas(CanvasContext& context, uint32_t width, uint32_t height, uint8_t depth, const char* title)
+	: WindowCanvas(&context, width, height, depth, title, context.getBackend()) {
+}
+
+WindowCanvas::WindowCanvas(CanvasContext* context, uint32_t width, uint32_t height, uint8_t depth, const char* title, Backend backend)
+	: width(width), height(height), depth(depth), pixelBuffer(nullptr), pixelBufferLength(0), pitch(0), pixelFormat(getFormatForDepth(depth)), dirtyRectCount(0), presenter(nullptr), coalesceEvents(false)
+	, backend(resolveBackend(backend)), frameSink(nullptr), frameSinkUser(nullptr), injectedHead(0), injectedCount(0), tilePool(nullptr), context(context)
+	, resizable(false), resizePending(false), pendingWidth(0), pendingHeight(0), bufferCapacity(0), rowPadding(AUTO_ROW_PADDING)
+	, windowWidth(width), windowHeight(height), fixedRenderSize(false), scaleFilter(ScaleNearest), recorder(nullptr)
+	, damageDetection(false), tileHashesValid(false), tileHashes(nullptr), tileHashCapacity(0)
+	, pendingInputTime(0), submitTime(0), completeTime(0), presentSync(false), latencyHead(0), latencyCount(0)
+#if defined(__linux__)
+	, display(nullptr), window(0), gc(0), xImage(nullptr), shmEnabled(false), imageFormat(PixelFormatXRGB8888), convertOnPresent(false), imageCapacity(0)
+	, scaleImage(nullptr), scaleShared(false), scaleCapacity(0), wakePipe{-1, -1}, xcbQueue()
+#elif defined (_WIN32)
+	, hwnd(0), hdc(0), hDCMem(0), bitmap(0), oldBitmap(0), bitmapWidth(0), bitmapHeight(0)
+	, scaleDC(0), scaleBitmap(0), scaleOldBitmap(0), scaleBits(nullptr), scaleBitmapWidth(0), scaleBitmapHeight(0), eventPtr(nullptr)
+#endif
+{
+	for (uint32_t index = 0; index < 256; ++index) {
+		palette[index] = index * 0x010101;
+	}
+	if (initialize(width, height, depth, title) == 0 && context != nullptr && !context->addCanvas(this)) {
+		WC_ERROR("The canvas context is full.\n");
+		uninitialize();
+	}
+}
+
+WindowCanvas::~WindowCanvas() {
+	uninitialize();
+}
+
+uint32_t WindowCanvas::getWidth() const {
+	return width;
+}
+
+uint32_t WindowCanvas::getHeight() const {
+	return height;
+}
+
+uint32_t WindowCanvas::getWindowWidth() const {
+	return windowWidth;
+}
+
+uint32_t WindowCanvas::getWindowHeight() const {
+	return windowHeight;
+}
+
+uint32_t WindowCanvas::getDepth() const {
+	return depth;
+}
+
+WindowCanvas::Backend WindowCanvas::getBackend() const {
+	return backend;
+}
+
+void WindowCanvas::setTitle(const char* title) {
+	if (backend == Headless) {
+		return;
+	}
+#if defined(_WIN32)
+	SetWindowText(hwnd, title);
+#else // __linux__
+	x11.XStoreName(display, window, (char*)title);
+#endif
+}
+
+const char* WindowCanvas::getTitle() const {
+	if (backend == Headless) {
+		return "";
+	}
+#if defined(_WIN32)
+	static char title[128];
+	return (GetWindowText(hwnd, title, sizeof(title)) > 0) ? title : "";
+#else // __linux__
+	assert(!"Not implemented");
+#endif
+	return "";
+}
+
+// Capacity for at least 'required' bytes, growing by half at a time so that
+// a window dragged bigger reallocates only a few times.
+static uint32_t growCapacity(uint32_t capacity, uint32_t required) {
+	if (required <= capacity) {
+		return capacity;
+	}
+	const uint64_t grown = (uint64_t)capacity + capacity / 2;
+	return (grown > required && grown <= UINT32_MAX) ? (uint32_t)grown : required;
+}
+
+#if defined(__linux__)
+// Pin the window to the canvas size unless it is resizable.
+void WindowCanvas::updateSizeHints() {
+	XSizeHints sizeHints;
+	memset(&sizeHints, 0, sizeof(sizeHints));
+	if (x11.XGetWMNormalHints(display, window, &sizeHints, nullptr) == 0) {
+		WC_WARNING("Failed to get normal hints.\n");
+	}
+	if (resizable) {
+		sizeHints.flags = (sizeHints.flags | PMinSize) & ~PMaxSize;
+		sizeHints.min_width = 1;
+		sizeHints.min_height = 1;
+	} else {
+		sizeHints.flags |= PMinSize | PMaxSize;
+		sizeHints.min_width = windowWidth;
+		sizeHints.max_width = windowWidth;
+		sizeHints.min_height = windowHeight;
+		sizeHints.max_height = windowHeight;
+	}
+	x11.XSetWMNormalHints(display, window, &sizeHints);
+}
+#endif
+
+void WindowCanvas::setResizable(bool resizable) {
+	this->resizable = resizable;
+	if (backend == Headless) {
+		return;
+	}
+#if defined(_WIN32)
+	LONG_PTR style = GetWindowLongPtr(hwnd, GWL_STYLE);
+	if (resizable) {
+		style |= WS_THICKFRAME | WS_MAXIMIZEBOX;
+	} else {
+		style &= ~(LONG_PTR)(WS_THICKFRAME | WS_MAXIMIZEBOX);
+	}
+	SetWindowLongPtr(hwnd, GWL_STYLE, style);
+	// The frame changes size, keep the client area.
+	RECT r = {0, 0, (LONG)windowWidth, (LONG)windowHeight};
+	AdjustWindowRect(&r, (DWORD)style, false);
+	SetWindowPos(hwnd, nullptr, 0, 0, r.right - r.left, r.bottom - r.top, SWP_NOMOVE | SWP_NOZORDER | SWP_FRAMECHANGED);
+#else // __linux__
+	updateSizeHints();
+#endif
+}
+
+bool WindowCanvas::isResizable() const {
+	return resizable;
+}
+
+uint32_t WindowCanvas::getStride() const {
+	return pitch;
+}
+
+int WindowCanvas::setRowPadding(uint32_t bytes) {
+	rowPadding = bytes;
+	return resizeBuffers(width, height);
+}
+
+int WindowCanvas::setSize(uint32_t width, uint32_t height) {
+	if (width == 0 || height == 0) {
+		WC_ERROR("Invalid canvas size %ux%u.\n", width, height);
+		return 1;
+	}
+	if (width == windowWidth && height == windowHeight) {
+		return 0;
+	}
+	const int result = updateWindowSize(width, height);
+	if (result != 0 || backend == Headless) {
+		return result;
+	}
+#if defined(_WIN32)
+	RECT r = {0, 0, (LONG)width, (LONG)height};
+	AdjustWindowRect(&r, (DWORD)GetWindowLongPtr(hwnd, GWL_STYLE), false);
+	SetWindowPos(hwnd, nullptr, 0, 0, r.right - r.left, r.bottom - r.top, SWP_NOMOVE | SWP_NOZORDER);
+#else // __linux__
+	updateSizeHints();
+	x11.XResizeWindow(display, window, width, height);
+#endif
+	return 0;
+}
+
+int WindowCanvas::resizeBuffers(uint32_t width, uint32_t height) {
+	waitTiles();
+	// The presenter buffers have the old size, restart it around the change.
+	const uint32_t bufferCount = getBufferCount();
+	if (bufferCount > 1) {
+		setBufferCount(1);
+	}
+	const int result = reallocateBuffers(width, height);
+	if (bufferCount > 1) {
+		setBufferCount(bufferCount);
+	}
+	return result;
+}
+
+// Point the pixel buffer at a 'width' x 'height' frame, reusing the current
+// allocations when they are big enough. Nothing changes on failure.
+int WindowCanvas::reallocateBuffers(uint32_t width, uint32_t height) {
+	const uint32_t bytesPerPixel = getBytesPerPixel(pixelFormat);
+	const uint32_t newPitch = computeStride(width, bytesPerPixel, rowPadding);
+	if (backend == Headless) {
+		const uint32_t length = newPitch * height;
+		if (length > bufferCapacity) {
+			const uint32_t capacity = growCapacity(bufferCapacity, length);
+			uint8_t* buffer = allocatePixels(capacity);
+			if (buffer == nullptr) {
+				WC_ERROR("Failed to allocate the pixel buffer.\n");
+				return 2;
+			}
+			freePixels(pixelBuffer, bufferCapacity);
+			pixelBuffer = buffer;
+			bufferCapacity = capacity;
+		}
+		pitch = newPitch;
+	} else {
+#if defined(_WIN32)
+		// The DIB rows are as long as the bitmap, so only growing reallocates.
+		const uint32_t rowWidth = newPitch / bytesPerPixel;
+		if (rowWidth > bitmapWidth || height > bitmapHeight) {
+			const uint32_t allocWidth = computeStride(growCapacity(bitmapWidth, rowWidth), bytesPerPixel, 0) / bytesPerPixel;
+			const uint32_t allocHeight = growCapacity(bitmapHeight, height);
+			DibInfo bitmapinfo;
+			getDibInfo(bitmapinfo, allocWidth, allocHeight, depth, palette);
+			uint8_t* bits = nullptr;
+			HBITMAP newBitmap = gdi.CreateDIBSection(hDCMem, (const BITMAPINFO*)&bitmapinfo, DIB_RGB_COLORS, (VOID**)&bits, nullptr, 0);
+			if (newBitmap == nullptr) {
+				WC_ERROR("Failed to create bitmap.\n");
+				return 2;
+			}
+			gdi.SelectObject(hDCMem, newBitmap);
+			gdi.DeleteObject(bitmap);
+			bitmap = newBitmap;
+			pixelBuffer = bits;
+			bitmapWidth = allocWidth;
+			bitmapHeight = allocHeight;
+			pitch = allocWidth * bytesPerPixel;
+		}
+#else // __linux__
+		const uint32_t imagePitch = computeStride(width, xImage->bits_per_pixel / 8, rowPadding);
+		const bool reuseImage = (imagePitch * height <= imageCapacity);
+
+		XImage* image = xImage;
+		XShmSegmentInfo newShmInfo = shmInfo;
+		bool shared = shmEnabled;
+		uint32_t capacity = imageCapacity;
+		if (!reuseImage) {
+			capacity = growCapacity(imageCapacity, imagePitch * height);
+			if ((image = createPresentImage(display, width, height, imagePitch, newShmInfo, shared, capacity)) == nullptr) {
+				return 2;
+			}
+		}
+
+		const bool zeroCopy = (imageFormat == pixelFormat && imagePitch == newPitch);
+		uint8_t* buffer = zeroCopy ? (uint8_t*)image->data : pixelBuffer;
+		uint32_t newBufferCapacity = zeroCopy ? 0 : bufferCapacity;
+		if (!zeroCopy && (!convertOnPresent || newPitch * height > bufferCapacity)) {
+			newBufferCapacity = convertOnPresent ? growCapacity(bufferCapacity, newPitch * height) : newPitch * height;
+			if ((buffer = allocatePixels(newBufferCapacity)) == nullptr) {
+				WC_ERROR("Failed to allocate the pixel buffer.\n");
+				if (!reuseImage) {
+					destroyPresentImage(display, image, newShmInfo, shared, capacity);
+				}
+				return 3;
+			}
+		}
+
+		if (convertOnPresent && buffer != pixelBuffer) {
+			freePixels(pixelBuffer, bufferCapacity);
+		}
+		if (reuseImage) {
+			// Only the header describes the size, the data is reinterpreted.
+			setImageLayout(xImage, shmEnabled, width, height, imagePitch);
+		} else {
+			destroyPresentImage(display, xImage, shmInfo, shmEnabled, imageCapacity);
+			xImage = image;
+			shmInfo = newShmInfo;
+			shmEnabled = shared;
+			imageCapacity = capacity;
+			if (shmEnabled) {
+				// XShmPutImage finds the segment through the image.
+				xImage->obdata = (char*)&shmInfo;
+			}
+		}
+		pixelBuffer = buffer;
+		bufferCapacity = newBufferCapacity;
+		convertOnPresent = !zeroCopy;
+		pitch = newPitch;
+#endif
+	}
+	this->width = width;
+	this->height = height;
+	pixelBufferLength = pitch * height;
+	dirtyRectCount = 0;
+	tileHashesValid = false;
+	return 0;
+}
+
+// Apply the last size reported by the window system and describe it in
+// 'event'. Returns false if there is nothing to report.
+bool WindowCanvas::applyPendingResize(WindowEvent& event) {
+	if (!resizePending) {
+		return false;
+	}
+	resizePending = false;
+	if (pendingWidth == 0 || pendingHeight == 0 || (pendingWidth == windowWidth && pendingHeight == windowHeight)) {
+		return false;
+	}
+	if (updateWindowSize(pendingWidth, pendingHeight) != 0) {
+		return false;
+	}
+	event.type = WindowEvent::Resized;
+	event.width = windowWidth;
+	event.height = windowHeight;
+	event.time = 0;
+	event.receiveTime = getMonotonicTime();
+	return true;
+}
+
+// Follow a new window size with the pixel buffer, or with the scaled image
+// when the render size is fixed.
+int WindowCanvas::updateWindowSize(uint32_t width, uint32_t height) {
+	if (!fixedRenderSize) {
+		const int result = resizeBuffers(width, height);
+		if (result != 0) {
+			return result;
+		}
+	}
+	windowWidth = width;
+	windowHeight = height;
+	return updateScaleTarget();
+}
+
+int WindowCanvas::setRenderSize(uint32_t width, uint32_t height, ScaleFilter filter) {
+	if ((width == 0) != (height == 0)) {
+		WC_ERROR("Invalid render size %ux%u.\n", width, height);
+		return 1;
+	}
+	if (getBufferCount() > 1) {
+		WC_ERROR("A render size needs a single buffer.\n");
+		return 2;
+	}
+	if (width != 0 && pixelFormat == PixelFormatIndex8) {
+		WC_ERROR("8 bit canvases can't be scaled.\n");
+		return 2;
+	}
+	const bool fixed = (width != 0);
+	if (!fixed) {
+		width = windowWidth;
+		height = windowHeight;
+	}
+	if (width != this->width || height != this->height) {
+		const int result = resizeBuffers(width, height);
+		if (result != 0) {
+			return result;
+		}
+	}
+	fixedRenderSize = fixed;
+	scaleFilter = filter;
+	if (updateScaleTarget() != 0) {
+		// Present unscaled rather than not at all.
+		fixedRenderSize = false;
+		return 3;
+	}
+	return 0;
+}
+
+bool WindowCanvas::isScaled() const {
+	return fixedRenderSize && backend != Headless && (width != windowWidth || height != windowHeight);
+}
+
+// Size the window image the frame is scaled into, reusing the allocation
+// while it is big enough. Released when the render size is cleared.
+int WindowCanvas::updateScaleTarget() {
+	if (!fixedRenderSize) {
+		releaseScaleTarget();
+		return 0;
+	}
+	if (!isScaled()) {
+		return 0;
+	}
+#if defined(_WIN32)
+	const uint32_t bytesPerPixel = depth / 8;
+	const uint32_t rowWidth = computeStride(windowWidth, bytesPerPixel, rowPadding) / bytesPerPixel;
+	if (rowWidth > scaleBitmapWidth || windowHeight > scaleBitmapHeight) {
+		const uint32_t allocWidth = computeStride(growCapacity(scaleBitmapWidth, rowWidth), bytesPerPixel, 0) / bytesPerPixel;
+		const uint32_t allocHeight = growCapacity(scaleBitmapHeight, windowHeight);
+		if (scaleDC == nullptr && (scaleDC = gdi.CreateCompatibleDC(hdc)) == nullptr) {
+			WC_ERROR("Failed to create compatible device context.\n");
+			return 1;
+		}
+		DibInfo bitmapinfo;
+		getDibInfo(bitmapinfo, allocWidth, allocHeight, depth, palette);
+		uint8_t* bits = nullptr;
+		HBITMAP newBitmap = gdi.CreateDIBSection(scaleDC, (const BITMAPINFO*)&bitmapinfo, DIB_RGB_COLORS, (VOID**)&bits, nullptr, 0);
+		if (newBitmap == nullptr) {
+			WC_ERROR("Failed to create bitmap.\n");
+			return 2;
+		}
+		HGDIOBJ previous = gdi.SelectObject(scaleDC, newBitmap);
+		if (scaleBitmap != nullptr) {
+			gdi.DeleteObject(scaleBitmap);
+		} else {
+			scaleOldBitmap = previous;
+		}
+		scaleBitmap = newBitmap;
+		scaleBits = bits;
+		scaleBitmapWidth = allocWidth;
+		scaleBitmapHeight = allocHeight;
+	}
+#else // __linux__
+	const uint32_t imagePitch = computeStride(windowWidth, xImage->bits_per_pixel / 8, rowPadding);
+	if (scaleImage != nullptr && imagePitch * windowHeight <= scaleCapacity) {
+		setImageLayout(scaleImage, scaleShared, windowWidth, windowHeight, imagePitch);
+		return 0;
+	}
+	XShmSegmentInfo newShmInfo;
+	bool shared = false;
+	uint32_t capacity = growCapacity(scaleCapacity, imagePitch * windowHeight);
+	XImage* image = createPresentImage(display, windowWidth, windowHeight, imagePitch, newShmInfo, shared, capacity);
+	if (image == nullptr) {
+		return 2;
+	}
+	releaseScaleTarget();
+	scaleImage = image;
+	scaleShmInfo = newShmInfo;
+	scaleShared = shared;
+	scaleCapacity = capacity;
+	if (scaleShared) {
+		scaleImage->obdata = (char*)&scaleShmInfo;
+	}
+#endif
+	return 0;
+}
+
+void WindowCanvas::releaseScaleTarget() {
+#if defined(_WIN32)
+	if (scaleDC) {
+		if (scaleOldBitmap) {
+			gdi.SelectObject(scaleDC, scaleOldBitmap);
+		}
+		if (scaleBitmap) {
+			gdi.DeleteObject(scaleBitmap);
+		}
+		gdi.DeleteObject(scaleDC);
+	}
+	scaleDC = 0;
+	scaleBitmap = 0;
+	scaleOldBitmap = 0;
+	scaleBits = nullptr;
+	scaleBitmapWidth = 0;
+	scaleBitmapHeight = 0;
+#else // __linux__
+	if (scaleImage != nullptr) {
+		destroyPresentImage(display, scaleImage, scaleShmInfo, scaleShared, scaleCapacity);
+		scaleImage = nullptr;
+	}
+	scaleShared = false;
+	scaleCapacity = 0;
+#endif
+}
+
+uint8_t* WindowCanvas::getPixelBuffer() const {
+	return pixelBuffer;
+}
+
+uint32_t WindowCanvas::getPixelBufferLength() const {
+	return pixelBufferLength;
+}
+bool WindowCanvas::injectEvent(const WindowEvent& event) {
+	if (injectedCount == MAX_INJECTED_EVENTS) {
+		return false;
+	}
+	WindowEvent& queued = injectedEvents[(injectedHead + injectedCount) % MAX_INJECTED_EVENTS];
+	queued = event;
+	if (queued.receiveTime == 0) {
+		queued.receiveTime = getMonotonicTime();
+	}
+#if !defined(_WIN32)
+	// The pipe holds one byte while the queue is not empty.
+	if (injectedCount == 0 && wakePipe[1] >= 0) {
+		const char signal = 0;
+		if (write(wakePipe[1], &signal, 1) != 1) {
+			WC_WARNING("Failed to signal the event pipe.\n");
+		}
+	}
+#endif
+	++injectedCount;
+	return true;
+}
+
+bool WindowCanvas::postEvent(const WindowEvent& event) {
+	if (backend == Headless) {
+		return injectEvent(event);
+	}
+#if defined(_WIN32)
+	UINT message = 0;
+	WPARAM wParam = 0;
+	LPARAM lParam = 0;
+	switch (event.type) {
+	case WindowEvent::WindowClose :
+		message = WM_CLOSE;
+		break;
+	case WindowEvent::KeyPressed :
+		message = WM_KEYDOWN;
+		wParam = event.keyCode;
+		break;
+	case WindowEvent::KeyReleased :
+		message = WM_KEYUP;
+		wParam = event.keyCode;
+		break;
+	case WindowEvent::CursorMove :
+		message = WM_MOUSEMOVE;
+		lParam = MAKELPARAM(event.x, event.y);
+		break;
+	case WindowEvent::ButtonPressed :
+	case WindowEvent::ButtonReleased :
+		switch (event.button) {
+		case 1 :
+			message = (event.type == WindowEvent::ButtonPressed) ? WM_LBUTTONDOWN : WM_LBUTTONUP;
+			break;
+		case 2 :
+			message = (event.type == WindowEvent::ButtonPressed) ? WM_MBUTTONDOWN : WM_MBUTTONUP;
+			break;
+		case 3 :
+			message = (event.type == WindowEvent::ButtonPressed) ? WM_RBUTTONDOWN : WM_RBUTTONUP;
+			break;
+		}
+		break;
+	case WindowEvent::WheelUp :
+	case WindowEvent::WheelDown :
+		message = WM_MOUSEWHEEL;
+		wParam = MAKEWPARAM(0, (event.type == WindowEvent::WheelUp) ? WHEEL_DELTA : -WHEEL_DELTA);
+		break;
+	default :
+		break;
+	}
+	if (message == 0) {
+		return false;
+	}
+	return PostMessage(hwnd, message, wParam, lParam) != 0;
+#else // __linux__
+	XEvent xEvent;
+	memset(&xEvent, 0, sizeof(xEvent));
+	xEvent.xany.display = display;
+	xEvent.xany.window = window;
+	switch (event.type) {
+	case WindowEvent::WindowClose :
+		xEvent.type = ClientMessage;
+		xEvent.xclient.message_type = x11.XInternAtom(display, "WM_PROTOCOLS", False);
+		xEvent.xclient.format = 32;
+		xEvent.xclient.data.l[0] = wm_delete_window;
+		break;
+	case WindowEvent::KeyPressed :
+	case WindowEvent::KeyReleased :
+		xEvent.type = (event.type == WindowEvent::KeyPressed) ? KeyPress : KeyRelease;
+		xEvent.xkey.keycode = event.keyCode;
+		xEvent.xkey.same_screen = True;
+		break;
+	case WindowEvent::CursorMove :
+		xEvent.type = MotionNotify;
+		xEvent.xmotion.x = event.x;
+		xEvent.xmotion.y = event.y;
+		xEvent.xmotion.same_screen = True;
+		break;
+	case WindowEvent::ButtonPressed :
+	case WindowEvent::ButtonReleased :
+	case WindowEvent::WheelUp :
+	case WindowEvent::WheelDown :
+		xEvent.type = (event.type == WindowEvent::ButtonReleased) ? ButtonRelease : ButtonPress;
+		if (event.type == WindowEvent::WheelUp) {
+			xEvent.xbutton.button = Button4;
+		} else if (event.type == WindowEvent::WheelDown) {
+			xEvent.xbutton.button = Button5;
+		} else {
+			xEvent.xbutton.button = event.button;
+		}
+		xEvent.xbutton.same_screen = True;
+		break;
+	default :
+		return false;
+	}
+	// An empty mask delivers the event to the client owning the window, i.e.
+	// this one. The request is flushed by the next event poll.
+	return x11.XSendEvent(display, window, False, 0, &xEvent) != 0;
+#endif
+}
+
+bool WindowCanvas::popInjectedEvent(WindowEvent& event) {
+	if (injectedCount == 0) {
+		return false;
+	}
+	event = injectedEvents[injectedHead];
+	injectedHead = (injectedHead + 1) % MAX_INJECTED_EVENTS;
+	--injectedCount;
+#if !defined(_WIN32)
+	if (injectedCount == 0 && wakePipe[0] >= 0) {
+		char signal;
+		while (read(wakePipe[0], &signal, 1) == 1) {
+		}
+	}
+#endif
+	return true;
+}
+
+bool WindowCanvas::getEvent(WindowEvent& event) {
+	if (!readEvent(event)) {
+		return false;
+	}
+	trackInput(event);
+	return true;
+}
+
+bool WindowCanvas::readEvent(WindowEvent& event) {
+	if (popInjectedEvent(event)) {
+		return true;
+	}
+	if (backend == Headless) {
+		return false;
+	}
+	if (context != nullptr) {
+		// The shared connection carries the events of every window.
+		context->pumpEvents();
+		return popInjectedEvent(event);
+	}
+	bool ans = false;
+#if defined(_WIN32)
+    MSG msg;
+	if (PeekMessage(&msg, hwnd, 0, 0, 0)) {
+		GetMessage(&msg, hwnd, 0, 0);
+		eventPtr = &event;
+		eventPtr->type = WindowEvent::Unknown;
+		
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+		eventPtr = nullptr;
+		
+		ans = (event.type != WindowEvent::Unknown);
+    } else {
+		ans = applyPendingResize(event);
+	}
+#else // __linux__
+	XEvent xEvent;
+	if (backend == Xcb) {
+		xcb.xcb_flush(xcbQueue.connection);
+		if (nextXcbEvent(display, xcbQueue, xEvent, true)) {
+			ans = translateEvent(xEvent, event);
+		} else {
+			ans = applyPendingResize(event);
+		}
+	} else if (x11.XPending(display) > 0) {
+		x11.XNextEvent(display, &xEvent);
+		ans = translateEvent(xEvent, event);
+	} else {
+		ans = applyPendingResize(event);
+	}
+#endif
+	return ans;
+}
+
+#if defined(__linux__)
+// An auto-repeated key arrives as a release immediately followed by a press
+// with the same keycode and timestamp. Drops the press and returns true so
+// that the caller drops the release.
+static bool skipAutoRepeat(Display* display, const XEvent& xEvent, int& pending) {
+	if (xEvent.type != KeyRelease || pending == 0) {
+		return false;
+	}
+	XEvent next;
+	x11.XPeekEvent(display, &next);
+	if (next.type != KeyPress || next.xkey.window != xEvent.xkey.window || next.xkey.keycode != xEvent.xkey.keycode || next.xkey.time != xEvent.xkey.time) {
+		return false;
+	}
+	x11.XNextEvent(display, &next);
+	--pending;
+	return true;
+}
+
+// Same as skipAutoRepeat() for an XCB owned queue.
+static bool skipXcbAutoRepeat(Display* display, XcbEventQueue& queue, const XEvent& xEvent) {
+	XEvent next;
+	if (xEvent.type != KeyRelease || !peekXcbEvent(display, queue, next)) {
+		return false;
+	}
+	if (next.type != KeyPress || next.xkey.window != xEvent.xkey.window || next.xkey.keycode != xEvent.xkey.keycode || next.xkey.time != xEvent.xkey.time) {
+		return false;
+	}
+	queue.hasHeld = false;
+	return true;
+}
+#endif
+
+// Block until the native queue may hold events or 'timeoutMs' passes.
+// Returns false if waiting failed.
+bool WindowCanvas::waitNative(int timeoutMs) {
+#if defined(_WIN32)
+	const DWORD timeout = (timeoutMs < 0) ? INFINITE : (DWORD)timeoutMs;
+	if (backend == Headless) {
+		// Nothing but injectEvent() can produce events.
+		Sleep(timeout);
+		return true;
+	}
+	return MsgWaitForMultipleObjectsEx(0, nullptr, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE) != WAIT_FAILED;
+#else // __linux__
+	// poll() does not see events Xlib or XCB already read from the socket.
+	if (backend == Xcb) {
+		// A shared connection has its event queue in the context.
+		XcbEventQueue& queue = (context != nullptr) ? context->xcbQueue : xcbQueue;
+		XEvent next;
+		xcb.xcb_flush(queue.connection);
+		if (peekXcbEvent(display, queue, next)) {
+			return true;
+		}
+	} else if (backend != Headless && x11.XEventsQueued(display, QueuedAfterFlush) > 0) {
+		return true;
+	}
+	pollfd fd;
+	fd.fd = getNativeFd();
+	fd.events = POLLIN;
+	fd.revents = 0;
+	if (fd.fd < 0) {
+		return false;
+	}
+	return poll(&fd, 1, timeoutMs) >= 0 || errno == EINTR;
+#endif
+}
+
+bool WindowCanvas::waitEvent(WindowEvent& event, int timeoutMs) {
+	const uint64_t deadline = getMonotonicTime() + (uint64_t)(timeoutMs > 0 ? timeoutMs : 0) * 1000000ull;
+	for (;;) {
+		if (getEvent(event)) {
+			return true;
+		}
+		int remaining = -1;
+		if (timeoutMs >= 0) {
+			const uint64_t now = getMonotonicTime();
+			if (now >= deadline) {
+				return false;
+			}
+			remaining = (int)((deadline - now + 999999) / 1000000);
+		}
+		if (!waitNative(remaining)) {
+			WC_ERROR("Failed to wait for events.\n");
+			return false;
+		}
+	}
+}
+
+int WindowCanvas::getNativeFd() const {
+#if defined(_WIN32)
+	return -1;
+#else // __linux__
+	if (backend == Headless) {
+		return wakePipe[0];
+	}
+	return (display != nullptr) ? ConnectionNumber(display) : -1;
+#endif
+}
+
+// Append 'event' to the batch, folding it into the previous cursor move
+// when coalescing is enabled.
+static void appendEvent(WindowEvent* events, uint32_t& count, const WindowEvent& event, bool coalesce) {
+	if (coalesce && count > 0 && event.type == WindowEvent::CursorMove && events[count - 1].type == WindowEvent::CursorMove) {
+		const uint64_t receiveTime = events[count - 1].receiveTime;
+		events[count - 1] = event;
+		events[count - 1].receiveTime = receiveTime;
+		return;
+	}
+	events[count++] = event;
+}
+
+uint32_t WindowCanvas::pollEvents(WindowEvent* events, uint32_t maxCount) {
+	const uint32_t count = readEvents(events, maxCount);
+	for (uint32_t index = 0; index < count; ++index) {
+		trackInput(events[index]);
+	}
+	return count;
+}
+
+uint32_t WindowCanvas::readEvents(WindowEvent* events, uint32_t maxCount) {
+	uint32_t count = 0;
+	WindowEvent event;
+	while (count < maxCount && popInjectedEvent(event)) {
+		appendEvent(events, count, event, coalesceEvents);
+	}
+	if (backend == Headless) {
+		return count;
+	}
+	if (context != nullptr) {
+		context->pumpEvents();
+		while (count < maxCount && popInjectedEvent(event)) {
+			appendEvent(events, count, event, coalesceEvents);
+		}
+		return count;
+	}
+#if defined(_WIN32)
+	MSG msg;
+	while (count < maxCount && PeekMessage(&msg, hwnd, 0, 0, PM_REMOVE)) {
+		eventPtr = &event;
+		eventPtr->type = WindowEvent::Unknown;
+
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+		eventPtr = nullptr;
+
+		if (event.type != WindowEvent::Unknown) {
+			appendEvent(events, count, event, coalesceEvents);
+		}
+	}
+#else // __linux__
+	XEvent xEvent;
+	if (backend == Xcb) {
+		xcb.xcb_flush(xcbQueue.connection);
+		// Read the connection at most once, then only drain what XCB queued.
+		bool read = true;
+		while (count < maxCount && nextXcbEvent(display, xcbQueue, xEvent, read)) {
+			read = false;
+			if (coalesceEvents && skipXcbAutoRepeat(display, xcbQueue, xEvent)) {
+				continue;
+			}
+			if (translateEvent(xEvent, event)) {
+				appendEvent(events, count, event, coalesceEvents);
+			}
+		}
+	}
+	// Read the connection once, then only drain what Xlib already queued.
+	int pending = (backend == Xcb) ? 0 : x11.XEventsQueued(display, QueuedAfterReading);
+	while (count < maxCount && pending > 0) {
+		x11.XNextEvent(display, &xEvent);
+		--pending;
+
+		if (coalesceEvents && skipAutoRepeat(display, xEvent, pending)) {
+			continue;
+		}
+
+		if (translateEvent(xEvent, event)) {
+			appendEvent(events, count, event, coalesceEvents);
+		}
+		if (pending == 0) {
+			pending = x11.XEventsQueued(display, QueuedAlready);
+		}
+	}
+#endif
+	if (count < maxCount && applyPendingResize(event)) {
+		appendEvent(events, count, event, coalesceEvents);
+	}
+	return count;
+}
+
+void WindowCanvas::setEventCoalescing(bool enabled) {
+	coalesceEvents = enabled;
+}
+
+#if defined(__linux__)
+bool WindowCanvas::translateEvent(XEvent& xEvent, WindowEvent& event) {
+	bool ans = false;
+	KeySym key;
+	char text[32];
+	event.time = 0;
+	event.receiveTime = getMonotonicTime();
+	switch (xEvent.type) {
+	case ClientMessage:
+		if((Atom)xEvent.xclient.data.l[0] == wm_delete_window) {
+			event.type = WindowEvent::WindowClose;
+			ans = true;
+		}
+		break;
+	case KeyPress :
+		event.type = WindowEvent::KeyPressed;
+		event.keyCode = xEvent.xkey.keycode;
+		event.time = xEvent.xkey.time;
+		if (x11.XLookupString(&xEvent.xkey, text, sizeof(text), &key, 0) == 1) {
+			switch (text[0]) {
+			case 0x1B : // escape
+			case 0x08 : // backspace
+			case 0x7F : // delete
+				event.ascii = '\0';
+				break;
+			case 0xD :
+				event.ascii = '\n';
+				break;
+			default :
+				event.ascii = text[0];
+				break;
+			}
+		} else {
+			event.ascii = '\0';
+		}
+		ans = true;
+		break;
+	case KeyRelease :
+		event.type = WindowEvent::KeyReleased;
+		event.keyCode = xEvent.xkey.keycode;
+		event.time = xEvent.xkey.time;
+		ans = true;
+		break;
+	case MotionNotify :
+		event.type = WindowEvent::CursorMove;
+		event.x = xEvent.xmotion.x;
+		event.y = xEvent.xmotion.y;
+		event.time = xEvent.xmotion.time;
+		ans = true;
+		break;
+	case ButtonPress:
+		event.time = xEvent.xbutton.time;
+		switch (xEvent.xbutton.button) {
+		case Button4 :
+			event.type = WindowEvent::WheelUp;
+			break;
+		case Button5 :
+			event.type = WindowEvent::WheelDown;
+			break;
+		default :
+			event.type = WindowEvent::ButtonPressed;
+			event.button = xEvent.xbutton.button;
+			break;
+		}
+		ans = true;
+		break;
+	case ButtonRelease:
+		event.time = xEvent.xbutton.time;
+		switch (xEvent.xbutton.button) {
+		case Button4 :
+		case Button5 :
+			break;
+		default :
+			event.type = WindowEvent::ButtonReleased;
+			event.button = xEvent.xbutton.button;
+			ans = true;
+			break;
+		}
+		break;
+	case Expose :
+		// The server lost the window content, the next frame is sent whole.
+		tileHashesValid = false;
+		break;
+	case ConfigureNotify :
+		// Only the last size of a burst is applied, see applyPendingResize().
+		if (resizable) {
+			pendingWidth = xEvent.xconfigure.width;
+			pendingHeight = xEvent.xconfigure.height;
+			resizePending = true;
+		}
+		break;
+	}
+	return ans;
+}
+#endif
+
+void WindowCanvas::clear() {
+#if defined(_WIN32)
+	// gdi.ExtFloodFill(hdc, 0, 0, RGB(0, 0, 0), FLOODFILLSURFACE);
+#endif
+	memset(pixelBuffer, 0, pixelBufferLength);
+}
+
+void WindowCanvas::clear(uint32_t color) {
+	if (depth == 8) {
+		memset(pixelBuffer, color & 0xFF, pixelBufferLength);
+	} else if (depth == 32) {
+		// Filling the row padding as well keeps this a single span.
+		const Kernels& kernels = getKernels();
+		if (pixelBufferLength >= KERNEL_STREAM_THRESHOLD) {
+			kernels.fill32Stream((uint32_t*)pixelBuffer, pixelBufferLength / 4, color);
+		} else {
+			kernels.fill32((uint32_t*)pixelBuffer, pixelBufferLength / 4, color);
+		}
+	} else {
+		fillRect(0, 0, width, height, color);
+	}
+}
+
+void WindowCanvas::fillSpan(int32_t x, int32_t y, uint32_t length, uint32_t color) {
+	fillRect(x, y, length, 1, color);
+}
+
+void WindowCanvas::fillRect(int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t color) {
+	WindowRect rect(x, y, width, height);
+	if (!clipRect(rect, this->width, this->height)) {
+		return;
+	}
+	uint8_t* row = pixelBuffer + rect.y * pitch + rect.x * depth / 8;
+	if (depth == 32) {
+		const Kernels& kernels = getKernels();
+		for (uint32_t line = 0; line < rect.height; ++line, row += pitch) {
+			kernels.fill32((uint32_t*)row, rect.width, color);
+		}
+	} else if (depth == 8) {
+		for (uint32_t line = 0; line < rect.height; ++line, row += pitch) {
+			memset(row, color & 0xFF, rect.width);
+		}
+	} else if (depth == 16) {
+		const uint16_t value = (uint16_t)(((color >> 8) & 0xF800) | ((color >> 5) & 0x07E0) | ((color >> 3) & 0x001F));
+		for (uint32_t line = 0; line < rect.height; ++line, row += pitch) {
+			uint16_t* pixel = (uint16_t*)row;
+			for (uint32_t column = 0; column < rect.width; ++column) {
+				pixel[column] = value;
+			}
+		}
+	} else {
+		// 24 bit pixels are packed B, G, R.
+		const uint8_t b = color & 0xFF, g = (color >> 8) & 0xFF, r = (color >> 16) & 0xFF;
+		for (uint32_t line = 0; line < rect.height; ++line, row += pitch) {
+			uint8_t* pixel = row;
+			for (uint32_t column = 0; column < rect.width; ++column, pixel += 3) {
+				pixel[0] = b;
+				pixel[1] = g;
+				pixel[2] = r;
+			}
+		}
+	}
+}
+
+void WindowCanvas::copyRect(int32_t dstX, int32_t dstY, int32_t srcX, int32_t srcY, uint32_t width, uint32_t height) {
+	// Clip the source, then the destination, moving the other one along.
+	WindowRect src(srcX, srcY, width, height);
+	if (!clipRect(src, this->width, this->height)) {
+		return;
+	}
+	WindowRect dst(dstX + (src.x - srcX), dstY + (src.y - srcY), src.width, src.height);
+	if (!clipRect(dst, this->width, this->height)) {
+		return;
+	}
+	src.x += dst.x - (dstX + (src.x - srcX));
+	src.y += dst.y - (dstY + (src.y - srcY));
+
+	const uint32_t bytesPerPixel = depth / 8;
+	const uint32_t rowLength = dst.width * bytesPerPixel;
+	if (dst.y > src.y) {
+		// Overlapping downward copy, walk the rows bottom up.
+		for (uint32_t line = dst.height; line-- > 0;) {
+			memmove(pixelBuffer + (dst.y + line) * pitch + dst.x * bytesPerPixel, pixelBuffer + (src.y + line) * pitch + src.x * bytesPerPixel, rowLength);
+		}
+	} else {
+		for (uint32_t line = 0; line < dst.height; ++line) {
+			memmove(pixelBuffer + (dst.y + line) * pitch + dst.x * bytesPerPixel, pixelBuffer + (src.y + line) * pitch + src.x * bytesPerPixel, rowLength);
+		}
+	}
+}
+
+void WindowCanvas::markDirty(int32_t x, int32_t y, uint32_t width, uint32_t height) {
+	WindowRect rect(x, y, width, height);
+	if (clipRect(rect, this->width, this->height)) {
+		mergeRect(dirtyRects, dirtyRectCount, MAX_DIRTY_RECTS, rect);
+	}
+}
+
+void WindowCanvas::blit() {
+	waitTiles();
+	if (presenter != nullptr) {
+		present();
+		return;
+	}
+	const uint64_t submitTime = getMonotonicTime();
+	if (damageDetection) {
+		// The changed tiles are added to the regions marked by the application.
+		WindowRect rects[MAX_DIRTY_RECTS];
+		uint32_t count = dirtyRectCount;
+		memcpy(rects, dirtyRects, count * sizeof(WindowRect));
+		dirtyRectCount = 0;
+		if (!detectDamage(rects, count)) {
+			const WindowRect rect(0, 0, width, height);
+			presentRects(&rect, 1);
+		} else if (count > 0) {
+			presentRects(rects, count);
+		}
+	} else if (dirtyRectCount > 0) {
+		presentRects(dirtyRects, dirtyRectCount);
+		dirtyRectCount = 0;
+	} else {
+		const WindowRect rect(0, 0, width, height);
+		presentRects(&rect, 1);
+	}
+	recordFrame();
+	completeFrame(submitTime);
+}
+
+// Hash every tile and add runs of changed tiles to 'rects'. Returns false
+// when the whole frame has to be sent: most tiles changed, or there is no
+// previous frame to compare with.
+bool WindowCanvas::detectDamage(WindowRect* rects, uint32_t& count) {
+	const uint32_t columns = (width + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+	const uint32_t rows = (height + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+	const uint32_t tileCount = columns * rows;
+	if (tileCount > tileHashCapacity) {
+		delete [] tileHashes;
+		tileHashes = new uint64_t[tileCount];
+		tileHashCapacity = tileCount;
+		tileHashesValid = false;
+	}
+
+	const Kernels& kernels = getKernels();
+	const uint32_t bytesPerPixel = getBytesPerPixel(pixelFormat);
+	uint32_t changed = 0;
+	uint64_t* hash = tileHashes;
+	for (uint32_t row = 0; row < rows; ++row) {
+		const uint32_t y = row * DAMAGE_TILE_SIZE;
+		const uint32_t tileHeight = (height - y < DAMAGE_TILE_SIZE) ? height - y : DAMAGE_TILE_SIZE;
+		const uint8_t* pixels = pixelBuffer + (size_t)y * pitch;
+		uint32_t runStart = 0;
+		bool inRun = false;
+		for (uint32_t column = 0; column < columns; ++column, ++hash) {
+			const uint32_t x = column * DAMAGE_TILE_SIZE;
+			const uint32_t tileWidth = (width - x < DAMAGE_TILE_SIZE) ? width - x : DAMAGE_TILE_SIZE;
+			const uint64_t value = kernels.hashRows(pixels + x * bytesPerPixel, pitch, tileWidth * bytesPerPixel, tileHeight);
+			const bool dirty = !tileHashesValid || value != *hash;
+			*hash = value;
+			if (dirty) {
+				++changed;
+				if (!inRun) {
+					runStart = x;
+					inRun = true;
+				}
+			}
+			if (inRun && (!dirty || column + 1 == columns)) {
+				const uint32_t runEnd = dirty ? x + tileWidth : x;
+				mergeRect(rects, count, MAX_DIRTY_RECTS, WindowRect(runStart, y, runEnd - runStart, tileHeight));
+				inRun = false;
+			}
+		}
+	}
+	const bool compared = tileHashesValid;
+	tileHashesValid = true;
+	return compared && changed * 2 <= tileCount;
+}
+
+void WindowCanvas::setDamageDetection(bool enabled) {
+	damageDetection = enabled;
+	tileHashesValid = false;
+}
+
+bool WindowCanvas::isDamageDetectionEnabled() const {
+	return damageDetection;
+}
+
+void WindowCanvas::blit(const WindowRect* rects, uint32_t count) {
+	waitTiles();
+	if (presenter != nullptr) {
+		present();
+		return;
+	}
+	const uint64_t submitTime = getMonotonicTime();
+	WindowRect merged[MAX_DIRTY_RECTS];
+	uint32_t mergedCount = 0;
+	for (uint32_t index = 0; index < count; ++index) {
+		WindowRect rect = rects[index];
+		if (clipRect(rect, width, height)) {
+			mergeRect(merged, mergedCount, MAX_DIRTY_RECTS, rect);
+		}
+	}
+	if (mergedCount > 0) {
+		presentRects(merged, mergedCount);
+	}
+	recordFrame();
+	completeFrame(submitTime);
+}
+
+void WindowCanvas::presentRects(const WindowRect* rects, uint32_t count) {
+	if (backend == Headless) {
+		if (frameSink != nullptr) {
+			frameSink(*this, rects, count, frameSinkUser);
+		}
+		return;
+	}
+	if (isScaled()) {
+		presentScaled(rects, count);
+		return;
+	}
+#if defined(_WIN32)
+	for (uint32_t index = 0; index < count; ++index) {
+		const WindowRect& r = rects[index];
+		gdi.BitBlt(hdc, r.x, r.y, r.width, r.height, hDCMem, r.x, r.y, SRCCOPY);
+	}
+#else // __linux__
+	if (pixelFormat == PixelFormatIndex8) {
+		// Always converted, no X visual is indexed here.
+		const uint32_t dstBytes = getBytesPerPixel(imageFormat);
+		for (uint32_t index = 0; index < count; ++index) {
+			const WindowRect& r = rects[index];
+			expandIndexed((uint8_t*)xImage->data + r.y * xImage->bytes_per_line + r.x * dstBytes, xImage->bytes_per_line, imageFormat,
+			              pixelBuffer + r.y * pitch + r.x, pitch, palette, r.width, r.height);
+		}
+	} else if (convertOnPresent) {
+		const uint32_t srcBytes = getBytesPerPixel(pixelFormat);
+		const uint32_t dstBytes = getBytesPerPixel(imageFormat);
+		for (uint32_t index = 0; index < count; ++index) {
+			const WindowRect& r = rects[index];
+			convertPixels((uint8_t*)xImage->data + r.y * xImage->bytes_per_line + r.x * dstBytes, xImage->bytes_per_line, imageFormat,
+			              pixelBuffer + r.y * pitch + r.x * srcBytes, pitch, pixelFormat, r.width, r.height);
+		}
+	}
+	putImage(xImage, shmEnabled, rects, count);
+#endif
+}
+
+// Scale the regions of the pixel buffer straight into the window image, the
+// regions grown to the window pixels they affect.
+void WindowCanvas::presentScaled(const WindowRect* rects, uint32_t count) {
+	// A bilinear pixel also reads the neighbours of its source pixel.
+	const int64_t margin = (scaleFilter == ScaleBilinear) ? 1 : 0;
+	WindowRect windowRects[MAX_DIRTY_RECTS];
+	uint32_t windowRectCount = 0;
+	for (uint32_t index = 0; index < count; ++index) {
+		const WindowRect& r = rects[index];
+		const int64_t x0 = (r.x - margin > 0) ? r.x - margin : 0;
+		const int64_t y0 = (r.y - margin > 0) ? r.y - margin : 0;
+		const int64_t x1 = r.x + r.width + margin;
+		const int64_t y1 = r.y + r.height + margin;
+		const int64_t left = x0 * windowWidth / width;
+		const int64_t top = y0 * windowHeight / height;
+		const int64_t right = (x1 * windowWidth + width - 1) / width;
+		const int64_t bottom = (y1 * windowHeight + height - 1) / height;
+		WindowRect windowRect((int32_t)left, (int32_t)top, (uint32_t)(right - left), (uint32_t)(bottom - top));
+		if (clipRect(windowRect, windowWidth, windowHeight)) {
+			mergeRect(windowRects, windowRectCount, MAX_DIRTY_RECTS, windowRect);
+		}
+	}
+#if defined(_WIN32)
+	const uint32_t scalePitch = scaleBitmapWidth * (depth / 8);
+	for (uint32_t index = 0; index < windowRectCount; ++index) {
+		const WindowRect& r = windowRects[index];
+		scalePixels(scaleBits, scalePitch, pixelFormat, windowWidth, windowHeight, pixelBuffer, pitch, pixelFormat, width, height, r.x, r.y, r.width, r.height, scaleFilter);
+		gdi.BitBlt(hdc, r.x, r.y, r.width, r.height, scaleDC, r.x, r.y, SRCCOPY);
+	}
+#else // __linux__
+	for (uint32_t index = 0; index < windowRectCount; ++index) {
+		const WindowRect& r = windowRects[index];
+		scalePixels((uint8_t*)scaleImage->data, scaleImage->bytes_per_line, imageFormat, windowWidth, windowHeight, pixelBuffer, pitch, pixelFormat, width, height, r.x, r.y, r.width, r.height, scaleFilter);
+	}
+	putImage(scaleImage, scaleShared, windowRects, windowRectCount);
+#endif
+}
+
+#if defined(__linux__)
+void WindowCanvas::putImage(XImage* image, bool shared, const WindowRect* rects, uint32_t count) {
+	if (backend == Xcb) {
+		putXcbImage(display, xcbQueue.connection, window, gc, image, shared, rects, count);
+		if (context != nullptr && context->batching) {
+			context->batchNeedsSync = context->batchNeedsSync || shared;
+		} else if (shared) {
+			// The segment is still read by the server, see below.
+			x11.XSync(display, False);
+		} else {
+			// The image data was copied into the requests, only send them.
+			xcb.xcb_flush(xcbQueue.connection);
+		}
+		return;
+	}
+	if (shared) {
+		for (uint32_t index = 0; index < count; ++index) {
+			const WindowRect& r = rects[index];
+			xext.XShmPutImage(display, window, gc, image, r.x, r.y, r.x, r.y, r.width, r.height, False);
+		}
+		// Wait for the server to read the segment before the buffer is touched
+		// again. A batch waits once for all of its windows.
+		if (context != nullptr && context->batching) {
+			context->batchNeedsSync = true;
+		} else {
+			x11.XSync(display, False);
+		}
+	} else {
+		for (uint32_t index = 0; index < count; ++index) {
+			const WindowRect& r = rects[index];
+			x11.XPutImage(display, window, gc, image, r.x, r.y, r.x, r.y, r.width, r.height);
+		}
+	}
+}
+#endif
+
+int WindowCanvas::setBufferCount(uint32_t count) {
+	if (count < 1 || count > MAX_BUFFER_COUNT) {
+		WC_ERROR("Unsupported buffer count %u.\n", count);
+		return 1;
+	}
+	if (presenter != nullptr) {
+		if (presenter->bufferCount == count) {
+			return 0;
+		}
+		// Drain the queue and move the frame being drawn to the primary buffer.
+		uint8_t* backBuffer = pixelBuffer;
+		pixelBuffer = presenter->primaryBuffer;
+		presenter->stop();
+		memcpy(pixelBuffer, backBuffer, pixelBufferLength);
+		delete presenter;
+		presenter = nullptr;
+	}
+	// Frames presented by the presenter are not hashed.
+	tileHashesValid = false;
+	if (count == 1) {
+		return 0;
+	}
+	if (backend == Headless) {
+		WC_ERROR("The headless backend has a single buffer.\n");
+		return 4;
+	}
+	if (fixedRenderSize) {
+		WC_ERROR("A render size needs a single buffer.\n");
+		return 5;
+	}
+	if (pixelFormat == PixelFormatIndex8) {
+		WC_ERROR("8 bit canvases have a single buffer.\n");
+		return 6;
+	}
+	if (pixelBuffer == nullptr) {
+		WC_ERROR("The canvas is not initialized.\n");
+		return 2;
+	}
+
+	presenter = new Presenter();
+	if (presenter->init(*this, count) != 0) {
+		delete presenter;
+		presenter = nullptr;
+		return 3;
+	}
+	pixelBuffer = presenter->buffers[presenter->current].pixels;
+	WC_INFO("Started the presenter thread with %u buffers.\n", count);
+	return 0;
+}
+
+uint32_t WindowCanvas::getBufferCount() const {
+	return (presenter != nullptr) ? presenter->bufferCount : 1;
+}
+
+void WindowCanvas::present() {
+	waitTiles();
+	if (presenter != nullptr) {
+		const uint64_t submitTime = getMonotonicTime();
+		recordFrame();
+		pixelBuffer = presenter->present();
+		completeFrame(submitTime);
+	} else {
+		blit();
+	}
+}
+
+uint32_t WindowCanvas::getQueuedBufferCount() const {
+	return (presenter != nullptr) ? presenter->queued.load(std::memory_order_relaxed) : 0;
+}
+
+void WindowCanvas::flush(bool wait) {
+	if (backend == Headless) {
+		return;
+	}
+#if defined(_WIN32)
+	(void)wait;
+	GdiFlush();
+#else
+	if (wait) {
+		x11.XSync(display, False);
+	} else {
+		x11.XFlush(display);
+	}
+#endif
+}
+
+void WindowCanvas::setFrameSink(FrameSink sink, void* user) {
+	frameSink = sink;
+	frameSinkUser = user;
+}
+
+void WindowCanvas::setFrameRecorder(FrameRecorder* recorder) {
+	this->recorder = recorder;
+}
+
+// Hand the oldest input read since the last frame to the application to the
+// latency window.
+void WindowCanvas::trackInput(const WindowEvent& event) {
+	if (event.type < WindowEvent::KeyPressed || event.type > WindowEvent::WheelUp || event.receiveTime == 0) {
+		return;
+	}
+	if (pendingInputTime == 0 || event.receiveTime < pendingInputTime) {
+		pendingInputTime = event.receiveTime;
+	}
+}
+
+// Stamp the frame that was just sent and close the latency sample of the
+// input read before it.
+void WindowCanvas::completeFrame(uint64_t submitTime) {
+	if (presentSync && presenter == nullptr) {
+		flush(true);
+	}
+	this->submitTime = submitTime;
+	completeTime = getMonotonicTime();
+	if (pendingInputTime == 0) {
+		return;
+	}
+	latencySamples[latencyHead] = (completeTime > pendingInputTime) ? completeTime - pendingInputTime : 0;
+	latencyHead = (latencyHead + 1) % LATENCY_WINDOW;
+	if (latencyCount < LATENCY_WINDOW) {
+		++latencyCount;
+	}
+	pendingInputTime = 0;
+}
+
+void WindowCanvas::setPresentSync(bool enabled) {
+	presentSync = enabled;
+}
+
+bool WindowCanvas::isPresentSyncEnabled() const {
+	return presentSync;
+}
+
+uint64_t WindowCanvas::getLastSubmitTime() const {
+	return submitTime;
+}
+
+uint64_t WindowCanvas::getLastCompleteTime() const {
+	return completeTime;
+}
+
+// Nearest rank percentiles of a sorted copy of the window.
+InputLatency WindowCanvas::getInputLatency() const {
+	InputLatency latency;
+	memset(&latency, 0, sizeof(latency));
+	latency.count = latencyCount;
+	if (latencyCount == 0) {
+		return latency;
+	}
+	uint64_t sorted[LATENCY_WINDOW];
+	memcpy(sorted, latencySamples, latencyCount * sizeof(uint64_t));
+	std::sort(sorted, sorted + latencyCount);
+	latency.p50 = sorted[(latencyCount * 50 + 99) / 100 - 1];
+	latency.p99 = sorted[(latencyCount * 99 + 99) / 100 - 1];
+	latency.max = sorted[latencyCount - 1];
+	return latency;
+}
+
+void WindowCanvas::resetInputLatency() {
+	pendingInputTime = 0;
+	latencyHead = 0;
+	latencyCount = 0;
+}
+
+// The whole frame is recorded, whatever part of it was presented.
+void WindowCanvas::recordFrame() {
+	if (recorder != nullptr) {
+		recorder->capture(pixelBuffer, pitch, width, height);
+	}
+}
+
+PixelFormat WindowCanvas::getPixelFormat() const {
+	return pixelFormat;
+}
+
+int WindowCanvas::setPalette(const uint32_t* colors, uint32_t first, uint32_t count) {
+	if (pixelFormat != PixelFormatIndex8) {
+		WC_ERROR("Only 8 bit canvases have a palette.\n");
+		return 1;
+	}
+	if (colors == nullptr || first > 256 || count > 256 - first) {
+		WC_ERROR("Invalid palette range %u, %u.\n", first, count);
+		return 2;
+	}
+	memcpy(palette + first, colors, count * sizeof(uint32_t));
+#if defined(_WIN32)
+	if (backend != Headless) {
+		RGBQUAD quads[256];
+		for (uint32_t index = 0; index < count; ++index) {
+			const uint32_t color = colors[index];
+			quads[index].rgbBlue = color & 0xFF;
+			quads[index].rgbGreen = (color >> 8) & 0xFF;
+			quads[index].rgbRed = (color >> 16) & 0xFF;
+			quads[index].rgbReserved = 0;
+		}
+		gdi.SetDIBColorTable(hDCMem, first, count, quads);
+	}
+#endif
+	// The indices did not change, so neither the marked regions nor the tile
+	// hashes cover the new colors.
+	markDirty(0, 0, width, height);
+	tileHashesValid = false;
+	return 0;
+}
+
+const uint32_t* WindowCanvas::getPalette() const {
+	return palette;
+}
+
+void WindowCanvas::runTile(uint32_t index, uint32_t thread, void* user) {
+	const WindowCanvas& canvas = *(const WindowCanvas*)user;
+	const TileJob& job = canvas.tileJob;
+	WindowTile tile;
+	tile.x = (index % job.columns) * job.width;
+	tile.y = (index / job.columns) * job.height;
+	tile.width = (canvas.width - tile.x < job.width) ? canvas.width - tile.x : job.width;
+	tile.height = (canvas.height - tile.y < job.height) ? canvas.height - tile.y : job.height;
+	tile.pitch = canvas.pitch;
+	tile.pixels = canvas.pixelBuffer + tile.y * canvas.pitch + tile.x * (canvas.depth / 8);
+	tile.thread = thread;
+	job.function(tile, job.user);
+}
+
+void WindowCanvas::renderTiles(TileFunction function, void* user, uint32_t tileWidth, uint32_t tileHeight) {
+	if (tilePool == nullptr) {
+		tilePool = new TilePool();
+	}
+	// Finish the previous frame before the job description changes.
+	tilePool->wait();
+
+	// Round the width to whole cache lines so tiles never share one on a row.
+	const uint32_t bytesPerPixel = depth / 8;
+	const uint32_t align = 64 / gcd(64, bytesPerPixel);
+	tileWidth = (tileWidth < 1) ? 1 : tileWidth;
+	tileHeight = (tileHeight < 1) ? 1 : tileHeight;
+	tileJob.function = function;
+	tileJob.user = user;
+	tileJob.width = (tileWidth + align - 1) / align * align;
+	tileJob.height = tileHeight;
+	tileJob.columns = (width + tileJob.width - 1) / tileJob.width;
+	const uint32_t rows = (height + tileJob.height - 1) / tileJob.height;
+	tilePool->dispatch(tileJob.columns * rows, runTile, this);
+}
+
+void WindowCanvas::waitTiles() {
+	if (tilePool != nullptr) {
+		tilePool->wait();
+	}
+}
+
+uint32_t WindowCanvas::getTileThreadCount() {
+	if (tilePool == nullptr) {
+		tilePool = new TilePool();
+	}
+	return tilePool->getThreadCount();
+}
+
+CanvasContext::CanvasContext(WindowCanvas::Backend backend)
+	: backend(resolveBackend(backend)), canvasCount(0), batching(false)
+#if defined(__linux__)
+	, display(nullptr), batchNeedsSync(false), xcbQueue()
+#endif
+{
+#if defined(__linux__)
+	if (this->backend == WindowCanvas::Headless) {
+		return;
+	}
+	if (x11.init() != 0) {
+		WC_ERROR("Failed to load libX11.\n");
+		return;
+	}
+	if ((display = x11.XOpenDisplay(nullptr)) == nullptr) {
+		WC_ERROR("Failed to connect X server.\n");
+	} else if (this->backend == WindowCanvas::Xcb && openXcbQueue(display, xcbQueue) != 0) {
+		x11.XCloseDisplay(display);
+		display = nullptr;
+	}
+#endif
+}
+
+CanvasContext::~CanvasContext() {
+	if (canvasCount > 0) {
+		WC_WARNING("Destroying a canvas context still used by %u canvases.\n", canvasCount);
+	}
+#if defined(__linux__)
+	if (display != nullptr) {
+		x11.XCloseDisplay(display);
+		display = nullptr;
+	}
+#endif
+}
+
+bool CanvasContext::isOpen() const {
+#if defined(__linux__)
+	return backend == WindowCanvas::Headless || display != nullptr;
+#else
+	return true;
+#endif
+}
+
+WindowCanvas::Backend CanvasContext::getBackend() const {
+	return backend;
+}
+
+uint32_t CanvasContext::getCanvasCount() const {
+	return canvasCount;
+}
+
+int CanvasContext::getNativeFd() const {
+#if defined(__linux__)
+	return (display != nullptr) ? ConnectionNumber(display) : -1;
+#else
+	return -1;
+#endif
+}
+
+bool CanvasContext::addCanvas(WindowCanvas* canvas) {
+	if (canvasCount == MAX_CANVAS_COUNT) {
+		return false;
+	}
+	canvases[canvasCount++] = canvas;
+	return true;
+}
+
+#if defined(__linux__)
+// Few windows per context, a linear search beats a map here.
+WindowCanvas* CanvasContext::findCanvas(Window window) const {
+	for (uint32_t index = 0; index < canvasCount; ++index) {
+		if (canvases[index]->window == window) {
+			return canvases[index];
+		}
+	}
+	return nullptr;
+}
+#endif
+
+void CanvasContext::removeCanvas(WindowCanvas* canvas) {
+	for (uint32_t index = 0; index < canvasCount; ++index) {
+		if (canvases[index] == canvas) {
+			canvases[index] = canvases[--canvasCount];
+			return;
+		}
+	}
+}
+
+uint32_t CanvasContext::pumpEvents() {
+	if (backend == WindowCanvas::Headless || !isOpen()) {
+		return 0;
+	}
+	uint32_t count = 0;
+	WindowEvent event;
+#if defined(_WIN32)
+	MSG msg;
+	while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+		WindowCanvas* canvas = nullptr;
+		for (uint32_t index = 0; index < canvasCount; ++index) {
+			if (canvases[index]->hwnd == msg.hwnd) {
+				canvas = canvases[index];
+				break;
+			}
+		}
+		event.type = WindowEvent::Unknown;
+		if (canvas != nullptr) {
+			canvas->eventPtr = &event;
+		}
+
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+		if (canvas != nullptr) {
+			canvas->eventPtr = nullptr;
+		}
+
+		if (canvas == nullptr || event.type == WindowEvent::Unknown) {
+			continue;
+		}
+		if (canvas->injectEvent(event)) {
+			++count;
+		} else {
+			WC_WARNING("Dropped an event, the canvas queue is full.\n");
+		}
+	}
+#else // __linux__
+	XEvent xEvent;
+	if (backend == WindowCanvas::Xcb) {
+		xcb.xcb_flush(xcbQueue.connection);
+		bool read = true;
+		while (nextXcbEvent(display, xcbQueue, xEvent, read)) {
+			read = false;
+			WindowCanvas* canvas = findCanvas(xEvent.xany.window);
+			if (canvas != nullptr && !(canvas->coalesceEvents && skipXcbAutoRepeat(display, xcbQueue, xEvent)) && canvas->translateEvent(xEvent, event)) {
+				if (canvas->injectEvent(event)) {
+					++count;
+				} else {
+					WC_WARNING("Dropped an event, the canvas queue is full.\n");
+				}
+			}
+		}
+	}
+	int pending = (backend == WindowCanvas::Xcb) ? 0 : x11.XEventsQueued(display, QueuedAfterReading);
+	while (pending > 0) {
+		x11.XNextEvent(display, &xEvent);
+		--pending;
+
+		WindowCanvas* canvas = findCanvas(xEvent.xany.window);
+		if (canvas != nullptr && !(canvas->coalesceEvents && skipAutoRepeat(display, xEvent, pending)) && canvas->translateEvent(xEvent, event)) {
+			if (canvas->injectEvent(event)) {
+				++count;
+			} else {
+				WC_WARNING("Dropped an event, the canvas queue is full.\n");
+			}
+		}
+		if (pending == 0) {
+			pending = x11.XEventsQueued(display, QueuedAlready);
+		}
+	}
+#endif
+	for (uint32_t index = 0; index < canvasCount; ++index) {
+		if (canvases[index]->applyPendingResize(event) && canvases[index]->injectEvent(event)) {
+			++count;
+		}
+	}
+	return count;
+}
+
+void CanvasContext::beginBatch() {
+	batching = true;
+}
+
+void CanvasContext::endBatch() {
+	batching = false;
+	if (backend == WindowCanvas::Headless || !isOpen()) {
+		return;
+	}
+#if defined(_WIN32)
+	GdiFlush();
+#else
+	if (batchNeedsSync) {
+		x11.XSync(display, False);
+		batchNeedsSync = false;
+	} else {
+		x11.XFlush(display);
+	}
+#endif
+}
+
+void CanvasContext::blitAll() {
+	beginBatch();
+	for (uint32_t index = 0; index < canvasCount; ++index) {
+		canvases[index]->blit();
+	}
+	endBatch();
+}
@@ -1,101 +1,548 @@
-#ifndef __WINDOW_CANVAS_H__
-#define __WINDOW_CANVAS_H__
-
-#include <stdint.h>
-
-#if defined (__linux__) 
-#include <X11/Xlib.h>
-#elif defined (_WIN32)
-#include <windows.h>
-#endif
-
-struct WindowEvent {
-	enum Type {
-		Unknown, 
-		WindowClose,
-		KeyPressed,
-		KeyReleased,
-		CursorMove,
-		ButtonPressed,
-		ButtonReleased,
-		WheelDown,
-		WheelUp,
-	} type;
-	union {
-		int32_t x;
-		uint32_t width, keyCode, button;
-	};
-	union {
-		int32_t y;
-		uint32_t height;
-		char ascii;
-	};
-
-	WindowEvent(Type type = Unknown, int lParam = 0, int wParam = 0) 
-		: type(type), x(lParam), y(wParam) {
-	}
-};
-
-typedef WindowEvent WEvent;
-
-class WindowCanvas {
-	uint32_t width;
-	uint32_t height;
-	uint8_t depth;
-	uint8_t* pixelBuffer;
-	uint32_t pixelBufferLength;
-#if defined (_WIN32)
-	friend LRESULT CALLBACK WindowProc(HWND, UINT, WPARAM, LPARAM);
-	HWND hwnd;
-	HDC hdc;
-	HDC hDCMem;
-	HBITMAP bitmap;
-	HGDIOBJ oldBitmap;
-	WindowEvent* eventPtr;
-#else
-	Display* display;
-	Window window;
-	GC gc;
-	XImage* xImage;
-    Atom wm_delete_window;
-#endif
-	int initialize(uint32_t width, uint32_t height, uint8_t depth, const char* title);
-	int uninitialize();
-
-public:
-	// Supported depth values: 24, 32
-	WindowCanvas(uint32_t width, uint32_t height, uint8_t depth = 32, const char* title = "");
-
-	~WindowCanvas();
-
-	uint32_t getWidth() const;
-
-	uint32_t getHeight() const;
-
-	uint32_t getDepth() const;
-
-	void setTitle(const char* title = "");
-
-	const char* getTitle() const;
-
-	// Returns the internal pixel buffer that will be displayed in the window.
-	uint8_t* getPixelBuffer() const;
-
-	//Returns the internal pixel buffer length. 
-	// value = width * height * depth / 8
-	uint32_t getPixelBufferLength() const;
-
-	// If any events are available, populate the 'event' and returns true.
-	// Returns false otherwise.
-	bool getEvent(WindowEvent& event);
-
-	// Clear the internal pixel buffer by filling it with 0.
-	void clear();
-
-	//Send the internal pixel buffer to the display.
-	void blit();
-};
-
-typedef WindowCanvas WCanvas;
-
+#ifndef __WINDOW_CANVAS_H__
+#define __WINDOW_CANVAS_H__
+
+#include <stdint.h>
+#include "PixelFormat.h"
+#include "Scale.h"
+
+#if defined (__linux__) 
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+
+typedef struct xcb_connection_t xcb_connection_t;
+
+// Event queue of a display handed to XCB by the Xcb backend.
+struct XcbEventQueue {
+	xcb_connection_t* connection;
+	// Event read ahead by the auto-repeat check.
+	XEvent held;
+	bool hasHeld;
+};
+#elif defined (_WIN32)
+#include <windows.h>
+#endif
+
+struct WindowEvent {
+	enum Type {
+		Unknown, 
+		WindowClose,
+		KeyPressed,
+		KeyReleased,
+		CursorMove,
+		ButtonPressed,
+		ButtonReleased,
+		WheelDown,
+		WheelUp,
+		// The window was resized to 'width' x 'height'. Unless a render size
+		// is set, the pixel buffer was reallocated to the same size.
+		Resized,
+	} type;
+	union {
+		int32_t x;
+		uint32_t width, keyCode, button;
+	};
+	union {
+		int32_t y;
+		uint32_t height;
+		char ascii;
+	};
+	// Window system timestamp in milliseconds (X server time, WIN32 message
+	// time), 0 when there is none.
+	uint32_t time;
+	// getMonotonicTime() when the library read the event, in nanoseconds.
+	// Folded cursor moves keep the time of the first one.
+	uint64_t receiveTime;
+
+	WindowEvent(Type type = Unknown, int lParam = 0, int wParam = 0) 
+		: type(type), x(lParam), y(wParam), time(0), receiveTime(0) {
+	}
+};
+
+typedef WindowEvent WEvent;
+
+// Input-to-present latency in nanoseconds, see WindowCanvas::getInputLatency().
+struct InputLatency {
+	// Number of frames the percentiles were taken from.
+	uint32_t count;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t max;
+};
+
+struct WindowRect {
+	int32_t x;
+	int32_t y;
+	uint32_t width;
+	uint32_t height;
+
+	WindowRect(int32_t x = 0, int32_t y = 0, uint32_t width = 0, uint32_t height = 0)
+		: x(x), y(y), width(width), height(height) {
+	}
+};
+
+typedef WindowRect WRect;
+
+// Region of the pixel buffer handed to a tile callback.
+struct WindowTile {
+	// First pixel of the tile and the pixel buffer row length in bytes.
+	uint8_t* pixels;
+	uint32_t pitch;
+	int32_t x;
+	int32_t y;
+	uint32_t width;
+	uint32_t height;
+	// Index of the worker running the callback, below getTileThreadCount().
+	uint32_t thread;
+};
+
+class TilePool;
+class CanvasContext;
+class FrameRecorder;
+
+class WindowCanvas {
+public:
+	enum Backend {
+		// Native unless the WCANVAS_BACKEND environment variable is "headless"
+		// or "xcb". Builds defining WCANVAS_XCB default to Xcb on Linux.
+		Default,
+		// WIN32 or X11 window.
+		Native,
+		// Offscreen pixel buffer, blit() hands frames to the frame sink.
+		Headless,
+		// X11 window presented and read through XCB: images go out as
+		// unchecked requests and events are read without Xlib's queue. Same
+		// as Native on WIN32.
+		Xcb,
+	};
+
+	// Receives the presented regions of a headless canvas.
+	typedef void (*FrameSink)(const WindowCanvas& canvas, const WindowRect* rects, uint32_t count, void* user);
+
+	// Renders one tile, called concurrently from several threads.
+	typedef void (*TileFunction)(const WindowTile& tile, void* user);
+
+	// Default of setRowPadding(), pads only rows that are a multiple of 4 KiB.
+	static const uint32_t AUTO_ROW_PADDING = 0xFFFFFFFF;
+
+	// Frames kept by the input latency statistics.
+	static const uint32_t LATENCY_WINDOW = 256;
+
+private:
+	// Dirty rectangles are merged down to this many regions per blit.
+	static const uint32_t MAX_DIRTY_RECTS = 16;
+	// Upper limit for setBufferCount().
+	static const uint32_t MAX_BUFFER_COUNT = 3;
+	// Capacity of the injected event queue.
+	static const uint32_t MAX_INJECTED_EVENTS = 256;
+	// Side of the tiles compared by the damage detection.
+	static const uint32_t DAMAGE_TILE_SIZE = 32;
+
+	struct Presenter;
+
+	uint32_t width;
+	uint32_t height;
+	uint8_t depth;
+	uint8_t* pixelBuffer;
+	uint32_t pixelBufferLength;
+	// Bytes per row of the pixel buffer.
+	uint32_t pitch;
+	PixelFormat pixelFormat;
+	WindowRect dirtyRects[MAX_DIRTY_RECTS];
+	uint32_t dirtyRectCount;
+	Presenter* presenter;
+	bool coalesceEvents;
+	Backend backend;
+	FrameSink frameSink;
+	void* frameSinkUser;
+	WindowEvent injectedEvents[MAX_INJECTED_EVENTS];
+	uint32_t injectedHead;
+	uint32_t injectedCount;
+	TilePool* tilePool;
+	CanvasContext* context;
+	bool resizable;
+	// Last size reported by the window system, applied once the queue drains.
+	bool resizePending;
+	uint32_t pendingWidth;
+	uint32_t pendingHeight;
+	// Allocated bytes of a pixel buffer owned by the canvas.
+	uint32_t bufferCapacity;
+	uint32_t rowPadding;
+	// Size of the window. Differs from the pixel buffer size when a render
+	// size is set, blit() scales the frame to it then.
+	uint32_t windowWidth;
+	uint32_t windowHeight;
+	bool fixedRenderSize;
+	ScaleFilter scaleFilter;
+	FrameRecorder* recorder;
+	// Hash of every tile of the last frame sent by blit(), row by row.
+	bool damageDetection;
+	bool tileHashesValid;
+	uint64_t* tileHashes;
+	uint32_t tileHashCapacity;
+	// Receive time of the oldest input event handed to the application since
+	// the last frame, 0 if there is none.
+	uint64_t pendingInputTime;
+	uint64_t submitTime;
+	uint64_t completeTime;
+	bool presentSync;
+	// Latency of the last frames that followed input, a ring.
+	uint64_t latencySamples[LATENCY_WINDOW];
+	uint32_t latencyHead;
+	uint32_t latencyCount;
+	// XRGB8888 colors of the 8 bit indices, see setPalette().
+	uint32_t palette[256];
+	struct TileJob {
+		TileFunction function;
+		void* user;
+		uint32_t width;
+		uint32_t height;
+		uint32_t columns;
+	} tileJob;
+#if defined (_WIN32)
+	friend LRESULT CALLBACK WindowProc(HWND, UINT, WPARAM, LPARAM);
+	HWND hwnd;
+	HDC hdc;
+	HDC hDCMem;
+	HBITMAP bitmap;
+	HGDIOBJ oldBitmap;
+	// Allocated size of the DIB section, at least the canvas size.
+	uint32_t bitmapWidth;
+	uint32_t bitmapHeight;
+	// Window sized bitmap the frame is scaled into.
+	HDC scaleDC;
+	HBITMAP scaleBitmap;
+	HGDIOBJ scaleOldBitmap;
+	uint8_t* scaleBits;
+	uint32_t scaleBitmapWidth;
+	uint32_t scaleBitmapHeight;
+	WindowEvent* eventPtr;
+#else
+	Display* display;
+	Window window;
+	GC gc;
+	XImage* xImage;
+	XShmSegmentInfo shmInfo;
+	bool shmEnabled;
+	// Layout of the presented image and whether blit() converts into it.
+	PixelFormat imageFormat;
+	bool convertOnPresent;
+	// Allocated bytes of the xImage data.
+	uint32_t imageCapacity;
+	// Window sized image the frame is scaled into.
+	XImage* scaleImage;
+	XShmSegmentInfo scaleShmInfo;
+	bool scaleShared;
+	uint32_t scaleCapacity;
+	// Readable while injected events are queued on a headless canvas.
+	int wakePipe[2];
+	// Connection of the Xcb backend, with the event queue when not shared.
+	XcbEventQueue xcbQueue;
+    Atom wm_delete_window;
+#endif
+	int initialize(uint32_t width, uint32_t height, uint8_t depth, const char* title);
+	int uninitialize();
+#if defined (__linux__)
+	bool translateEvent(XEvent& xEvent, WindowEvent& event);
+	void updateSizeHints();
+	void putImage(XImage* image, bool shared, const WindowRect* rects, uint32_t count);
+#endif
+	int resizeBuffers(uint32_t width, uint32_t height);
+	int reallocateBuffers(uint32_t width, uint32_t height);
+	bool applyPendingResize(WindowEvent& event);
+	int updateWindowSize(uint32_t width, uint32_t height);
+	bool isScaled() const;
+	int updateScaleTarget();
+	void releaseScaleTarget();
+	void presentRects(const WindowRect* rects, uint32_t count);
+	void presentScaled(const WindowRect* rects, uint32_t count);
+	void recordFrame();
+	bool detectDamage(WindowRect* rects, uint32_t& count);
+	bool popInjectedEvent(WindowEvent& event);
+	bool readEvent(WindowEvent& event);
+	uint32_t readEvents(WindowEvent* events, uint32_t maxCount);
+	void trackInput(const WindowEvent& event);
+	void completeFrame(uint64_t submitTime);
+	bool waitNative(int timeoutMs);
+	static void runTile(uint32_t index, uint32_t thread, void* user);
+
+	friend class CanvasContext;
+	WindowCanvas(CanvasContext* context, uint32_t width, uint32_t height, uint8_t depth, const char* title, Backend backend);
+
+public:
+	// Supported depth values: 8 (palette index), 16 (RGB565), 24 (packed
+	// RGB888), 32 (XRGB8888). The pixel buffer always uses this layout, blit()
+	// converts it when the X visual differs. 8 bit pixels are looked up in the
+	// palette then, only over the presented regions.
+	WindowCanvas(uint32_t width, uint32_t height, uint8_t depth = 32, const char* title = "", Backend backend = Default);
+
+	// Create a window on the connection of 'context', using its backend. The
+	// canvas has to be destroyed before the context.
+	WindowCanvas(CanvasContext& context, uint32_t width, uint32_t height, uint8_t depth = 32, const char* title = "");
+
+	~WindowCanvas();
+
+	// Size of the pixel buffer, see setRenderSize().
+	uint32_t getWidth() const;
+
+	uint32_t getHeight() const;
+
+	uint32_t getWindowWidth() const;
+
+	uint32_t getWindowHeight() const;
+
+	uint32_t getDepth() const;
+
+	Backend getBackend() const;
+
+	// Layout of the pixel buffer, derived from the depth.
+	PixelFormat getPixelFormat() const;
+
+	// Set 'count' XRGB8888 colors of the palette of an 8 bit canvas, starting
+	// at index 'first'. The whole frame is sent by the next blit(). The
+	// default palette is a gray ramp. Returns 0 on success.
+	int setPalette(const uint32_t* colors, uint32_t first = 0, uint32_t count = 256);
+
+	// The 256 colors of the palette.
+	const uint32_t* getPalette() const;
+
+	void setTitle(const char* title = "");
+
+	// Let the user resize the window. Size changes are reported with a
+	// Resized event once the pending events are drained, the pixel buffer
+	// content is undefined after it. Off by default.
+	void setResizable(bool resizable);
+
+	bool isResizable() const;
+
+	// Resize the window, and the pixel buffer unless a render size is set.
+	// Allocations are kept and grown geometrically, so shrinking and growing
+	// back does not reallocate. Returns 0 on success.
+	int setSize(uint32_t width, uint32_t height);
+
+	// Draw into a 'width' x 'height' pixel buffer and let blit() scale it to
+	// the window with 'filter', whatever the window size. Only the small
+	// buffer is ever touched by the application. 0 x 0 goes back to a buffer
+	// as large as the window. The buffer content is undefined afterwards. A
+	// headless canvas hands the unscaled buffer to its frame sink. Needs a
+	// single buffer and more than 8 bits per pixel. Returns 0 on success.
+	int setRenderSize(uint32_t width, uint32_t height, ScaleFilter filter = ScaleNearest);
+
+	const char* getTitle() const;
+
+	// Returns the internal pixel buffer that will be displayed in the window.
+	// With more than one buffer this is the current back buffer, which
+	// changes after every present().
+	uint8_t* getPixelBuffer() const;
+
+	//Returns the internal pixel buffer length. 
+	// value = getStride() * height
+	uint32_t getPixelBufferLength() const;
+
+	// Distance in bytes between the starts of two rows. Rows start on 64 byte
+	// boundaries, so the stride is usually larger than width * bytes per pixel.
+	uint32_t getStride() const;
+
+	// Extra bytes after every row, rounded up to keep the rows aligned.
+	// Reallocates the pixel buffer, its content is undefined afterwards.
+	// Returns 0 on success.
+	int setRowPadding(uint32_t bytes = AUTO_ROW_PADDING);
+
+	// If any events are available, populate the 'event' and returns true.
+	// Returns false otherwise.
+	bool getEvent(WindowEvent& event);
+
+	// Queue a synthetic event, returned by getEvent()/pollEvents() before any
+	// window event. Works with every backend. Returns false if the queue is full.
+	bool injectEvent(const WindowEvent& event);
+
+	// Send a synthetic event through the window system, so it goes through
+	// the same queue and translation as user input. Same as injectEvent() on
+	// a headless canvas. Returns false if the event could not be sent.
+	bool postEvent(const WindowEvent& event);
+
+	// Like getEvent(), but wait up to 'timeoutMs' milliseconds for an event
+	// to arrive, or forever if negative. Returns false on timeout.
+	bool waitEvent(WindowEvent& event, int timeoutMs = -1);
+
+	// Descriptor that becomes readable when events arrive, for poll() or
+	// epoll based loops: the X connection, or a pipe signalling injected
+	// events on a headless canvas. Call getEvent() or pollEvents() until
+	// they run dry after it fires. Returns -1 on Win32.
+	int getNativeFd() const;
+
+	// Drain up to 'maxCount' queued events into 'events' without waiting.
+	// Returns the number of events written.
+	uint32_t pollEvents(WindowEvent* events, uint32_t maxCount);
+
+	// When enabled, pollEvents() folds consecutive cursor moves into the last
+	// position and drops auto-repeated key release/press pairs (X11 only).
+	void setEventCoalescing(bool enabled);
+
+	// Clear the internal pixel buffer by filling it with 0.
+	void clear();
+
+	// Fill the internal pixel buffer with 'color' (0xAARRGGBB, alpha is
+	// dropped on 24 bit canvases, the low byte is the palette index on 8 bit
+	// ones). Large buffers bypass the caches.
+	void clear(uint32_t color);
+
+	// The drawing functions below clip against the canvas bounds.
+	void fillRect(int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t color);
+
+	// Fill 'length' pixels of row 'y' starting at 'x'.
+	void fillSpan(int32_t x, int32_t y, uint32_t length, uint32_t color);
+
+	// Copy a rectangle of the pixel buffer, overlapping regions are allowed.
+	void copyRect(int32_t dstX, int32_t dstY, int32_t srcX, int32_t srcY, uint32_t width, uint32_t height);
+
+	// Add a region to the set sent by the next blit(). Overlapping regions
+	// are merged and the set is kept under MAX_DIRTY_RECTS rectangles.
+	void markDirty(int32_t x, int32_t y, uint32_t width, uint32_t height);
+
+	// Let blit() find the changed regions itself: it hashes every 32 x 32
+	// tile, compares with the last frame and sends only the tiles that
+	// changed, or the whole frame when more than half of them did. Adds one
+	// read of the pixel buffer per blit(). Off by default.
+	void setDamageDetection(bool enabled);
+
+	bool isDamageDetectionEnabled() const;
+
+	//Send the internal pixel buffer to the display.
+	// Only the regions passed to markDirty() are sent if there are any.
+	void blit();
+
+	// Send only the given regions of the internal pixel buffer to the display.
+	void blit(const WindowRect* rects, uint32_t count);
+
+	// Use 'count' pixel buffers (1 to MAX_BUFFER_COUNT). With 2 or 3 buffers
+	// uploads run on a presenter thread and present() returns as soon as a
+	// free buffer is available. Each buffer keeps its own content, so frames
+	// have to be redrawn completely. 8 bit canvases have a single buffer.
+	// Returns 0 on success.
+	int setBufferCount(uint32_t count);
+
+	uint32_t getBufferCount() const;
+
+	// Queue the current back buffer for display and switch to the next free
+	// one, waiting if all of them are queued. Same as blit() with 1 buffer.
+	// In multi-buffered mode blit() behaves like present().
+	void present();
+
+	// Number of buffers waiting for or in the middle of an upload.
+	uint32_t getQueuedBufferCount() const;
+
+	// Send the queued drawing requests to the display. With 'wait' set, also
+	// block until the display has processed them.
+	void flush(bool wait = false);
+
+	// Split the pixel buffer in tiles of about 'tileWidth' x 'tileHeight' and
+	// run 'function' on all of them in parallel, returning immediately. The
+	// tile width is rounded up so that tiles start on 64 byte boundaries.
+	// blit() and present() wait for the tiles to finish.
+	void renderTiles(TileFunction function, void* user = nullptr, uint32_t tileWidth = 64, uint32_t tileHeight = 64);
+
+	// Block until the tiles started by renderTiles() are done, helping with
+	// the remaining ones.
+	void waitTiles();
+
+	// Number of threads running tiles, including the one calling waitTiles().
+	uint32_t getTileThreadCount();
+
+	// With 'enabled', blit() waits for the display to process every frame
+	// (XSync, GdiFlush) before taking its completion time, at the cost of a
+	// round trip. Otherwise a frame completes once its requests are queued.
+	// Off by default.
+	void setPresentSync(bool enabled);
+
+	bool isPresentSyncEnabled() const;
+
+	// getMonotonicTime() when the last blit() or present() started sending
+	// the frame, after the tiles were done, and when it completed. With more
+	// than one buffer a frame completes once it is queued for the presenter.
+	uint64_t getLastSubmitTime() const;
+
+	uint64_t getLastCompleteTime() const;
+
+	// Time from the reception of the oldest input event read by getEvent()
+	// or pollEvents() before a frame to the completion of that frame, over
+	// the last LATENCY_WINDOW frames that followed input.
+	InputLatency getInputLatency() const;
+
+	void resetInputLatency();
+
+	// Called by blit() on a headless canvas with the presented regions.
+	void setFrameSink(FrameSink sink, void* user = nullptr);
+
+	// Hand every presented frame to 'recorder', nullptr stops. Set by
+	// FrameRecorder::open() and close().
+	void setFrameRecorder(FrameRecorder* recorder);
+};
+
+typedef WindowCanvas WCanvas;
+
+// Display connection shared by several canvases. The events of all windows
+// are read by one pump and routed to the canvas owning the window, so every
+// canvas still reads its own events with getEvent()/pollEvents(). Blits made
+// between beginBatch() and endBatch() are sent with a single flush.
+class CanvasContext {
+public:
+	// Upper limit of canvases sharing one context.
+	static const uint32_t MAX_CANVAS_COUNT = 64;
+
+private:
+	friend class WindowCanvas;
+
+	WindowCanvas::Backend backend;
+	WindowCanvas* canvases[MAX_CANVAS_COUNT];
+	uint32_t canvasCount;
+	bool batching;
+#if defined (__linux__)
+	Display* display;
+	// An image presented during the batch still needs the server to read it.
+	bool batchNeedsSync;
+	XcbEventQueue xcbQueue;
+#endif
+
+	bool addCanvas(WindowCanvas* canvas);
+	void removeCanvas(WindowCanvas* canvas);
+#if defined (__linux__)
+	WindowCanvas* findCanvas(Window window) const;
+#endif
+
+	CanvasContext(const CanvasContext&);
+	CanvasContext& operator=(const CanvasContext&);
+
+public:
+	// Opens the display connection, check it with isOpen().
+	CanvasContext(WindowCanvas::Backend backend = WindowCanvas::Default);
+
+	~CanvasContext();
+
+	bool isOpen() const;
+
+	WindowCanvas::Backend getBackend() const;
+
+	uint32_t getCanvasCount() const;
+
+	// The shared X connection descriptor, see WindowCanvas::getNativeFd().
+	// Returns -1 when there is none.
+	int getNativeFd() const;
+
+	// Read every pending window event and queue it on its canvas. Called by
+	// the canvases when their queue is empty. Returns the number of events
+	// queued.
+	uint32_t pumpEvents();
+
+	// Until endBatch(), blit() on the canvases of this context only queues
+	// the images. The pixel buffers must not be touched before endBatch().
+	void beginBatch();
+
+	// Send the images queued since beginBatch() and wait until the server
+	// has read them, one round trip for all windows.
+	void endBatch();
+
+	// Blit every canvas of the context in one batch.
+	void blitAll();
+};
+
 #endif // __WINDOW_CANVAS_H__
\ No newline at end of file